@@ -3,10 +3,25 @@
 #ifndef __BASE_DEF_H__
 #define __BASE_DEF_H__
 
+#define LOG_NAMESPACE_BEGIN namespace Log {
+#define LOG_NAMESPACE_END }
+
 #define MESSAGING_BEGIN  namespace messaging {
 #define MESSAGING_END }
 
 
+#define METRICS_BEGIN namespace metrics {
+#define METRICS_END }
+
+#define BENCHMARK_BEGIN namespace bench {
+#define BENCHMARK_END }
+
+#define CORO_BEGIN namespace coro {
+#define CORO_END }
+
+#define PIPELINE_BEGIN namespace pipeline {
+#define PIPELINE_END }
+
 #define THREADSAFT_CONTAINER_BEGIN namespace threadsafe_container {
 #define THREADSAFT_CONTAINER_END }
 #endif // !__BASE_DEF_H__
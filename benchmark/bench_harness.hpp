@@ -0,0 +1,200 @@
+#pragma once
+
+#ifndef __BENCH_HARNESS_H__
+#define __BENCH_HARNESS_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "base_def.h"
+
+BENCHMARK_BEGIN
+
+using Clock = std::chrono::steady_clock;
+
+inline std::uint64_t elapsed_ns(Clock::time_point start, Clock::time_point end = Clock::now())
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+/*What one repetition of a benchmark reports back*/
+struct Sample
+{
+    Sample() = default;
+    Sample(std::uint64_t ops, std::uint64_t ns) :_ops(ops), _ns(ns) {}
+
+    std::uint64_t _ops = 0;
+    std::uint64_t _ns = 0;
+    /*Optional per-operation latencies, e.g. enqueue-to-start of pool tasks*/
+    std::vector<std::uint64_t> _latenciesNs;
+};
+
+struct Config
+{
+    int _warmup = 1;
+    int _reps = 5;
+    double _scale = 1.0;
+    unsigned _maxThreads = std::max(2u, std::thread::hardware_concurrency());
+    std::string _filter;
+    std::string _format = "text";
+
+    /*Problem sizes are multiplied by --scale so CI can run a short smoke pass*/
+    std::uint64_t scaled(std::uint64_t n) const
+    {
+        return std::max<std::uint64_t>(1, static_cast<std::uint64_t>(n * _scale));
+    }
+};
+
+struct Result
+{
+    std::string _name;
+    std::string _params;
+    std::uint64_t _opsPerRep = 0;
+    std::vector<double> _nsPerOp;
+    std::vector<std::uint64_t> _latenciesNs;
+
+    static double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty()) return 0.0;
+        std::sort(values.begin(), values.end());
+        size_t idx = static_cast<size_t>(p / 100.0 * (values.size() - 1) + 0.5);
+        return values[idx];
+    }
+
+    static std::uint64_t percentile(std::vector<std::uint64_t>& sorted, double p)
+    {
+        if (sorted.empty()) return 0;
+        size_t idx = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+        return sorted[idx];
+    }
+
+    double median() const { return percentile(_nsPerOp, 50); }
+    double opsPerSecond() const { double m = median(); return m > 0 ? 1e9 / m : 0.0; }
+};
+
+class Runner
+{
+public:
+    using BenchFunc = std::function<Sample()>;
+
+    explicit Runner(Config config) :_config(std::move(config)) {}
+
+    const Config& config() const { return _config; }
+
+    bool selected(const std::string& name) const
+    {
+        return _config._filter.empty() || name.find(_config._filter) != std::string::npos;
+    }
+
+    /*Runs warmup + measured repetitions of func and records the result under name/params*/
+    void run(const std::string& name, const std::string& params, const BenchFunc& func)
+    {
+        if (!selected(name))
+        {
+            return;
+        }
+        for (int i = 0; i < _config._warmup; ++i)
+        {
+            func();
+        }
+        Result result;
+        result._name = name;
+        result._params = params;
+        for (int i = 0; i < _config._reps; ++i)
+        {
+            Sample sample = func();
+            result._opsPerRep = sample._ops;
+            result._nsPerOp.push_back(sample._ops == 0 ? 0.0 : static_cast<double>(sample._ns) / sample._ops);
+            result._latenciesNs.insert(result._latenciesNs.end(), sample._latenciesNs.begin(), sample._latenciesNs.end());
+        }
+        std::sort(result._latenciesNs.begin(), result._latenciesNs.end());
+        if (_config._format == "text")
+        {
+            printText(result);
+        }
+        _results.push_back(std::move(result));
+    }
+
+    /*csv and json are written once all benchmarks finished so the output stays parseable*/
+    void finish(std::ostream& os = std::cout)
+    {
+        if (_config._format == "csv")
+        {
+            os << "name,params,ops_per_rep,reps,ns_per_op_min,ns_per_op_median,ns_per_op_p90,ns_per_op_max,ops_per_sec,lat_p50_ns,lat_p99_ns,lat_p999_ns\n";
+            for (auto& r : _results)
+            {
+                os << r._name << ",\"" << r._params << "\"," << r._opsPerRep << "," << r._nsPerOp.size() << ","
+                    << Result::percentile(r._nsPerOp, 0) << "," << r.median() << "," << Result::percentile(r._nsPerOp, 90) << ","
+                    << Result::percentile(r._nsPerOp, 100) << "," << r.opsPerSecond() << ","
+                    << Result::percentile(r._latenciesNs, 50) << "," << Result::percentile(r._latenciesNs, 99) << ","
+                    << Result::percentile(r._latenciesNs, 99.9) << "\n";
+            }
+        }
+        else if (_config._format == "json")
+        {
+            os << "[\n";
+            for (size_t i = 0; i < _results.size(); ++i)
+            {
+                auto& r = _results[i];
+                os << "  {\"name\": \"" << r._name << "\", \"params\": \"" << r._params << "\", \"ops_per_rep\": " << r._opsPerRep
+                    << ", \"ns_per_op\": [";
+                for (size_t j = 0; j < r._nsPerOp.size(); ++j)
+                {
+                    os << (j ? ", " : "") << r._nsPerOp[j];
+                }
+                os << "], \"ns_per_op_median\": " << r.median() << ", \"ops_per_sec\": " << r.opsPerSecond();
+                if (!r._latenciesNs.empty())
+                {
+                    os << ", \"latency_ns\": {\"p50\": " << Result::percentile(r._latenciesNs, 50)
+                        << ", \"p99\": " << Result::percentile(r._latenciesNs, 99)
+                        << ", \"p99.9\": " << Result::percentile(r._latenciesNs, 99.9)
+                        << ", \"max\": " << r._latenciesNs.back() << "}";
+                }
+                os << "}" << (i + 1 < _results.size() ? "," : "") << "\n";
+            }
+            os << "]\n";
+        }
+    }
+
+private:
+    void printText(Result& r)
+    {
+        std::ostringstream line;
+        line << std::left << std::setw(28) << r._name << std::setw(30) << r._params << std::right << std::fixed << std::setprecision(1)
+            << std::setw(12) << r.median() << " ns/op  [min " << Result::percentile(r._nsPerOp, 0)
+            << ", p90 " << Result::percentile(r._nsPerOp, 90) << "]  " << std::setprecision(0) << std::setw(14) << r.opsPerSecond() << " ops/s";
+        if (!r._latenciesNs.empty())
+        {
+            line << "  lat p50/p99/p99.9 " << Result::percentile(r._latenciesNs, 50) << "/" << Result::percentile(r._latenciesNs, 99)
+                << "/" << Result::percentile(r._latenciesNs, 99.9) << " ns";
+        }
+        std::cout << line.str() << std::endl;
+    }
+
+private:
+    Config _config;
+    std::vector<Result> _results;
+};
+
+/*Keeps the optimizer from discarding a computed value*/
+template<class T>
+inline void do_not_optimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T* sink;
+    sink = &value;
+#endif
+}
+
+BENCHMARK_END
+
+#endif //!__BENCH_HARNESS_H__
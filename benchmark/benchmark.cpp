@@ -0,0 +1,994 @@
+/*
+ * Microbenchmarks for the containers, the thread pool, the parallel algorithms and the logger.
+ *
+ *   benchmark [--filter=<substring>] [--reps=N] [--warmup=N] [--scale=X] [--threads=N]
+ *             [--format=text|csv|json]
+ *
+ * Build with the same include directories as main.cpp (-O2, linked against boost_thread and the
+ * logger). csv/json go to stdout after all runs so results can be diffed between commits.
+ * The coroutine benchmarks are only built with -std=c++20.
+ */
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench_harness.hpp"
+#include "my_algorithm.hpp"
+#include "external_sort.hpp"
+#include "group_by.hpp"
+#include "threadsafe_stack.hpp"
+#include "threadsafe_queue.hpp"
+#include "threadsafe_map.hpp"
+#include "concurrent_ordered_map.hpp"
+#include "concurrent_priority_queue.hpp"
+#include "spsc_channel.hpp"
+#include "timer_wheel.hpp"
+#include "simple_thread_pool.hpp"
+#include "logger.h"
+#include "actor.hpp"
+#include "pipeline.hpp"
+#include "task.hpp"
+
+using threadsafe_container::threadsafe_queue;
+using threadsafe_container::threadsaft_stack;
+using threadsafe_container::threadsafe_map;
+using threadsafe_container::concurrent_ordered_map;
+using threadsafe_container::concurrent_priority_queue;
+using threadsafe_container::relaxed_priority_queue;
+using threadsafe_container::spsc_channel;
+using threadsafe_container::spsc_wait;
+using threadsafe_container::TaskPriority;
+
+BENCHMARK_BEGIN
+
+/*Cheap per-thread generator; std::default_random_engine reseeding would dominate the timings*/
+struct XorShift
+{
+    std::uint64_t _state;
+    explicit XorShift(std::uint64_t seed) :_state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+    std::uint64_t operator()()
+    {
+        _state ^= _state << 13;
+        _state ^= _state >> 7;
+        _state ^= _state << 17;
+        return _state;
+    }
+};
+
+/*Releases all worker threads at once so thread start-up is not measured*/
+class StartGate
+{
+public:
+    void wait() const
+    {
+        while (!_open.load(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+    }
+    void open() { _open.store(true, std::memory_order_release); }
+private:
+    std::atomic<bool> _open{ false };
+};
+
+template<class Container, class... Args>
+Sample producer_consumer(unsigned producers, unsigned consumers, std::uint64_t items, Args... args)
+{
+    Container container(args...);
+    const std::uint64_t perProducer = items / producers;
+    const std::uint64_t total = perProducer * producers;
+    StartGate gate;
+    std::vector<std::thread> threads;
+    for (unsigned p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&, p]() {
+            gate.wait();
+            for (std::uint64_t i = 0; i < perProducer; ++i)
+            {
+                container.push(static_cast<int>(i + p));
+            }
+        });
+    }
+    for (unsigned c = 0; c < consumers; ++c)
+    {
+        const std::uint64_t quota = total / consumers + (c < total % consumers ? 1 : 0);
+        threads.emplace_back([&, quota]() {
+            gate.wait();
+            int value = 0;
+            for (std::uint64_t i = 0; i < quota; ++i)
+            {
+                container.wait_and_pop(value);
+            }
+            do_not_optimize(value);
+        });
+    }
+    auto start = Clock::now();
+    gate.open();
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    return Sample{ total, elapsed_ns(start) };
+}
+
+void bench_queue_and_stack(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t items = conf.scaled(1000000);
+    const unsigned maxThreads = conf._maxThreads;
+    struct Shape { const char* _kind; unsigned _producers; unsigned _consumers; };
+    std::vector<Shape> shapes{ {"spsc", 1, 1}, {"mpsc", 2, 1}, {"mpsc", maxThreads, 1},
+                               {"mpmc", 2, 2}, {"mpmc", maxThreads, maxThreads} };
+    for (size_t i = 0; i < shapes.size(); ++i)
+    {
+        const Shape& shape = shapes[i];
+        if (i > 0 && shape._producers == shapes[i - 1]._producers && shape._consumers == shapes[i - 1]._consumers)
+        {
+            continue;
+        }
+        std::string params = std::string(shape._kind) + " p=" + std::to_string(shape._producers) + " c=" + std::to_string(shape._consumers);
+        runner.run("queue_push_pop", params, [&]() {
+            return producer_consumer<threadsafe_queue<int>>(shape._producers, shape._consumers, items);
+        });
+        /*producers throttled by a full queue instead of running ahead of the consumers*/
+        runner.run("queue_push_pop_bounded", params + " cap=1024", [&]() {
+            return producer_consumer<threadsafe_queue<int>>(shape._producers, shape._consumers, items, size_t(1024));
+        });
+        runner.run("stack_push_pop", params, [&]() {
+            return producer_consumer<threadsaft_stack<int>>(shape._producers, shape._consumers, items);
+        });
+    }
+}
+
+/*One producer, one consumer; batch > 1 uses push_batch/try_pop_batch*/
+Sample spsc_transfer(spsc_wait waitMode, size_t batch, std::uint64_t items)
+{
+    spsc_channel<std::uint64_t> channel(4096, waitMode);
+    StartGate gate;
+    std::thread producer([&]() {
+        std::vector<std::uint64_t> buffer(batch);
+        gate.wait();
+        for (std::uint64_t i = 0; i < items; i += batch)
+        {
+            if (batch == 1)
+            {
+                channel.push(i);
+                continue;
+            }
+            std::iota(buffer.begin(), buffer.end(), i);
+            channel.push_batch(buffer.begin(), buffer.end());
+        }
+    });
+    const std::uint64_t total = (items + batch - 1) / batch * batch;
+    std::vector<std::uint64_t> buffer(batch);
+    std::uint64_t received = 0, sum = 0, value = 0;
+    auto start = Clock::now();
+    gate.open();
+    while (received < total)
+    {
+        size_t n = batch == 1 ? 0 : channel.try_pop_batch(buffer.begin(), batch);
+        if (n == 0)
+        {
+            channel.wait_and_pop(value);
+            sum += value;
+            ++received;
+        }
+        received += n;
+    }
+    std::uint64_t ns = elapsed_ns(start);
+    producer.join();
+    do_not_optimize(sum);
+    return Sample{ total, ns };
+}
+
+void bench_spsc(Runner& runner)
+{
+    const std::uint64_t items = runner.config().scaled(20000000);
+    for (spsc_wait waitMode : { spsc_wait::SPIN, spsc_wait::BLOCK })
+    {
+        for (size_t batch : { size_t{ 1 }, size_t{ 64 } })
+        {
+            std::string params = std::string(waitMode == spsc_wait::SPIN ? "spin" : "block") + " batch=" + std::to_string(batch);
+            runner.run("spsc_channel", params, [&]() { return spsc_transfer(waitMode, batch, items); });
+        }
+    }
+}
+
+void bench_map(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t opsPerThread = conf.scaled(200000);
+    for (unsigned size : { 1000u, 90000u })
+    {
+        for (unsigned readPercent : { 50u, 90u, 99u })
+        {
+            for (unsigned threadNum : { 1u, conf._maxThreads })
+            {
+                std::string params = "size=" + std::to_string(size) + " read=" + std::to_string(readPercent) + "% t=" + std::to_string(threadNum);
+                runner.run("map_read_write", params, [&]() {
+                    /*pre-sized above the key count so the run never hits the rehash path*/
+                    threadsafe_map<unsigned, unsigned> map(98317);
+                    for (unsigned k = 0; k < size; ++k)
+                    {
+                        map.addPair(k, k);
+                    }
+                    StartGate gate;
+                    std::vector<std::thread> threads;
+                    for (unsigned t = 0; t < threadNum; ++t)
+                    {
+                        threads.emplace_back([&, t]() {
+                            XorShift rng(t + 1);
+                            unsigned sink = 0;
+                            gate.wait();
+                            for (std::uint64_t i = 0; i < opsPerThread; ++i)
+                            {
+                                std::uint64_t r = rng();
+                                unsigned key = static_cast<unsigned>(r % size);
+                                if ((r >> 32) % 100 < readPercent)
+                                {
+                                    sink += map.getValue(key);
+                                }
+                                else
+                                {
+                                    map.addPair(key, static_cast<unsigned>(i));
+                                }
+                            }
+                            do_not_optimize(sink);
+                        });
+                    }
+                    auto start = Clock::now();
+                    gate.open();
+                    for (auto& t : threads)
+                    {
+                        t.join();
+                    }
+                    return Sample{ opsPerThread * threadNum, elapsed_ns(start) };
+                });
+            }
+        }
+    }
+}
+
+/*Startup warmup: one addPair per entry against a single insert_bulk, serial and on the pool*/
+void bench_map_bulk(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const unsigned size = static_cast<unsigned>(conf.scaled(1000000));
+    std::vector<std::pair<unsigned, unsigned>> input;
+    input.reserve(size);
+    for (unsigned k = 0; k < size; ++k)
+    {
+        input.emplace_back(k * 2654435761u, k);
+    }
+    const std::string params = "size=" + std::to_string(size);
+    runner.run("map_load_add_pair", params, [&]() {
+        threadsafe_map<unsigned, unsigned> map;
+        auto start = Clock::now();
+        for (const auto& entry : input)
+        {
+            map.addPair(entry.first, entry.second);
+        }
+        return Sample{ size, elapsed_ns(start) };
+    });
+    runner.run("map_load_insert_bulk", params, [&]() {
+        threadsafe_map<unsigned, unsigned> map;
+        auto start = Clock::now();
+        map.insert_bulk(input.begin(), input.end());
+        return Sample{ size, elapsed_ns(start) };
+    });
+    SimpleThreadPool pool(conf._maxThreads);
+    runner.run("map_load_insert_bulk_pool", params + " t=" + std::to_string(conf._maxThreads), [&]() {
+        threadsafe_map<unsigned, unsigned> map;
+        auto start = Clock::now();
+        map.insert_bulk(input.begin(), input.end(), pool);
+        return Sample{ size, elapsed_ns(start) };
+    });
+    threadsafe_map<unsigned, unsigned> loaded;
+    loaded.insert_bulk(input.begin(), input.end(), pool);
+    runner.run("map_snapshot_pool", params + " t=" + std::to_string(conf._maxThreads), [&]() {
+        auto start = Clock::now();
+        auto copy = loaded.snapshot(pool);
+        do_not_optimize(copy.size());
+        return Sample{ size, elapsed_ns(start) };
+    });
+}
+
+/*Count rows per key: every thread upserting into one shared map vs thread-local pre-aggregation*/
+void bench_group_by(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t rows = conf.scaled(4000000);
+    const unsigned threadNum = conf._maxThreads;
+    for (unsigned keys : { 1000u, 1000000u })
+    {
+        std::vector<unsigned> column(rows);
+        XorShift rng(keys);
+        for (auto& v : column)
+        {
+            v = static_cast<unsigned>(rng() % keys);
+        }
+        std::string params = "rows=" + std::to_string(rows) + " keys=" + std::to_string(keys) + " t=" + std::to_string(threadNum);
+        runner.run("group_by_count_upsert", params, [&]() {
+            threadsafe_map<unsigned, std::uint64_t> counts;
+            StartGate gate;
+            std::vector<std::thread> threads;
+            for (unsigned t = 0; t < threadNum; ++t)
+            {
+                threads.emplace_back([&, t]() {
+                    gate.wait();
+                    for (std::uint64_t i = rows * t / threadNum; i < rows * (t + 1) / threadNum; ++i)
+                    {
+                        counts.upsert(column[i], [](std::uint64_t& c) { ++c; }, std::uint64_t{ 1 });
+                    }
+                });
+            }
+            auto start = Clock::now();
+            gate.open();
+            for (auto& t : threads)
+            {
+                t.join();
+            }
+            return Sample{ rows, elapsed_ns(start) };
+        });
+        runner.run("group_by_count_flat", params, [&]() {
+            auto start = Clock::now();
+            auto counts = parallel_group_by(column.begin(), column.end(), [](unsigned key) { return key; },
+                [](unsigned) { return std::uint64_t{ 1 }; }, [](std::uint64_t& into, std::uint64_t&& from) { into += from; }, threadNum);
+            std::uint64_t ns = elapsed_ns(start);
+            do_not_optimize(counts.size());
+            return Sample{ rows, ns };
+        });
+        runner.run("group_by_count_parallel", params, [&]() {
+            threadsafe_map<unsigned, std::uint64_t> counts;
+            auto start = Clock::now();
+            parallel_group_by_into(counts, column.begin(), column.end(), [](unsigned key) { return key; },
+                [](unsigned) { return std::uint64_t{ 1 }; }, [](std::uint64_t& into, std::uint64_t&& from) { into += from; }, threadNum);
+            return Sample{ rows, elapsed_ns(start) };
+        });
+    }
+}
+
+/*Point lookups with a share of writes; lookup(key) and update(key, i) adapt the two map interfaces*/
+template<class Lookup, class Update>
+Sample lookup_mix(unsigned threadNum, unsigned keys, unsigned readPercent, std::uint64_t opsPerThread, Lookup lookup, Update update)
+{
+    StartGate gate;
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < threadNum; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            XorShift rng(t + 1);
+            unsigned sink = 0;
+            gate.wait();
+            for (std::uint64_t i = 0; i < opsPerThread; ++i)
+            {
+                std::uint64_t r = rng();
+                unsigned key = static_cast<unsigned>(r % keys);
+                if ((r >> 32) % 100 < readPercent)
+                {
+                    sink += lookup(key);
+                }
+                else
+                {
+                    update(key, static_cast<unsigned>(i));
+                }
+            }
+            do_not_optimize(sink);
+        });
+    }
+    auto start = Clock::now();
+    gate.open();
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    return Sample{ opsPerThread * threadNum, elapsed_ns(start) };
+}
+
+void bench_ordered_map(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t opsPerThread = conf.scaled(200000);
+    const unsigned size = 90000;
+    for (unsigned readPercent : { 90u, 100u })
+    {
+        for (unsigned threadNum : { 1u, conf._maxThreads })
+        {
+            std::string params = "size=" + std::to_string(size) + " read=" + std::to_string(readPercent) + "% t=" + std::to_string(threadNum);
+            runner.run("point_lookup_hash_map", params, [&]() {
+                threadsafe_map<unsigned, unsigned> map(98317);
+                for (unsigned k = 0; k < size; ++k)
+                {
+                    map.addPair(k, k);
+                }
+                return lookup_mix(threadNum, size, readPercent, opsPerThread,
+                    [&](unsigned key) { return map.getValue(key); },
+                    [&](unsigned key, unsigned value) { map.addPair(key, value); });
+            });
+            runner.run("point_lookup_skip_list", params, [&]() {
+                concurrent_ordered_map<unsigned, unsigned> map;
+                for (unsigned k = 0; k < size; ++k)
+                {
+                    map.insert(k, k);
+                }
+                /*values are immutable in the skip list, so a write is an erase plus an insert*/
+                return lookup_mix(threadNum, size, readPercent, opsPerThread,
+                    [&](unsigned key) { return map.find(key).value_or(0); },
+                    [&](unsigned key, unsigned value) {
+                        map.erase(key);
+                        map.insert(key, value);
+                    });
+            });
+        }
+    }
+    for (unsigned span : { 16u, 1024u })
+    {
+        runner.run("skip_list_range_scan", "size=" + std::to_string(size) + " span=" + std::to_string(span), [&]() {
+            concurrent_ordered_map<unsigned, unsigned> map;
+            for (unsigned k = 0; k < size; ++k)
+            {
+                map.insert(k, k);
+            }
+            const std::uint64_t scans = conf.scaled(200000) / span + 1;
+            XorShift rng(1);
+            unsigned sink = 0;
+            auto start = Clock::now();
+            for (std::uint64_t i = 0; i < scans; ++i)
+            {
+                unsigned from = static_cast<unsigned>(rng() % (size - span));
+                map.for_each_range(from, from + span, [&](unsigned, unsigned value) { sink += value; });
+            }
+            do_not_optimize(sink);
+            return Sample{ scans * span, elapsed_ns(start) };
+        });
+    }
+}
+
+/*What the scheduler used before: one std::priority_queue behind one mutex, smallest first*/
+class locked_priority_queue
+{
+public:
+    void push(std::uint64_t value)
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        _heap.push(value);
+    }
+
+    std::optional<std::uint64_t> try_pop_min()
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        if (_heap.empty())
+        {
+            return std::nullopt;
+        }
+        std::uint64_t value = _heap.top();
+        _heap.pop();
+        return value;
+    }
+
+private:
+    std::mutex _m;
+    std::priority_queue<std::uint64_t, std::vector<std::uint64_t>, std::greater<std::uint64_t>> _heap;
+};
+
+/*Each pool task alternates push and try_pop_min on a prefilled queue, like workers rescheduling work*/
+template<class Queue>
+Sample priority_churn(unsigned threadNum, unsigned prefill, std::uint64_t opsPerThread)
+{
+    Queue queue;
+    XorShift fill(7);
+    for (unsigned i = 0; i < prefill; ++i)
+    {
+        queue.push(fill() % 1000000);
+    }
+    SimpleThreadPool pool(threadNum);
+    StartGate gate;
+    std::vector<std::future<void>> done;
+    for (unsigned t = 0; t < threadNum; ++t)
+    {
+        done.push_back(pool.enqueue([&, t]() {
+            XorShift rng(t + 1);
+            std::uint64_t sink = 0;
+            gate.wait();
+            for (std::uint64_t i = 0; i < opsPerThread / 2; ++i)
+            {
+                queue.push(rng() % 1000000);
+                sink += queue.try_pop_min().value_or(0);
+            }
+            do_not_optimize(sink);
+        }));
+    }
+    auto start = Clock::now();
+    gate.open();
+    for (auto& f : done)
+    {
+        f.get();
+    }
+    return Sample{ opsPerThread / 2 * 2 * threadNum, elapsed_ns(start) };
+}
+
+void bench_priority_queue(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t opsPerThread = conf.scaled(200000);
+    const unsigned prefill = 10000;
+    for (unsigned threadNum : { 1u, conf._maxThreads })
+    {
+        std::string params = "prefill=" + std::to_string(prefill) + " t=" + std::to_string(threadNum);
+        runner.run("priority_queue_mutex", params, [&]() {
+            return priority_churn<locked_priority_queue>(threadNum, prefill, opsPerThread);
+        });
+        runner.run("priority_queue_skip_list", params, [&]() {
+            return priority_churn<concurrent_priority_queue<std::uint64_t>>(threadNum, prefill, opsPerThread);
+        });
+        runner.run("priority_queue_relaxed", params, [&]() {
+            return priority_churn<relaxed_priority_queue<std::uint64_t>>(threadNum, prefill, opsPerThread);
+        });
+    }
+}
+
+void bench_pool(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t tasks = conf.scaled(200000);
+    const std::uint64_t pings = conf.scaled(20000);
+    const unsigned threadNum = conf._maxThreads;
+
+    runner.run("pool_task_overhead", "t=" + std::to_string(threadNum), [&]() {
+        SimpleThreadPool pool(threadNum);
+        std::vector<std::future<void>> futures;
+        futures.reserve(tasks);
+        auto start = Clock::now();
+        for (std::uint64_t i = 0; i < tasks; ++i)
+        {
+            futures.push_back(pool.enqueue([]() {}));
+        }
+        for (auto& f : futures)
+        {
+            f.wait();
+        }
+        return Sample{ tasks, elapsed_ns(start) };
+    });
+
+    /*Same as above through continuable_future: one allocation per task instead of packaged_task + shared_ptr*/
+    runner.run("pool_submit_overhead", "t=" + std::to_string(threadNum), [&]() {
+        SimpleThreadPool pool(threadNum);
+        std::vector<threadsafe_container::continuable_future<void>> futures;
+        futures.reserve(tasks);
+        auto start = Clock::now();
+        for (std::uint64_t i = 0; i < tasks; ++i)
+        {
+            futures.push_back(pool.submit([]() {}));
+        }
+        threadsafe_container::when_all(std::move(futures)).get();
+        return Sample{ tasks, elapsed_ns(start) };
+    });
+
+    /*One task at a time on an otherwise idle pool; latencies are enqueue-to-start*/
+    runner.run("pool_task_latency", "t=" + std::to_string(threadNum), [&]() {
+        SimpleThreadPool pool(threadNum);
+        Sample sample;
+        sample._latenciesNs.reserve(pings);
+        auto start = Clock::now();
+        for (std::uint64_t i = 0; i < pings; ++i)
+        {
+            auto enqueued = Clock::now();
+            sample._latenciesNs.push_back(pool.enqueue([enqueued]() { return elapsed_ns(enqueued); }).get());
+        }
+        sample._ns = elapsed_ns(start);
+        sample._ops = pings;
+        return sample;
+    });
+
+    /*Probe latency while LOW bulk work keeps every worker busy; probes as NORMAL show plain FIFO*/
+    const std::uint64_t bulkTasks = conf.scaled(20000);
+    const std::uint64_t probes = conf.scaled(2000);
+    for (TaskPriority probePriority : { TaskPriority::HIGH, TaskPriority::NORMAL })
+    {
+        std::string params = std::string(probePriority == TaskPriority::HIGH ? "probe=HIGH" : "probe=FIFO") + " t=" + std::to_string(threadNum);
+        runner.run("pool_priority_latency", params, [&]() {
+            SimpleThreadPool pool(threadNum);
+            auto spin = []() {
+                auto until = Clock::now() + std::chrono::microseconds(20);
+                while (Clock::now() < until)
+                {
+                }
+            };
+            for (std::uint64_t i = 0; i < bulkTasks; ++i)
+            {
+                pool.post(spin, probePriority == TaskPriority::HIGH ? TaskPriority::LOW : TaskPriority::NORMAL);
+            }
+            Sample sample;
+            std::vector<std::future<std::uint64_t>> results;
+            auto start = Clock::now();
+            for (std::uint64_t i = 0; i < probes; ++i)
+            {
+                auto enqueued = Clock::now();
+                results.push_back(pool.enqueue(probePriority, [enqueued]() { return elapsed_ns(enqueued); }));
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            for (auto& f : results)
+            {
+                sample._latenciesNs.push_back(f.get());
+            }
+            sample._ns = elapsed_ns(start);
+            sample._ops = probes;
+            return sample;
+        });
+    }
+}
+
+/*Senders spread messages over many actors; timed until every message was handled*/
+/*Insert and cancel of far-off timers: the cost of arming a timeout that almost never fires*/
+void bench_timers(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t timers = conf.scaled(1000000);
+    runner.run("timer_schedule_cancel", "n=" + std::to_string(timers), [&]() {
+        threadsafe_container::timer_wheel wheel;
+        std::vector<threadsafe_container::timer_handle> handles;
+        handles.reserve(timers);
+        auto start = Clock::now();
+        for (std::uint64_t i = 0; i < timers; ++i)
+        {
+            handles.push_back(wheel.schedule_after(std::chrono::seconds(60 + i % 3600), []() {}));
+        }
+        for (auto& handle : handles)
+        {
+            wheel.cancel(handle);
+        }
+        return Sample{ timers, elapsed_ns(start) };
+    });
+}
+
+#ifdef __cpp_impl_coroutine
+coro::task<void> await_one(threadsafe_queue<std::uint64_t>& queue, SimpleThreadPool& pool, std::atomic<std::uint64_t>& done)
+{
+    co_await queue.async_pop(pool);
+    done.fetch_add(1);
+}
+
+/*Many suspended coroutines parked on one queue, then woken one value at a time; no thread per waiter*/
+void bench_coroutines(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t waiters = conf.scaled(200000);
+    const unsigned threadNum = conf._maxThreads;
+    runner.run("coro_async_pop", "waiters=" + std::to_string(waiters) + " t=" + std::to_string(threadNum), [&]() {
+        SimpleThreadPool pool(threadNum);
+        threadsafe_queue<std::uint64_t> queue;
+        std::atomic<std::uint64_t> done{ 0 };
+        auto start = Clock::now();
+        for (std::uint64_t i = 0; i < waiters; ++i)
+        {
+            coro::spawn(await_one(queue, pool, done));
+        }
+        for (std::uint64_t i = 0; i < waiters; ++i)
+        {
+            queue.push(i);
+        }
+        while (done.load() != waiters)
+        {
+            std::this_thread::yield();
+        }
+        return Sample{ waiters, elapsed_ns(start) };
+    });
+}
+#endif
+
+void bench_actors(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t messages = conf.scaled(1000000);
+    const unsigned senders = conf._maxThreads;
+    for (unsigned actorNum : { 1u, 64u, 1024u })
+    {
+        std::string params = "actors=" + std::to_string(actorNum) + " senders=" + std::to_string(senders);
+        runner.run("actor_send", params, [&]() {
+            struct Tick { std::uint64_t _value; };
+            SimpleThreadPool pool(conf._maxThreads);
+            std::atomic<std::uint64_t> handled{ 0 };
+            std::vector<std::shared_ptr<messaging::actor>> actors;
+            for (unsigned a = 0; a < actorNum; ++a)
+            {
+                auto actor = messaging::spawn<messaging::actor>(pool);
+                actor->handle<Tick>([&handled](Tick&) { handled.fetch_add(1, std::memory_order_relaxed); });
+                actors.push_back(actor);
+            }
+            const std::uint64_t perSender = messages / senders;
+            StartGate gate;
+            std::vector<std::thread> threads;
+            for (unsigned t = 0; t < senders; ++t)
+            {
+                threads.emplace_back([&, t]() {
+                    gate.wait();
+                    for (std::uint64_t i = 0; i < perSender; ++i)
+                    {
+                        actors[(i + t) % actorNum]->send(Tick{ i });
+                    }
+                });
+            }
+            auto start = Clock::now();
+            gate.open();
+            for (auto& t : threads)
+            {
+                t.join();
+            }
+            while (handled.load(std::memory_order_relaxed) < perSender * senders)
+            {
+                std::this_thread::yield();
+            }
+            return Sample{ perSender * senders, elapsed_ns(start) };
+        });
+    }
+}
+
+void bench_pipeline(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t items = conf.scaled(200000);
+    /*a few hundred ns of hashing per item, so the parallel stage is the slow one*/
+    auto work = [](std::uint64_t v) {
+        for (int i = 0; i < 64; ++i)
+        {
+            v ^= v << 13;
+            v ^= v >> 7;
+            v ^= v << 17;
+        }
+        return v;
+    };
+    for (size_t batch : { size_t{ 1 }, size_t{ 64 } })
+    {
+        std::string params = "threads=" + std::to_string(conf._maxThreads) + " batch=" + std::to_string(batch);
+        runner.run("pipeline_parallel_in_order", params, [&]() {
+            SimpleThreadPool pool(conf._maxThreads);
+            std::uint64_t next = 0;
+            std::uint64_t sum = 0;
+            auto source = [&]() -> std::optional<std::uint64_t> {
+                if (next == items)
+                {
+                    return std::nullopt;
+                }
+                return next++;
+            };
+            auto start = Clock::now();
+            if (batch == 1)
+            {
+                auto p = pipeline::source(source)
+                    .then(pipeline::parallel(), work)
+                    .sink(pipeline::serial_in_order(), [&](std::uint64_t v) { sum += v; });
+                p.run(pool, 4 * conf._maxThreads);
+            }
+            else
+            {
+                auto p = pipeline::source(source)
+                    .batch(batch)
+                    .then(pipeline::parallel(), [&](std::vector<std::uint64_t> values) {
+                        for (auto& v : values)
+                        {
+                            v = work(v);
+                        }
+                        return values;
+                    })
+                    .sink(pipeline::serial_in_order(), [&](std::vector<std::uint64_t> values) {
+                        sum = std::accumulate(values.begin(), values.end(), sum);
+                    });
+                p.run(pool, 4 * conf._maxThreads);
+            }
+            std::uint64_t ns = elapsed_ns(start);
+            do_not_optimize(sum);
+            return Sample{ items, ns };
+        });
+    }
+}
+
+void bench_algorithms(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t accumulateSize = conf.scaled(20000000);
+    const std::uint64_t sortSize = conf.scaled(1000000);
+
+    std::vector<std::uint64_t> numbers(accumulateSize);
+    std::iota(numbers.begin(), numbers.end(), 0);
+    runner.run("accumulate", "std n=" + std::to_string(accumulateSize), [&]() {
+        auto start = Clock::now();
+        std::uint64_t sum = std::accumulate(numbers.begin(), numbers.end(), std::uint64_t{ 0 });
+        std::uint64_t ns = elapsed_ns(start);
+        do_not_optimize(sum);
+        return Sample{ accumulateSize, ns };
+    });
+    runner.run("accumulate", "parallel n=" + std::to_string(accumulateSize), [&]() {
+        auto start = Clock::now();
+        std::uint64_t sum = parallel_accumulate(numbers.begin(), numbers.end(), std::uint64_t{ 0 });
+        std::uint64_t ns = elapsed_ns(start);
+        do_not_optimize(sum);
+        return Sample{ accumulateSize, ns };
+    });
+
+    std::vector<int> unsorted(sortSize);
+    XorShift rng(42);
+    for (auto& v : unsorted)
+    {
+        v = static_cast<int>(rng() % 1000000000);
+    }
+    runner.run("sort", "std n=" + std::to_string(sortSize), [&]() {
+        std::vector<int> data = unsorted;
+        auto start = Clock::now();
+        std::sort(data.begin(), data.end());
+        return Sample{ sortSize, elapsed_ns(start) };
+    });
+    runner.run("sort", "parallel n=" + std::to_string(sortSize) + " t=" + std::to_string(conf._maxThreads), [&]() {
+        std::vector<int> data = unsorted;
+        auto start = Clock::now();
+        parallel_sort(data, static_cast<int>(conf._maxThreads));
+        return Sample{ sortSize, elapsed_ns(start) };
+    });
+
+    /*queries that only need a few ranks: top 100, the median, the sorted first 1000*/
+    const std::uint64_t selectSize = conf.scaled(10000000);
+    const size_t topK = 100;
+    std::vector<int> unselected(selectSize);
+    for (auto& v : unselected)
+    {
+        v = static_cast<int>(rng() % 1000000000);
+    }
+    runner.run("top_k", "std::partial_sort_copy n=" + std::to_string(selectSize) + " k=" + std::to_string(topK), [&]() {
+        std::vector<int> top(topK);
+        auto start = Clock::now();
+        std::partial_sort_copy(unselected.begin(), unselected.end(), top.begin(), top.end());
+        std::uint64_t ns = elapsed_ns(start);
+        do_not_optimize(top.front());
+        return Sample{ selectSize, ns };
+    });
+    runner.run("top_k", "parallel n=" + std::to_string(selectSize) + " k=" + std::to_string(topK) + " t=" + std::to_string(conf._maxThreads), [&]() {
+        auto start = Clock::now();
+        std::vector<int> top = parallel_top_k(unselected.begin(), unselected.end(), topK, std::less<>(), conf._maxThreads);
+        std::uint64_t ns = elapsed_ns(start);
+        do_not_optimize(top.front());
+        return Sample{ selectSize, ns };
+    });
+    runner.run("nth_element", "std median n=" + std::to_string(selectSize), [&]() {
+        std::vector<int> data = unselected;
+        auto start = Clock::now();
+        std::nth_element(data.begin(), data.begin() + selectSize / 2, data.end());
+        return Sample{ selectSize, elapsed_ns(start) };
+    });
+    runner.run("nth_element", "parallel median n=" + std::to_string(selectSize) + " t=" + std::to_string(conf._maxThreads), [&]() {
+        std::vector<int> data = unselected;
+        auto start = Clock::now();
+        parallel_nth_element(data.begin(), data.begin() + selectSize / 2, data.end(), std::less<>(), conf._maxThreads);
+        return Sample{ selectSize, elapsed_ns(start) };
+    });
+    const size_t sortedPrefix = std::min<size_t>(1000, selectSize);
+    runner.run("partial_sort", "std n=" + std::to_string(selectSize) + " k=" + std::to_string(sortedPrefix), [&]() {
+        std::vector<int> data = unselected;
+        auto start = Clock::now();
+        std::partial_sort(data.begin(), data.begin() + sortedPrefix, data.end());
+        return Sample{ selectSize, elapsed_ns(start) };
+    });
+    runner.run("partial_sort", "parallel n=" + std::to_string(selectSize) + " k=" + std::to_string(sortedPrefix) + " t=" + std::to_string(conf._maxThreads), [&]() {
+        std::vector<int> data = unselected;
+        auto start = Clock::now();
+        parallel_partial_sort(data.begin(), data.begin() + sortedPrefix, data.end(), std::less<>(), conf._maxThreads);
+        return Sample{ selectSize, elapsed_ns(start) };
+    });
+}
+
+void bench_external_sort(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t records = conf.scaled(8000000);
+    const std::string input = (std::filesystem::temp_directory_path() / "bench_external_sort.in").string();
+    const std::string output = (std::filesystem::temp_directory_path() / "bench_external_sort.out").string();
+    {
+        std::vector<std::uint64_t> data(records);
+        XorShift rng(11);
+        for (auto& v : data)
+        {
+            v = rng();
+        }
+        std::ofstream out(input, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(std::uint64_t)));
+    }
+    /*a budget of an eighth of the file forces a real spill and merge*/
+    external_sort_options options;
+    options._memoryBudget = std::max<size_t>(records * sizeof(std::uint64_t) / 8, size_t{ 1 } << 20);
+    options._threads = conf._maxThreads;
+    runner.run("external_sort", "n=" + std::to_string(records) + " budget=" + std::to_string(options._memoryBudget >> 20) + "MB t=" + std::to_string(conf._maxThreads), [&]() {
+        auto start = Clock::now();
+        external_sort_stats stats = external_sort<std::uint64_t>(input, output, std::less<>(), options);
+        std::uint64_t ns = elapsed_ns(start);
+        do_not_optimize(stats._runs);
+        return Sample{ records, ns };
+    });
+    std::error_code ignored;
+    std::filesystem::remove(input, ignored);
+    std::filesystem::remove(output, ignored);
+}
+
+void bench_logger(Runner& runner)
+{
+    const Config& conf = runner.config();
+    const std::uint64_t lines = conf.scaled(200000);
+    Log::Logger& log = Log::Logger::getInstance();
+    log.setOutMethod(Log::OutMethod::FILE);
+    log.setLogOutFile("/dev/null");
+    log.setLogLevel(Log::LogLevel::INFO);
+
+    runner.run("logger_line", "accepted", [&]() {
+        auto start = Clock::now();
+        for (std::uint64_t i = 0; i < lines; ++i)
+        {
+            log(Log::LogLevel::INFO) << "benchmark line " << i;
+        }
+        return Sample{ lines, elapsed_ns(start) };
+    });
+    runner.run("logger_line", "filtered", [&]() {
+        auto start = Clock::now();
+        for (std::uint64_t i = 0; i < lines; ++i)
+        {
+            log(Log::LogLevel::DEBUG) << "benchmark line " << i;
+        }
+        return Sample{ lines, elapsed_ns(start) };
+    });
+}
+
+Config parse_args(int argc, char** argv)
+{
+    Config conf;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto value = [&arg](const char* prefix) -> const char* {
+            size_t len = std::strlen(prefix);
+            return arg.compare(0, len, prefix) == 0 ? arg.c_str() + len : nullptr;
+        };
+        if (const char* v = value("--filter=")) conf._filter = v;
+        else if (const char* v = value("--reps=")) conf._reps = std::max(1, std::atoi(v));
+        else if (const char* v = value("--warmup=")) conf._warmup = std::max(0, std::atoi(v));
+        else if (const char* v = value("--scale=")) conf._scale = std::atof(v);
+        else if (const char* v = value("--threads=")) conf._maxThreads = std::max(1, std::atoi(v));
+        else if (const char* v = value("--format=")) conf._format = v;
+        else
+        {
+            std::cerr << "unknown argument " << arg << std::endl;
+            std::exit(1);
+        }
+    }
+    return conf;
+}
+
+BENCHMARK_END
+
+int main(int argc, char** argv)
+{
+    bench::Runner runner(bench::parse_args(argc, argv));
+    bench::bench_queue_and_stack(runner);
+    bench::bench_spsc(runner);
+    bench::bench_map(runner);
+    bench::bench_map_bulk(runner);
+    bench::bench_group_by(runner);
+    bench::bench_ordered_map(runner);
+    bench::bench_priority_queue(runner);
+    bench::bench_pool(runner);
+    bench::bench_timers(runner);
+    bench::bench_actors(runner);
+    bench::bench_pipeline(runner);
+#ifdef __cpp_impl_coroutine
+    bench::bench_coroutines(runner);
+#endif
+    bench::bench_algorithms(runner);
+    bench::bench_external_sort(runner);
+    bench::bench_logger(runner);
+    runner.finish();
+    return 0;
+}
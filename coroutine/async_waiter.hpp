@@ -0,0 +1,120 @@
+#pragma once
+
+#ifndef __ASYNC_WAITER_H__
+#define __ASYNC_WAITER_H__
+
+#include "base_def.h"
+
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#include <optional>
+
+CORO_BEGIN
+
+/*How a suspended waiter is resumed: inline on the thread that produced its value, or via executor.post*/
+class resumer
+{
+public:
+    resumer() = default;
+
+    /*Executor is anything with post(F), e.g. SimpleThreadPool*/
+    template<class Executor>
+    static resumer on(Executor& executor)
+    {
+        resumer res;
+        res._executor = &executor;
+        res._post = [](void* ex, std::coroutine_handle<> handle) {
+            static_cast<Executor*>(ex)->post([handle]() { handle.resume(); });
+        };
+        return res;
+    }
+
+    /*
+     * A stopped executor throws from post; the waiter then resumes inline rather than never. The
+     * producer has already handed its value over, so its push must not fail here.
+     */
+    void operator()(std::coroutine_handle<> handle) const
+    {
+        if (_post != nullptr)
+        {
+            try
+            {
+                _post(_executor, handle);
+                return;
+            }
+            catch (...)
+            {
+            }
+        }
+        handle.resume();
+    }
+
+private:
+    void* _executor = nullptr;
+    void (*_post)(void*, std::coroutine_handle<>) = nullptr;
+};
+
+/*A coroutine parked on a container; lives in the awaiting coroutine's frame, so no allocation*/
+template<class T>
+struct async_waiter
+{
+    std::optional<T> _value;
+    std::coroutine_handle<> _handle;
+    resumer _resumer;
+    async_waiter* _next = nullptr;
+
+    void resume()
+    {
+        _resumer(_handle);
+    }
+};
+
+/*Intrusive FIFO of waiters; the owning container guards it with its own lock*/
+template<class T>
+class waiter_list
+{
+public:
+    bool empty() const
+    {
+        return _head == nullptr;
+    }
+
+    void push_back(async_waiter<T>* waiter)
+    {
+        waiter->_next = nullptr;
+        if (_tail != nullptr)
+        {
+            _tail->_next = waiter;
+        }
+        else
+        {
+            _head = waiter;
+        }
+        _tail = waiter;
+    }
+
+    async_waiter<T>* pop_front()
+    {
+        async_waiter<T>* waiter = _head;
+        if (waiter != nullptr)
+        {
+            _head = waiter->_next;
+            if (_head == nullptr)
+            {
+                _tail = nullptr;
+            }
+            waiter->_next = nullptr;
+        }
+        return waiter;
+    }
+
+private:
+    async_waiter<T>* _head = nullptr;
+    async_waiter<T>* _tail = nullptr;
+};
+
+CORO_END
+
+#endif //__cpp_impl_coroutine
+
+#endif //!__ASYNC_WAITER_H__
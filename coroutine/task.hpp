@@ -0,0 +1,298 @@
+#pragma once
+
+#ifndef __CORO_TASK_H__
+#define __CORO_TASK_H__
+
+#include "base_def.h"
+
+#ifdef __cpp_impl_coroutine
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+CORO_BEGIN
+
+template<class T = void>
+class task;
+
+namespace detail
+{
+    /*Hands control straight to whoever awaited the task (symmetric transfer, no stack growth)*/
+    struct final_awaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template<class Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            std::coroutine_handle<> continuation = handle.promise()._continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    struct promise_base
+    {
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        final_awaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::coroutine_handle<> _continuation;
+    };
+
+    template<class T>
+    struct task_promise : promise_base
+    {
+        task<T> get_return_object() noexcept;
+
+        template<class U>
+        void return_value(U&& value)
+        {
+            _result.template emplace<1>(std::forward<U>(value));
+        }
+
+        void unhandled_exception() noexcept
+        {
+            _result.template emplace<2>(std::current_exception());
+        }
+
+        T take()
+        {
+            if (_result.index() == 2)
+            {
+                std::rethrow_exception(std::get<2>(_result));
+            }
+            return std::move(std::get<1>(_result));
+        }
+
+        std::variant<std::monostate, T, std::exception_ptr> _result;
+    };
+
+    template<>
+    struct task_promise<void> : promise_base
+    {
+        task<void> get_return_object() noexcept;
+
+        void return_void() noexcept {}
+
+        void unhandled_exception() noexcept
+        {
+            _exception = std::current_exception();
+        }
+
+        void take()
+        {
+            if (_exception)
+            {
+                std::rethrow_exception(_exception);
+            }
+        }
+
+        std::exception_ptr _exception;
+    };
+}
+
+/*
+ * Lazily started coroutine returning T. Nothing runs until the task is awaited (or handed to
+ * sync_wait/spawn); the awaiter is resumed by symmetric transfer when the body finishes, on whatever
+ * thread finished it. Combine with co_await pool.schedule() to move onto pool workers, and with the
+ * containers' async_pop() to wait for data without holding a thread.
+ */
+template<class T>
+class [[nodiscard]] task
+{
+public:
+    using promise_type = detail::task_promise<T>;
+
+    task() = default;
+
+    explicit task(std::coroutine_handle<promise_type> handle)
+        :_handle(handle) {}
+
+    task(task&& rhs) noexcept
+        :_handle(std::exchange(rhs._handle, nullptr)) {}
+
+    task& operator=(task&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            if (_handle)
+            {
+                _handle.destroy();
+            }
+            _handle = std::exchange(rhs._handle, nullptr);
+        }
+        return *this;
+    }
+
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    ~task()
+    {
+        if (_handle)
+        {
+            _handle.destroy();
+        }
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct awaiter
+        {
+            std::coroutine_handle<promise_type> _handle;
+
+            bool await_ready() noexcept
+            {
+                return !_handle || _handle.done();
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+            {
+                _handle.promise()._continuation = continuation;
+                return _handle;
+            }
+
+            T await_resume()
+            {
+                return _handle.promise().take();
+            }
+        };
+        return awaiter{ _handle };
+    }
+
+    auto operator co_await() & noexcept
+    {
+        return std::move(*this).operator co_await();
+    }
+
+private:
+    std::coroutine_handle<promise_type> _handle;
+};
+
+namespace detail
+{
+    template<class T>
+    task<T> task_promise<T>::get_return_object() noexcept
+    {
+        return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+    }
+
+    inline task<void> task_promise<void>::get_return_object() noexcept
+    {
+        return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+    }
+
+    /*Starts immediately and frees its own frame at the end; the driver for spawn and sync_wait*/
+    struct detached
+    {
+        struct promise_type
+        {
+            detached get_return_object() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_never initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_never final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_void() noexcept {}
+
+            void unhandled_exception() noexcept
+            {
+                std::terminate();
+            }
+        };
+    };
+
+    inline detached run_detached(task<void> work)
+    {
+        co_await std::move(work);
+    }
+
+    struct sync_state
+    {
+        std::mutex _m;
+        std::condition_variable _cv;
+        bool _done = false;
+    };
+
+    template<class T, class Result>
+    detached run_and_signal(task<T> work, Result* result, std::exception_ptr* error, sync_state* state)
+    {
+        try
+        {
+            if constexpr (std::is_void_v<T>)
+            {
+                co_await std::move(work);
+            }
+            else
+            {
+                result->emplace(co_await std::move(work));
+            }
+        }
+        catch (...)
+        {
+            *error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(state->_m);
+        state->_done = true;
+        state->_cv.notify_one();
+    }
+}
+
+/*Runs work to completion without anyone awaiting it; an escaping exception terminates, as with std::thread*/
+inline void spawn(task<void> work)
+{
+    detail::run_detached(std::move(work));
+}
+
+/*Blocks the calling (non-pool) thread until work finishes and returns its result*/
+template<class T>
+T sync_wait(task<T> work)
+{
+    detail::sync_state state;
+    std::exception_ptr error;
+    std::optional<std::conditional_t<std::is_void_v<T>, std::monostate, T>> result;
+    detail::run_and_signal(std::move(work), &result, &error, &state);
+    {
+        std::unique_lock<std::mutex> lock(state._m);
+        state._cv.wait(lock, [&]() { return state._done; });
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    if constexpr (!std::is_void_v<T>)
+    {
+        return std::move(*result);
+    }
+}
+
+CORO_END
+
+#endif //__cpp_impl_coroutine
+
+#endif //!__CORO_TASK_H__
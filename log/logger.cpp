@@ -6,6 +6,16 @@
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/date_time.hpp>
 #include <boost/foreach.hpp>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+#include <filesystem>
+#include "timer_wheel.hpp"
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
 
 LOG_NAMESPACE_BEGIN
 
@@ -47,30 +57,42 @@ struct Logger::Impl
         OutInfo& operator = (const OutInfo&) = delete;
         /*������־����buffer*/
         MyStringStream _outStreamBuffer;
-        OutMethod         _outMethod{ OutMethod::CONSOLE };
-        /*��������־·��*/
-        std::string       _outFilePath;
     };
     struct ConfReader
     {
-        static void parse(Impl& impl, const std::string& path)
+        static bool parse(LogConfig& conf, const std::string& path)
         {
-            boost::property_tree::ptree json_root;
-            boost::property_tree::read_json<boost::property_tree::ptree>(path, json_root);
-            const boost::property_tree::ptree& logConf = json_root.get_child("LOG");
-            size_t flushTime = logConf.get<int>("flush time");
-            std::string logLevel = logConf.get<std::string>("log level");
-            std::string logMethod = logConf.get<std::string>("log method");
-            std::string logPath = logConf.get<std::string>("log path");
-
-            transform(logLevel.begin(), logLevel.end(), logLevel.begin(), toupper);
-            transform(logMethod.begin(), logMethod.end(), logMethod.begin(), toupper);
-
-            impl._time = flushTime;
-            impl._outInfo._outFilePath = logPath;
-            impl._outInfo._outMethod = _logMethodMap[logMethod];
-            impl._logLevel = _logLevelMap[logLevel];
+            try
+            {
+                boost::property_tree::ptree json_root;
+                boost::property_tree::read_json<boost::property_tree::ptree>(path, json_root);
+                const boost::property_tree::ptree& logConf = json_root.get_child("LOG");
+                int flushTime = logConf.get<int>("flush time", conf._flushTime);
+                std::string logLevel = logConf.get<std::string>("log level", "");
+                std::string logMethod = logConf.get<std::string>("log method", "");
+                std::string logPath = logConf.get<std::string>("log path", conf._outFilePath);
+
+                transform(logLevel.begin(), logLevel.end(), logLevel.begin(), toupper);
+                transform(logMethod.begin(), logMethod.end(), logMethod.begin(), toupper);
+
+                auto levelPosi = _logLevelMap.find(logLevel);
+                auto methodPosi = _logMethodMap.find(logMethod);
+                if (flushTime <= 0 || (!logLevel.empty() && levelPosi == _logLevelMap.end())
+                    || (!logMethod.empty() && methodPosi == _logMethodMap.end()))
+                {
+                    return false;
+                }
 
+                conf._flushTime = flushTime;
+                conf._outFilePath = logPath;
+                if (methodPosi != _logMethodMap.end()) conf._outMethod = methodPosi->second;
+                if (levelPosi != _logLevelMap.end()) conf._logLevel = levelPosi->second;
+            }
+            catch (const boost::property_tree::ptree_error&)
+            {
+                return false;
+            }
+            return true;
         }
 
         static std::unordered_map<std::string, Log::LogLevel> _logLevelMap;
@@ -78,23 +100,78 @@ struct Logger::Impl
     };
 
 public:
-    Impl(Log::LogLevel logLevel = LogLevel::DEBUG, bool outStop = false);
+    Impl(Log::LogLevel logLevel = LogLevel::DEBUG);
     Impl& operator = (const Impl&) = delete;
     ~Impl();
 
 public:
-    void flush();
+    void flush(const LogConfig& conf);
+
+    std::shared_ptr<const LogConfig> loadConf() const
+    {
+        return std::atomic_load(&_conf);
+    }
+
+    /*Copy the current snapshot, let f modify the copy and publish it. Only config writers
+      serialize on _confMutex, the flush timer and log writers never wait for it.*/
+    template<class F>
+    bool updateConf(F f)
+    {
+        std::lock_guard<std::mutex> lgm(this->_confMutex);
+        auto next = std::make_shared<LogConfig>(*loadConf());
+        if (!f(*next))
+        {
+            return false;
+        }
+        int flushTime = next->_flushTime;
+        bool flushTimeChanged = flushTime != loadConf()->_flushTime;
+        this->_logLevel.store(next->_logLevel, std::memory_order_relaxed);
+        std::atomic_store(&_conf, std::shared_ptr<const LogConfig>(std::move(next)));
+        if (flushTimeChanged)
+        {
+            this->scheduleFlush(flushTime);
+        }
+        return true;
+    }
+
+    bool reload(const std::string& path)
+    {
+        return this->updateConf([&path](LogConfig& conf) {
+            return ConfReader::parse(conf, path);
+            });
+    }
+
+    /*Failures of the watcher have no caller to report to, so they go to the log itself*/
+    void reportReloadFailure(const std::string& path)
+    {
+        Logger::makeOutStream(*this, LogLevel::ERROR) << "reload log config failed: " << path;
+    }
+
+    void stopWatch();
+    void stopWatchLocked();
+
+    /*The periodic flush runs on the process-wide timer thread; called under _confMutex or in the ctor*/
+    void scheduleFlush(int milliseconds)
+    {
+        auto& timers = threadsafe_container::timer_wheel::instance();
+        timers.cancel(this->_flushTimer);
+        this->_flushTimer = timers.schedule_every(std::chrono::milliseconds(milliseconds), [this]() {
+            this->flush(*this->loadConf());
+            });
+    }
 
 public:
     OutInfo            _outInfo;
     friend class OutStream;
-    Log::LogLevel   _logLevel;
-    std::mutex      _m;
+    /*Mirror of _conf->_logLevel so the per-line level check is a single relaxed load*/
+    std::atomic<Log::LogLevel> _logLevel;
+    std::shared_ptr<const LogConfig> _conf;
+    std::mutex      _confMutex;
+    threadsafe_container::timer_handle _flushTimer;
 
-    std::condition_variable _condition;
-    std::atomic<bool> _outStop = false;
-    std::atomic<int>  _time = 100;
-    std::thread _outThread;
+    std::mutex _watchMutex;
+    std::atomic<bool> _watchStop = false;
+    std::thread _watchThread;
 };
 
 std::unordered_map<std::string, Log::LogLevel> Logger::Impl::ConfReader::_logLevelMap = { {"DEBUG", Log::LogLevel::DEBUG},
@@ -106,69 +183,78 @@ std::unordered_map<std::string, Log::LogLevel> Logger::Impl::ConfReader::_logLev
 std::unordered_map<std::string, Log::OutMethod> Logger::Impl::ConfReader::_logMethodMap = { {"CONSOLE", Log::OutMethod::CONSOLE},
                                                                                             {"FILE", Log::OutMethod::FILE },
                                                                                             {"BOTH", Log::OutMethod::BOTH} };
-Logger::Impl::Impl(Log::LogLevel logLevel, bool outStop)
+Logger::Impl::Impl(Log::LogLevel logLevel)
 {
-    this->_logLevel = logLevel;
-    _outStop = outStop;
-    this->_outInfo._outStreamBuffer.clear();
-    this->_outInfo._outStreamBuffer.clear();
-    this->_outInfo._outFilePath.clear();
-    std::string path = "C:\\Users\\86107\\Desktop\\test.json";
-    ConfReader::parse(*this, path);
-    this->_outThread = std::thread([this]() {
-        while (!_outStop)
+    auto conf = std::make_shared<LogConfig>();
+    conf->_logLevel = logLevel;
+    const char* path = std::getenv(Logger::CONFIG_ENV);
+    if (path != nullptr && *path != '\0')
+    {
+        LogConfig parsed = *conf;
+        if (ConfReader::parse(parsed, path))
         {
-            std::unique_lock<std::mutex> ulm(this->_m);
-            _condition.wait_for(ulm, std::chrono::milliseconds(_time));
-            this->flush();
-            ulm.unlock();
+            *conf = parsed;
         }
-        });
+    }
+    this->_logLevel = conf->_logLevel;
+    int flushTime = conf->_flushTime;
+    this->_conf = std::move(conf);
+    this->_outInfo._outStreamBuffer.clear();
+    this->scheduleFlush(flushTime);
 }
 
 Logger::Impl::~Impl()
 {
-    this->_time = 0;
-    this->_condition.notify_all();
-    this->_outStop = true;
-    this->_outThread.join();
+    this->stopWatch();
+    {
+        std::lock_guard<std::mutex> lgm(this->_confMutex);
+        /*waits for a flush that is running right now*/
+        threadsafe_container::timer_wheel::instance().cancel(this->_flushTimer);
+    }
+    this->flush(*this->loadConf());
 }
 
-void Logger::Impl::flush()
+void Logger::Impl::flush(const LogConfig& conf)
 {
-    switch (this->_outInfo._outMethod)
-    {
-    case OutMethod::CONSOLE:
+    /*Take the pending lines under the writers' mutex and do the slow I/O without it*/
+    std::string pending;
     {
-        std::cout << this->_outInfo._outStreamBuffer.str();
+        std::lock_guard<std::mutex> lgm(Logger::bufferMutex());
+        pending = this->_outInfo._outStreamBuffer.str();
         this->_outInfo._outStreamBuffer.clear();
-        break;
     }
-    case OutMethod::FILE:
+    if (pending.empty())
     {
-        if (!this->_outInfo._outFilePath.empty())
-        {
-            std::ofstream fileWrite(this->_outInfo._outFilePath, std::ofstream::app);
-            fileWrite << this->_outInfo._outStreamBuffer.str();
-            this->_outInfo._outStreamBuffer.clear();
-        }
-        break;
+        return;
     }
-    case OutMethod::BOTH:
+    if (conf._outMethod != OutMethod::FILE)
     {
-        std::cout << this->_outInfo._outStreamBuffer.str();
-        if (!this->_outInfo._outFilePath.empty())
-        {
-            std::ofstream fileWrite(this->_outInfo._outFilePath, std::ofstream::app);
-            fileWrite << this->_outInfo._outStreamBuffer.str();
-            this->_outInfo._outStreamBuffer.clear();
-        }
-        this->_outInfo._outStreamBuffer.clear();
-        break;
+        std::cout << pending;
     }
+    if (conf._outMethod != OutMethod::CONSOLE && !conf._outFilePath.empty())
+    {
+        std::ofstream fileWrite(conf._outFilePath, std::ofstream::app);
+        fileWrite << pending;
     }
 }
 
+void Logger::Impl::stopWatch()
+{
+    std::lock_guard<std::mutex> lgm(this->_watchMutex);
+    this->stopWatchLocked();
+}
+
+/*Caller holds _watchMutex*/
+void Logger::Impl::stopWatchLocked()
+{
+    this->_watchStop = true;
+    if (this->_watchThread.joinable())
+    {
+        this->_watchThread.join();
+    }
+    this->_watchStop = false;
+}
+
 
 OutStream::~OutStream()
 {
@@ -196,43 +282,163 @@ Logger::~Logger()
 {
 }
 
-OutStream Logger::operator () (LogLevel logLevel)
+OutStream Logger::makeOutStream(Impl& impl, LogLevel logLevel)
 {
-    OutStream outStream{ this->_implPtr->_outInfo._outStreamBuffer, logLevel, this->_implPtr->_logLevel };
+    OutStream outStream{ impl._outInfo._outStreamBuffer, logLevel, impl._logLevel.load(std::memory_order_relaxed) };
     return outStream;
 }
 
+std::mutex& Logger::bufferMutex()
+{
+    return OutStream::_m;
+}
+
+OutStream Logger::operator () (LogLevel logLevel)
+{
+    return makeOutStream(*this->_implPtr, logLevel);
+}
+
 void Logger::setLogLevel(LogLevel logLevel)
 {
-    std::lock_guard<std::mutex> lgm(this->_implPtr->_m);
-    this->_implPtr->_logLevel = logLevel;
+    this->_implPtr->updateConf([logLevel](LogConfig& conf) {
+        conf._logLevel = logLevel;
+        return true;
+        });
 }
 
 bool Logger::setLogOutFile(const std::string filePath)
 {
-    std::lock_guard<std::mutex> lgm(this->_implPtr->_m);
-    if (this->_implPtr->_outInfo._outMethod < Log::OutMethod::FILE)
+    return this->_implPtr->updateConf([&filePath](LogConfig& conf) {
+        if (conf._outMethod < Log::OutMethod::FILE)
+        {
+            return false;
+        }
+        JudgeFile judgeObj;
+        if (!judgeObj(filePath))
+        {
+            return false;
+        }
+        conf._outFilePath = filePath;
+        return true;
+        });
+}
+
+void Logger::setOutMethod(OutMethod outMethod)
+{
+    this->_implPtr->updateConf([outMethod](LogConfig& conf) {
+        conf._outMethod = outMethod;
+        return true;
+        });
+}
+
+void Logger::setFlushTime(int milliseconds)
+{
+    this->_implPtr->updateConf([milliseconds](LogConfig& conf) {
+        if (milliseconds <= 0)
+        {
+            return false;
+        }
+        conf._flushTime = milliseconds;
+        return true;
+        });
+}
+
+std::string Logger::getOutFile() const
+{
+    return this->_implPtr->loadConf()->_outFilePath;
+}
+
+std::shared_ptr<const LogConfig> Logger::getConfig() const
+{
+    return this->_implPtr->loadConf();
+}
+
+bool Logger::loadConfig(const std::string& path)
+{
+    return this->_implPtr->reload(path);
+}
+
+bool Logger::watchConfig(const std::string& path)
+{
+    this->stopWatchConfig();
+    if (!this->loadConfig(path))
     {
         return false;
     }
-    JudgeFile judgeObj;
-    if (!judgeObj(filePath))
+    std::lock_guard<std::mutex> lgm(this->_implPtr->_watchMutex);
+    Impl* impl = this->_implPtr.get();
+    /*a concurrent watchConfig may have started its watcher since the stop above; replace it*/
+    impl->stopWatchLocked();
+#ifdef __linux__
+    /*Watch the directory rather than the file: editors usually replace the file by rename*/
+    std::filesystem::path filePath = std::filesystem::absolute(path);
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
     {
         return false;
     }
-    this->_implPtr->_outInfo._outFilePath = filePath;
+    if (inotify_add_watch(fd, filePath.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        close(fd);
+        return false;
+    }
+    impl->_watchThread = std::thread([impl, fd, filePath]() {
+        const std::string fileName = filePath.filename().string();
+        alignas(inotify_event) char buffer[4096];
+        while (!impl->_watchStop)
+        {
+            pollfd pfd{ fd, POLLIN, 0 };
+            if (poll(&pfd, 1, 200) <= 0)
+            {
+                continue;
+            }
+            bool changed = false;
+            ssize_t len = 0;
+            while ((len = read(fd, buffer, sizeof(buffer))) > 0)
+            {
+                for (char* posi = buffer; posi < buffer + len; )
+                {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(posi);
+                    if (event->len > 0 && fileName == event->name)
+                    {
+                        changed = true;
+                    }
+                    posi += sizeof(inotify_event) + event->len;
+                }
+            }
+            if (changed && !impl->reload(filePath.string()))
+            {
+                impl->reportReloadFailure(filePath.string());
+            }
+        }
+        close(fd);
+        });
+#else
+    std::error_code ec;
+    auto lastWrite = std::filesystem::last_write_time(path, ec);
+    impl->_watchThread = std::thread([impl, path, lastWrite]() mutable {
+        while (!impl->_watchStop)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            std::error_code ec;
+            auto writeTime = std::filesystem::last_write_time(path, ec);
+            if (ec || writeTime == lastWrite)
+            {
+                continue;
+            }
+            lastWrite = writeTime;
+            if (!impl->reload(path))
+            {
+                impl->reportReloadFailure(path);
+            }
+        }
+        });
+#endif
     return true;
 }
 
-void Logger::setOutMethod(OutMethod outMethod)
-{
-    std::lock_guard<std::mutex> lgm(this->_implPtr->_m);
-    this->_implPtr->_outInfo._outMethod = outMethod;
-}
-
-std::string Logger::getOutFile() const
+void Logger::stopWatchConfig()
 {
-    std::lock_guard<std::mutex> lgm(this->_implPtr->_m);
-    return this->_implPtr->_outInfo._outFilePath;
+    this->_implPtr->stopWatch();
 }
 LOG_NAMESPACE_END
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include <chrono>
 #include <iomanip>
 #include <unordered_map>
+#include <memory>
+#include <string>
 #include "base_def.h"
 
 LOG_NAMESPACE_BEGIN
@@ -42,8 +44,6 @@ public:
     {
         auto now = std::chrono::system_clock::now();
         std::time_t t = std::chrono::system_clock::to_time_t(now);
-        tm* nowTM = std::localtime(&t);
-
         std::stringstream ss;
         ss << std::put_time(std::localtime(&t), "%F %T");
         std::string str = ss.str();
@@ -61,6 +61,15 @@ public:
     }
 };
 
+/*Immutable configuration snapshot, replaced as a whole on every change*/
+struct LogConfig
+{
+    LogLevel    _logLevel{ LogLevel::DEBUG };
+    OutMethod   _outMethod{ OutMethod::CONSOLE };
+    std::string _outFilePath;
+    int         _flushTime{ 100 };
+};
+
 class Logger;
 
 class OutStream : public std::ostringstream
@@ -77,7 +86,8 @@ private:
     }
 
     OutStream(OutStream& rhs)
-        :_outStream(rhs._outStream),
+        :std::basic_ios<char>(), std::ostringstream(),
+        _outStream(rhs._outStream),
         _logLevel(rhs._logLevel),
         _lowestLogLevel(rhs._lowestLogLevel),
         _map(rhs._map) {
@@ -103,16 +113,29 @@ public:
     static Logger& getInstance();
 
 public:
+    /*Environment variable naming the json config read at startup*/
+    static constexpr const char* CONFIG_ENV = "LOG_CONFIG_PATH";
+
     OutStream operator () (LogLevel logLevel = LogLevel::DEBUG);
     void setLogLevel(LogLevel logLevel);
     bool setLogOutFile(const std::string filePath);
     void setOutMethod(OutMethod outMethod);
+    void setFlushTime(int milliseconds);
     std::string getOutFile() const;
+    std::shared_ptr<const LogConfig> getConfig() const;
+
+    /*Parse a json config and publish it; the current snapshot is kept on failure*/
+    bool loadConfig(const std::string& path);
+    /*Reload the config whenever the file changes (inotify on linux, polling elsewhere); replaces an earlier watch*/
+    bool watchConfig(const std::string& path);
+    void stopWatchConfig();
 
 private:
     Logger();
     ~Logger();
     struct Impl;
+    static OutStream makeOutStream(Impl& impl, LogLevel logLevel);
+    static std::mutex& bufferMutex();
     std::shared_ptr<Impl> _implPtr;
 };
 LOG_NAMESPACE_END
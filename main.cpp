@@ -8,14 +8,14 @@
 #include "logger.h"
 
 using threadsafe_container::threadsafe_queue;
-using parallel_algorithm::parallel_sort;
 
 const int THREAD_POOL_SIZE = 4;
+const size_t QUEUE_CAPACITY = 65536; //有界队列，消费者跟不上时生产者阻塞，内存不再无限增长
 class SimpleMessageQueue
 {
 public:
-    SimpleMessageQueue(int index) :_index(index){}
-    SimpleMessageQueue(const SimpleMessageQueue& rhs) :_index(rhs._index) {}
+    SimpleMessageQueue(int index) :_tq(QUEUE_CAPACITY), _index(index){}
+    SimpleMessageQueue(const SimpleMessageQueue& rhs) :_tq(QUEUE_CAPACITY), _index(rhs._index) {}
     SimpleMessageQueue& operator=(const SimpleMessageQueue& rhs) { _index = rhs._index;  return *this; }
 public:
     void receive_message(int index)
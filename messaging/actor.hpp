@@ -0,0 +1,145 @@
+#pragma once
+
+#ifndef __ACTOR_H__
+#define __ACTOR_H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include "base_def.h"
+#include "message.hpp"
+#include "dispatcher.hpp"
+#include "mailbox.hpp"
+#include "simple_thread_pool.hpp"
+
+MESSAGING_BEGIN
+
+/*
+ * An actor owns a mailbox and a dispatcher and runs on a SimpleThreadPool. It is scheduled only
+ * while it has messages: the first send to an idle actor posts one drain task, which handles up to
+ * batchSize messages and then either yields the worker or goes idle. An actor is never run by two
+ * workers at once, so its handlers need no locking. Idle actors cost no thread and no polling.
+ *
+ * Actors must be owned by a std::shared_ptr (see spawn) because pending drain tasks keep them alive.
+ * A handler that throws loses only its own message: the exception goes to the pool's task error
+ * handler and the actor carries on with the rest of its mailbox. Draining the pool also drains its
+ * actors; messages sent once the pool has stopped are not delivered and stay counted by pending().
+ */
+template<class Queue = threadsafe_container::threadsafe_queue<envelope>>
+class basic_actor : public std::enable_shared_from_this<basic_actor<Queue>>
+{
+public:
+    explicit basic_actor(SimpleThreadPool& pool, size_t batchSize = 64)
+        :_pool(pool), _batchSize(batchSize == 0 ? 1 : batchSize) {}
+    basic_actor(const basic_actor&) = delete;
+    basic_actor& operator=(const basic_actor&) = delete;
+    virtual ~basic_actor() = default;
+
+    /*Register before the first send; handlers run on pool workers, one message at a time*/
+    template<class Msg, class F>
+    basic_actor& handle(F&& f)
+    {
+        _dispatcher.template handle<Msg>(std::forward<F>(f));
+        return *this;
+    }
+
+    template<class F>
+    basic_actor& unhandled(F&& f)
+    {
+        _dispatcher.unhandled(std::forward<F>(f));
+        return *this;
+    }
+
+    /*Safe from any thread, including from inside another actor's handler*/
+    template<class Msg>
+    void send(Msg&& msg)
+    {
+        _mailbox.send(std::forward<Msg>(msg));
+        _pending.fetch_add(1);
+        schedule();
+    }
+
+    std::int64_t pending() const
+    {
+        return _pending.load(std::memory_order_relaxed);
+    }
+
+protected:
+    dispatcher& handlers()
+    {
+        return _dispatcher;
+    }
+
+private:
+    void schedule()
+    {
+        if (!_scheduled.exchange(true))
+        {
+            auto self = this->shared_from_this();
+            try
+            {
+                _pool.post([self]() { self->drain(); });
+            }
+            catch (const std::runtime_error&)
+            {
+                /*the pool has stopped: the messages stay in the mailbox, counted by pending()*/
+                _scheduled.store(false);
+            }
+        }
+    }
+
+    void drain()
+    {
+        envelope msg;
+        size_t processed = 0;
+        while (processed < _batchSize && _mailbox.try_receive(msg))
+        {
+            try
+            {
+                _dispatcher.dispatch(msg);
+            }
+            catch (...)
+            {
+                /*still scheduled here, nobody else would ever run the rest of the mailbox*/
+                _pending.fetch_sub(1);
+                release();
+                throw;
+            }
+            _pending.fetch_sub(1);
+            ++processed;
+        }
+        release();
+    }
+
+    void release()
+    {
+        _scheduled.store(false);
+        /*a sender that found us still scheduled relies on this re-check to get its message handled*/
+        if (_pending.load() > 0)
+        {
+            schedule();
+        }
+    }
+
+private:
+    SimpleThreadPool& _pool;
+    const size_t _batchSize;
+    mailbox<Queue> _mailbox;
+    dispatcher _dispatcher;
+    std::atomic<std::int64_t> _pending{ 0 };
+    std::atomic<bool> _scheduled{ false };
+};
+
+using actor = basic_actor<>;
+
+template<class Actor, class... Args>
+std::shared_ptr<Actor> spawn(Args&&... args)
+{
+    return std::make_shared<Actor>(std::forward<Args>(args)...);
+}
+
+MESSAGING_END
+
+#endif //!__ACTOR_H__
@@ -0,0 +1,75 @@
+#pragma once
+
+#ifndef __DISPATCHER_H__
+#define __DISPATCHER_H__
+
+#include <functional>
+#include <utility>
+#include <vector>
+#include "base_def.h"
+#include "message.hpp"
+
+MESSAGING_BEGIN
+
+/*
+ * Maps message types to handlers. Actors handle a handful of types, so a flat vector scanned by
+ * type id beats hashing; the lookup is a pointer comparison per registered type.
+ * Register handlers before messages start flowing; dispatch() itself is read-only.
+ */
+class dispatcher
+{
+public:
+    using handler = std::function<void(envelope&)>;
+
+    template<class Msg, class F>
+    dispatcher& handle(F&& f)
+    {
+        type_id id = type_id_of<Msg>();
+        handler h = [func = std::forward<F>(f)](envelope& msg) mutable {
+            func(msg.get_unchecked<Msg>());
+        };
+        for (auto& entry : _handlers)
+        {
+            if (entry.first == id)
+            {
+                entry.second = std::move(h);
+                return *this;
+            }
+        }
+        _handlers.emplace_back(id, std::move(h));
+        return *this;
+    }
+
+    /*Called for messages without a registered handler; they are dropped by default*/
+    template<class F>
+    dispatcher& unhandled(F&& f)
+    {
+        _unhandled = std::forward<F>(f);
+        return *this;
+    }
+
+    bool dispatch(envelope& msg)
+    {
+        for (auto& entry : _handlers)
+        {
+            if (entry.first == msg.type())
+            {
+                entry.second(msg);
+                return true;
+            }
+        }
+        if (_unhandled)
+        {
+            _unhandled(msg);
+        }
+        return false;
+    }
+
+private:
+    std::vector<std::pair<type_id, handler>> _handlers;
+    handler _unhandled;
+};
+
+MESSAGING_END
+
+#endif //!__DISPATCHER_H__
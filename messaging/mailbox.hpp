@@ -0,0 +1,67 @@
+#pragma once
+
+#ifndef __MAILBOX_H__
+#define __MAILBOX_H__
+
+#include <utility>
+#include "base_def.h"
+#include "message.hpp"
+#include "dispatcher.hpp"
+#include "threadsafe_queue.hpp"
+
+MESSAGING_BEGIN
+
+/*
+ * A queue of envelopes. Queue is any container with push(T), try_pop(T&) and wait_and_pop(T&),
+ * threadsafe_queue by default. With exactly one sending thread, spsc_channel<envelope> is the
+ * cheaper choice.
+ */
+template<class Queue = threadsafe_container::threadsafe_queue<envelope>>
+class mailbox
+{
+public:
+    mailbox() = default;
+    mailbox(const mailbox&) = delete;
+    mailbox& operator=(const mailbox&) = delete;
+
+    template<class Msg>
+    void send(Msg&& msg)
+    {
+        _queue.push(envelope::make(std::forward<Msg>(msg)));
+    }
+
+    void send(envelope msg)
+    {
+        _queue.push(std::move(msg));
+    }
+
+    bool try_receive(envelope& msg)
+    {
+        return _queue.try_pop(msg);
+    }
+
+    /*Blocks on the queue's condition variable, not by polling*/
+    void receive(envelope& msg)
+    {
+        _queue.wait_and_pop(msg);
+    }
+
+    bool receive_and_dispatch(dispatcher& handlers)
+    {
+        envelope msg;
+        _queue.wait_and_pop(msg);
+        return handlers.dispatch(msg);
+    }
+
+    Queue& queue()
+    {
+        return _queue;
+    }
+
+private:
+    Queue _queue;
+};
+
+MESSAGING_END
+
+#endif //!__MAILBOX_H__
@@ -0,0 +1,93 @@
+#pragma once
+
+#ifndef __MESSAGE_H__
+#define __MESSAGE_H__
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "base_def.h"
+
+MESSAGING_BEGIN
+
+/*One address per message type; comparing them replaces typeid/dynamic_cast*/
+using type_id = const void*;
+
+template<class T>
+type_id type_id_of()
+{
+    static const char tag = 0;
+    return &tag;
+}
+
+/*Type-erased message: the payload plus the id of its type*/
+class envelope
+{
+public:
+    envelope() = default;
+    envelope(envelope&&) = default;
+    envelope& operator=(envelope&&) = default;
+    envelope(const envelope&) = delete;
+    envelope& operator=(const envelope&) = delete;
+
+    template<class T>
+    static envelope make(T&& value)
+    {
+        using Msg = std::decay_t<T>;
+        envelope res;
+        res._type = type_id_of<Msg>();
+        res._payload = std::make_unique<Payload<Msg>>(std::forward<T>(value));
+        return res;
+    }
+
+    type_id type() const
+    {
+        return _type;
+    }
+
+    bool empty() const
+    {
+        return !_payload;
+    }
+
+    template<class T>
+    bool is() const
+    {
+        return _type == type_id_of<T>();
+    }
+
+    /*nullptr when the envelope holds another type*/
+    template<class T>
+    T* get()
+    {
+        return is<T>() ? &static_cast<Payload<T>*>(_payload.get())->_value : nullptr;
+    }
+
+    /*Unchecked access for callers that already compared type()*/
+    template<class T>
+    T& get_unchecked()
+    {
+        return static_cast<Payload<T>*>(_payload.get())->_value;
+    }
+
+private:
+    struct PayloadBase
+    {
+        virtual ~PayloadBase() = default;
+    };
+
+    template<class T>
+    struct Payload : PayloadBase
+    {
+        template<class U>
+        explicit Payload(U&& value) :_value(std::forward<U>(value)) {}
+        T _value;
+    };
+
+    type_id _type = nullptr;
+    std::unique_ptr<PayloadBase> _payload;
+};
+
+MESSAGING_END
+
+#endif //!__MESSAGE_H__
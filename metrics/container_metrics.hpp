@@ -0,0 +1,372 @@
+#pragma once
+
+#ifndef __CONTAINER_METRICS_H__
+#define __CONTAINER_METRICS_H__
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <algorithm>
+#include "base_def.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+ * Opt-in instrumentation for the containers and the thread pool.
+ * Build with -DCONCURRENCY_ENABLE_METRICS to record; otherwise every hook is an empty inline
+ * function and container_metrics_t costs nothing.
+ */
+
+METRICS_BEGIN
+
+using timestamp = std::uint64_t;
+
+constexpr std::size_t COUNTER_STRIPES = 16;
+constexpr std::size_t HISTOGRAM_STRIPES = 4;
+
+inline timestamp now_ns()
+{
+    return static_cast<timestamp>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/*Stable per-thread stripe index, so threads mostly update disjoint cache lines*/
+inline std::size_t thread_stripe()
+{
+    static std::atomic<std::size_t> nextStripe{ 0 };
+    thread_local const std::size_t stripe = nextStripe.fetch_add(1, std::memory_order_relaxed);
+    return stripe;
+}
+
+inline unsigned highest_bit(std::uint64_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanReverse64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+}
+
+/*Counter split across cache lines; writers touch their own stripe, readers sum all of them*/
+class striped_counter
+{
+public:
+    void add(std::uint64_t n = 1)
+    {
+        _cells[thread_stripe() % COUNTER_STRIPES]._value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t load() const
+    {
+        std::uint64_t sum = 0;
+        for (const auto& cell : _cells)
+        {
+            sum += cell._value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+private:
+    struct alignas(64) Cell
+    {
+        std::atomic<std::uint64_t> _value{ 0 };
+    };
+    std::array<Cell, COUNTER_STRIPES> _cells;
+};
+
+/*Current level plus its high-water mark, e.g. queue depth*/
+class level_gauge
+{
+public:
+    void increase()
+    {
+        std::int64_t level = _level.fetch_add(1, std::memory_order_relaxed) + 1;
+        std::int64_t highWater = _highWater.load(std::memory_order_relaxed);
+        while (level > highWater && !_highWater.compare_exchange_weak(highWater, level, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void decrease()
+    {
+        _level.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    std::int64_t level() const { return _level.load(std::memory_order_relaxed); }
+    std::int64_t high_water() const { return _highWater.load(std::memory_order_relaxed); }
+
+private:
+    alignas(64) std::atomic<std::int64_t> _level{ 0 };
+    std::atomic<std::int64_t> _highWater{ 0 };
+};
+
+/*
+ * HDR-style log-linear histogram of nanosecond durations: every power of two is split into
+ * 2^SUB_BITS linear sub-buckets, giving ~12% relative precision from 1ns to ~39 hours.
+ */
+class histogram_snapshot
+{
+public:
+    static constexpr unsigned SUB_BITS = 3;
+    static constexpr unsigned SUB_COUNT = 1u << SUB_BITS;
+    static constexpr unsigned MAX_BIT = 47;
+    static constexpr unsigned BUCKETS = (MAX_BIT - SUB_BITS + 2) * SUB_COUNT;
+
+    static unsigned bucket_index(std::uint64_t value)
+    {
+        if (value < SUB_COUNT)
+        {
+            return static_cast<unsigned>(value);
+        }
+        unsigned msb = std::min(highest_bit(value), MAX_BIT);
+        unsigned shift = msb - SUB_BITS;
+        unsigned sub = static_cast<unsigned>((std::min(value, (std::uint64_t{ 2 } << MAX_BIT) - 1) >> shift) & (SUB_COUNT - 1));
+        return (shift + 1) * SUB_COUNT + sub;
+    }
+
+    static std::uint64_t bucket_lower(unsigned index)
+    {
+        unsigned group = index / SUB_COUNT;
+        unsigned sub = index % SUB_COUNT;
+        return group == 0 ? sub : (std::uint64_t{ SUB_COUNT + sub } << (group - 1));
+    }
+
+    static std::uint64_t bucket_upper(unsigned index)
+    {
+        unsigned group = index / SUB_COUNT;
+        return group == 0 ? bucket_lower(index) : bucket_lower(index) + (std::uint64_t{ 1 } << (group - 1)) - 1;
+    }
+
+    std::uint64_t count() const { return _count; }
+    std::uint64_t max() const { return _max; }
+    double mean() const { return _count == 0 ? 0.0 : static_cast<double>(_sum) / _count; }
+
+    /*Upper bound of the bucket holding the p-th percentile, p in [0, 100]*/
+    std::uint64_t percentile(double p) const
+    {
+        if (_count == 0)
+        {
+            return 0;
+        }
+        std::uint64_t rank = static_cast<std::uint64_t>(p / 100.0 * (_count - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (unsigned i = 0; i < BUCKETS; ++i)
+        {
+            seen += _counts[i];
+            if (seen >= rank)
+            {
+                return std::min(bucket_upper(i), _max);
+            }
+        }
+        return _max;
+    }
+
+private:
+    friend class latency_histogram;
+    std::array<std::uint64_t, BUCKETS> _counts{};
+    std::uint64_t _count = 0;
+    std::uint64_t _sum = 0;
+    std::uint64_t _max = 0;
+};
+
+class latency_histogram
+{
+public:
+    void record(std::uint64_t nanoseconds)
+    {
+        Stripe& stripe = _stripes[thread_stripe() % HISTOGRAM_STRIPES];
+        stripe._counts[histogram_snapshot::bucket_index(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        stripe._sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+        std::uint64_t max = stripe._max.load(std::memory_order_relaxed);
+        while (nanoseconds > max && !stripe._max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    histogram_snapshot snapshot() const
+    {
+        histogram_snapshot res;
+        for (const auto& stripe : _stripes)
+        {
+            for (unsigned i = 0; i < histogram_snapshot::BUCKETS; ++i)
+            {
+                std::uint64_t n = stripe._counts[i].load(std::memory_order_relaxed);
+                res._counts[i] += n;
+                res._count += n;
+            }
+            res._sum += stripe._sum.load(std::memory_order_relaxed);
+            res._max = std::max(res._max, stripe._max.load(std::memory_order_relaxed));
+        }
+        return res;
+    }
+
+private:
+    struct alignas(64) Stripe
+    {
+        std::array<std::atomic<std::uint64_t>, histogram_snapshot::BUCKETS> _counts{};
+        std::atomic<std::uint64_t> _sum{ 0 };
+        std::atomic<std::uint64_t> _max{ 0 };
+    };
+    std::array<Stripe, HISTOGRAM_STRIPES> _stripes;
+};
+
+struct metrics_snapshot
+{
+    bool _enabled = false;
+    double _elapsedSeconds = 0.0;
+    std::uint64_t _pushes = 0;
+    std::uint64_t _pops = 0;
+    std::uint64_t _lookups = 0;
+    std::uint64_t _steals = 0;
+    std::uint64_t _parks = 0;
+    std::int64_t _depth = 0;
+    std::int64_t _depthHighWater = 0;
+    histogram_snapshot _lockWait;
+    histogram_snapshot _lockHold;
+    histogram_snapshot _queueDelay;
+    histogram_snapshot _execTime;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const histogram_snapshot& hist)
+{
+    return os << "n=" << hist.count() << " mean=" << static_cast<std::uint64_t>(hist.mean())
+        << "ns p50=" << hist.percentile(50) << "ns p99=" << hist.percentile(99)
+        << "ns p99.9=" << hist.percentile(99.9) << "ns max=" << hist.max() << "ns";
+}
+
+/*Text dump; also works with Log::Logger since its OutStream is an ostream*/
+inline std::ostream& operator<<(std::ostream& os, const metrics_snapshot& snap)
+{
+    if (!snap._enabled)
+    {
+        return os << "metrics disabled (build with CONCURRENCY_ENABLE_METRICS)";
+    }
+    double seconds = snap._elapsedSeconds > 0 ? snap._elapsedSeconds : 1.0;
+    os << "pushes=" << snap._pushes << " (" << static_cast<std::uint64_t>(snap._pushes / seconds) << "/s)"
+        << " pops=" << snap._pops << " (" << static_cast<std::uint64_t>(snap._pops / seconds) << "/s)"
+        << " lookups=" << snap._lookups
+        << " depth=" << snap._depth << " depth_hwm=" << snap._depthHighWater
+        << " steals=" << snap._steals << " parks=" << snap._parks;
+    if (snap._lockWait.count() != 0) os << "\n  lock wait:   " << snap._lockWait;
+    if (snap._lockHold.count() != 0) os << "\n  lock hold:   " << snap._lockHold;
+    if (snap._queueDelay.count() != 0) os << "\n  queue delay: " << snap._queueDelay;
+    if (snap._execTime.count() != 0) os << "\n  exec time:   " << snap._execTime;
+    return os;
+}
+
+class container_metrics;
+
+/*Records the hold time of a lock when it goes out of scope; declare it right after the lock*/
+class lock_hold_scope
+{
+public:
+    lock_hold_scope(latency_histogram* hold, timestamp acquired) :_hold(hold), _acquired(acquired) {}
+    lock_hold_scope(const lock_hold_scope&) = delete;
+    lock_hold_scope& operator=(const lock_hold_scope&) = delete;
+    ~lock_hold_scope()
+    {
+        if (_hold != nullptr)
+        {
+            _hold->record(now_ns() - _acquired);
+        }
+    }
+private:
+    latency_histogram* _hold;
+    timestamp _acquired;
+};
+
+class container_metrics
+{
+public:
+    static constexpr bool ENABLED = true;
+
+    timestamp clock() const { return now_ns(); }
+
+    void on_push() { _pushes.add(); _depth.increase(); }
+    void on_pop() { _pops.add(); _depth.decrease(); }
+    void on_lookup() { _lookups.add(); }
+    void on_steal() { _steals.add(); }
+    void on_park() { _parks.add(); }
+
+    /*Call with clock() taken just before locking; records the wait and times the hold*/
+    lock_hold_scope lock_acquired(timestamp waitStart)
+    {
+        timestamp acquired = now_ns();
+        _lockWait.record(acquired - waitStart);
+        return lock_hold_scope(&_lockHold, acquired);
+    }
+
+    void record_queue_delay(timestamp enqueued) { _queueDelay.record(now_ns() - enqueued); }
+    void record_exec_time(timestamp started) { _execTime.record(now_ns() - started); }
+
+    metrics_snapshot snapshot() const
+    {
+        metrics_snapshot snap;
+        snap._enabled = true;
+        snap._elapsedSeconds = (now_ns() - _created) / 1e9;
+        snap._pushes = _pushes.load();
+        snap._pops = _pops.load();
+        snap._lookups = _lookups.load();
+        snap._steals = _steals.load();
+        snap._parks = _parks.load();
+        snap._depth = _depth.level();
+        snap._depthHighWater = _depth.high_water();
+        snap._lockWait = _lockWait.snapshot();
+        snap._lockHold = _lockHold.snapshot();
+        snap._queueDelay = _queueDelay.snapshot();
+        snap._execTime = _execTime.snapshot();
+        return snap;
+    }
+
+private:
+    timestamp _created = now_ns();
+    striped_counter _pushes;
+    striped_counter _pops;
+    striped_counter _lookups;
+    striped_counter _steals;
+    striped_counter _parks;
+    level_gauge _depth;
+    latency_histogram _lockWait;
+    latency_histogram _lockHold;
+    latency_histogram _queueDelay;
+    latency_histogram _execTime;
+};
+
+/*Same interface as container_metrics, every hook compiles away*/
+class null_metrics
+{
+public:
+    static constexpr bool ENABLED = false;
+
+    struct empty_scope
+    {
+        ~empty_scope() {}
+    };
+
+    timestamp clock() const { return 0; }
+    void on_push() {}
+    void on_pop() {}
+    void on_lookup() {}
+    void on_steal() {}
+    void on_park() {}
+    empty_scope lock_acquired(timestamp) { return empty_scope{}; }
+    void record_queue_delay(timestamp) {}
+    void record_exec_time(timestamp) {}
+    metrics_snapshot snapshot() const { return metrics_snapshot{}; }
+};
+
+#ifdef CONCURRENCY_ENABLE_METRICS
+using container_metrics_t = container_metrics;
+#else
+using container_metrics_t = null_metrics;
+#endif
+
+METRICS_END
+
+#endif //!__CONTAINER_METRICS_H__
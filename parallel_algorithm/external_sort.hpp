@@ -0,0 +1,579 @@
+#pragma once
+
+#ifndef __EXTERNAL_SORT_H__
+#define __EXTERNAL_SORT_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+#include "my_algorithm.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Out-of-core sort of a binary file of fixed-size records (a raw array of trivially copyable T).
+ * Run generation reads memory-budget-sized runs (mmap on linux, stream reads elsewhere), sorts each
+ * with parallel_sort_range while the next one is being read, and spills it to a temporary file. The
+ * runs are then merged through a loser tree; every run reader prefetches its next block and the
+ * output is written in the background, so disk and compare loop overlap. More runs than fit in the
+ * budget at once are merged in several passes.
+ */
+
+const size_t MIN_MERGE_BLOCK = size_t{ 64 } << 10;
+
+struct external_sort_options
+{
+    size_t _memoryBudget = size_t{ 256 } << 20;   /*bytes; run generation holds two runs, the merge two blocks per run*/
+    size_t _blockSize = size_t{ 1 } << 20;        /*bytes per merge read/write block, at most*/
+    size_t _threads = HARDWARE_THREADS;
+    std::string _tempDir;                         /*empty: std::filesystem::temp_directory_path()*/
+};
+
+struct external_sort_stats
+{
+    size_t _records = 0;
+    size_t _runs = 0;
+    size_t _mergePasses = 0;
+};
+
+[[noreturn]] inline void throw_io_error(const std::string& what)
+{
+    throw std::system_error(errno != 0 ? errno : EIO, std::generic_category(), "external_sort: " + what);
+}
+
+/*Read-only view of a whole input file: a sequential mapping on linux, positioned stream reads elsewhere*/
+class sort_input
+{
+public:
+    explicit sort_input(const std::string& path)
+        :_path(path)
+    {
+#ifdef __linux__
+        _fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (_fd < 0)
+        {
+            throw_io_error("open " + path);
+        }
+        struct stat info;
+        if (::fstat(_fd, &info) != 0)
+        {
+            int error = errno;
+            ::close(_fd);
+            errno = error;
+            throw_io_error("stat " + path);
+        }
+        _size = static_cast<size_t>(info.st_size);
+        if (_size != 0)
+        {
+            _data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (_data == MAP_FAILED)
+            {
+                int error = errno;
+                ::close(_fd);
+                errno = error;
+                throw_io_error("mmap " + path);
+            }
+            ::madvise(_data, _size, MADV_SEQUENTIAL);
+        }
+#else
+        _in.open(path, std::ios::binary);
+        if (!_in)
+        {
+            throw_io_error("open " + path);
+        }
+        _in.seekg(0, std::ios::end);
+        _size = static_cast<size_t>(_in.tellg());
+        _in.seekg(0);
+#endif
+    }
+
+    sort_input(const sort_input&) = delete;
+    sort_input& operator=(const sort_input&) = delete;
+
+    ~sort_input()
+    {
+#ifdef __linux__
+        if (_data != nullptr)
+        {
+            ::munmap(_data, _size);
+        }
+        ::close(_fd);
+#endif
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    void read(void* dst, size_t offset, size_t bytes)
+    {
+        if (bytes == 0)
+        {
+            return;
+        }
+#ifdef __linux__
+        std::memcpy(dst, static_cast<const char*>(_data) + offset, bytes);
+#else
+        _in.seekg(static_cast<std::streamoff>(offset));
+        _in.read(static_cast<char*>(dst), static_cast<std::streamsize>(bytes));
+        if (!_in)
+        {
+            throw_io_error("read " + _path);
+        }
+#endif
+    }
+
+private:
+    std::string _path;
+    size_t _size = 0;
+#ifdef __linux__
+    int _fd = -1;
+    void* _data = nullptr;
+#else
+    std::ifstream _in;
+#endif
+};
+
+/*Run files under one directory; whatever is still listed is deleted on destruction, including after an exception*/
+class sort_temp_files
+{
+public:
+    explicit sort_temp_files(const std::string& dir)
+        :_dir(dir.empty() ? std::filesystem::temp_directory_path() : std::filesystem::path(dir))
+    {
+        static std::atomic<std::uint64_t> sorts{ 0 };
+        _prefix = "external_sort_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())
+            + "_" + std::to_string(sorts.fetch_add(1)) + "_";
+    }
+
+    sort_temp_files(const sort_temp_files&) = delete;
+    sort_temp_files& operator=(const sort_temp_files&) = delete;
+
+    ~sort_temp_files()
+    {
+        for (const auto& path : _files)
+        {
+            std::error_code ignored;
+            std::filesystem::remove(path, ignored);
+        }
+    }
+
+    std::string create()
+    {
+        _files.push_back((_dir / (_prefix + std::to_string(_next++) + ".run")).string());
+        return _files.back();
+    }
+
+    void remove(const std::string& path)
+    {
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+        _files.erase(std::remove(_files.begin(), _files.end(), path), _files.end());
+    }
+
+private:
+    std::filesystem::path _dir;
+    std::string _prefix;
+    std::vector<std::string> _files;
+    size_t _next = 0;
+};
+
+template<class T>
+void write_records(std::ofstream& out, const std::string& path, const std::vector<T>& records)
+{
+    out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(T)));
+    if (!out)
+    {
+        throw_io_error("write " + path);
+    }
+}
+
+/*Writes records as the whole of path; the close is checked too, since buffered bytes only reach the file there*/
+template<class T>
+void write_file(const std::string& path, const std::vector<T>& records)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        throw_io_error("create " + path);
+    }
+    write_records(out, path, records);
+    out.close();
+    if (!out)
+    {
+        throw_io_error("close " + path);
+    }
+}
+
+/*Sequential reader of one sorted run; while the merge consumes a block the next one is already being read*/
+template<class T>
+class run_reader
+{
+public:
+    run_reader(const std::string& path, size_t blockRecords)
+        :_path(path), _in(path, std::ios::binary), _blockRecords(blockRecords)
+    {
+        if (!_in)
+        {
+            throw_io_error("open " + path);
+        }
+        prefetch();
+        next_block();
+    }
+
+    run_reader(const run_reader&) = delete;
+    run_reader& operator=(const run_reader&) = delete;
+
+    ~run_reader()
+    {
+        if (_pending.valid())
+        {
+            _pending.wait();
+        }
+    }
+
+    bool exhausted() const
+    {
+        return _current.empty();
+    }
+
+    const T& front() const
+    {
+        return _current[_pos];
+    }
+
+    void advance()
+    {
+        if (++_pos == _current.size())
+        {
+            next_block();
+        }
+    }
+
+private:
+    void prefetch()
+    {
+        _pending = std::async(std::launch::async, [this]() {
+            _next.resize(_blockRecords);
+            _in.read(reinterpret_cast<char*>(_next.data()), static_cast<std::streamsize>(_blockRecords * sizeof(T)));
+            if (_in.bad())
+            {
+                throw_io_error("read " + _path);
+            }
+            _next.resize(static_cast<size_t>(_in.gcount()) / sizeof(T));
+        });
+    }
+
+    void next_block()
+    {
+        _pending.get();
+        _current.swap(_next);
+        _pos = 0;
+        if (!_current.empty())
+        {
+            prefetch();
+        }
+    }
+
+private:
+    std::string _path;
+    std::ifstream _in;
+    const size_t _blockRecords;
+    std::vector<T> _current;
+    std::vector<T> _next;
+    size_t _pos = 0;
+    std::future<void> _pending;
+};
+
+/*Buffered output whose full blocks are written in the background while the next one fills*/
+template<class T>
+class block_writer
+{
+public:
+    block_writer(const std::string& path, size_t blockRecords)
+        :_path(path), _out(path, std::ios::binary | std::ios::trunc), _blockRecords(blockRecords)
+    {
+        if (!_out)
+        {
+            throw_io_error("create " + path);
+        }
+        _filling.reserve(blockRecords);
+    }
+
+    block_writer(const block_writer&) = delete;
+    block_writer& operator=(const block_writer&) = delete;
+
+    ~block_writer()
+    {
+        if (_pending.valid())
+        {
+            _pending.wait();
+        }
+    }
+
+    void push(const T& record)
+    {
+        _filling.push_back(record);
+        if (_filling.size() == _blockRecords)
+        {
+            flush();
+        }
+    }
+
+    /*Writes what is left and closes the file; errors from any background write surface here*/
+    void finish()
+    {
+        flush();
+        if (_pending.valid())
+        {
+            _pending.get();
+        }
+        _out.close();
+        if (!_out)
+        {
+            throw_io_error("close " + _path);
+        }
+    }
+
+private:
+    void flush()
+    {
+        if (_pending.valid())
+        {
+            _pending.get();
+        }
+        if (_filling.empty())
+        {
+            return;
+        }
+        _writing.swap(_filling);
+        _filling.clear();
+        _filling.reserve(_blockRecords);
+        _pending = std::async(std::launch::async, [this]() { write_records(_out, _path, _writing); });
+    }
+
+private:
+    std::string _path;
+    std::ofstream _out;
+    const size_t _blockRecords;
+    std::vector<T> _filling;
+    std::vector<T> _writing;
+    std::future<void> _pending;
+};
+
+/*
+ * Tournament tree over k runs: each inner node keeps the loser of the match played there and _tree[0]
+ * the overall winner, so replacing the winner replays only its leaf-to-root path, log2(k) compares.
+ * Exhausted runs lose every match; ties go to the lower run index, which keeps the merge stable.
+ */
+template<class T, class Compare>
+class loser_tree
+{
+public:
+    loser_tree(std::vector<std::unique_ptr<run_reader<T>>>& runs, Compare& comp)
+        :_runs(runs), _comp(comp), _tree(std::max<size_t>(runs.size(), 1))
+    {
+        _tree[0] = build(1);
+    }
+
+    bool empty() const
+    {
+        return _runs[_tree[0]]->exhausted();
+    }
+
+    const T& top() const
+    {
+        return _runs[_tree[0]]->front();
+    }
+
+    void pop()
+    {
+        size_t winner = _tree[0];
+        _runs[winner]->advance();
+        for (size_t node = (winner + _runs.size()) / 2; node >= 1; node /= 2)
+        {
+            if (beats(_tree[node], winner))
+            {
+                std::swap(_tree[node], winner);
+            }
+        }
+        _tree[0] = winner;
+    }
+
+private:
+    size_t build(size_t node)
+    {
+        if (node >= _runs.size())
+        {
+            return node - _runs.size();
+        }
+        size_t left = build(2 * node);
+        size_t right = build(2 * node + 1);
+        if (beats(left, right))
+        {
+            _tree[node] = right;
+            return left;
+        }
+        _tree[node] = left;
+        return right;
+    }
+
+    bool beats(size_t lhs, size_t rhs) const
+    {
+        if (_runs[lhs]->exhausted())
+        {
+            return false;
+        }
+        if (_runs[rhs]->exhausted())
+        {
+            return true;
+        }
+        if (_comp(_runs[lhs]->front(), _runs[rhs]->front()))
+        {
+            return true;
+        }
+        return !_comp(_runs[rhs]->front(), _runs[lhs]->front()) && lhs < rhs;
+    }
+
+private:
+    std::vector<std::unique_ptr<run_reader<T>>>& _runs;
+    Compare& _comp;
+    std::vector<size_t> _tree;
+};
+
+template<class T, class Compare>
+void merge_runs(const std::vector<std::string>& inputs, const std::string& output, size_t blockRecords, Compare& comp)
+{
+    std::vector<std::unique_ptr<run_reader<T>>> runs;
+    runs.reserve(inputs.size());
+    for (const auto& path : inputs)
+    {
+        runs.push_back(std::make_unique<run_reader<T>>(path, blockRecords));
+    }
+    block_writer<T> out(output, blockRecords);
+    loser_tree<T, Compare> tree(runs, comp);
+    while (!tree.empty())
+    {
+        out.push(tree.top());
+        tree.pop();
+    }
+    out.finish();
+}
+
+/*
+ * Sorts the records of input into output (which may be the same file) under comp, using about
+ * options._memoryBudget bytes of memory plus temporary run files in options._tempDir. Throws
+ * std::system_error on I/O failures; temporary files are removed either way.
+ */
+template<class T, class Compare = std::less<>>
+external_sort_stats external_sort(const std::string& input, const std::string& output,
+    Compare comp = Compare(), const external_sort_options& options = external_sort_options())
+{
+    static_assert(std::is_trivially_copyable_v<T>, "external_sort stores records as raw bytes");
+    external_sort_stats stats;
+    sort_temp_files temps(options._tempDir);
+    std::vector<std::string> runs;
+    std::vector<T> sorting;
+    {
+        sort_input in(input);
+        if (in.size() % sizeof(T) != 0)
+        {
+            throw std::runtime_error("external_sort: " + input + " is not a whole number of records");
+        }
+        stats._records = in.size() / sizeof(T);
+        const size_t runRecords = std::max<size_t>(1, options._memoryBudget / 2 / sizeof(T));
+        size_t offset = 0;
+        auto read_run = [&](std::vector<T>& run) {
+            const size_t count = std::min(runRecords, stats._records - offset);
+            run.resize(count);
+            in.read(run.data(), offset * sizeof(T), count * sizeof(T));
+            offset += count;
+        };
+        std::vector<T> filling;
+        read_run(sorting);
+        /*everything fits in one run: sort in memory and skip the spill*/
+        const bool single = offset == stats._records;
+        while (!sorting.empty())
+        {
+            std::future<void> next;
+            if (!single)
+            {
+                next = std::async(std::launch::async, read_run, std::ref(filling));
+            }
+            parallel_sort_range(sorting.begin(), sorting.end(), comp, options._threads);
+            ++stats._runs;
+            if (single)
+            {
+                break;
+            }
+            runs.push_back(temps.create());
+            write_file(runs.back(), sorting);
+            next.get();
+            sorting.swap(filling);
+        }
+    }
+    if (runs.empty())
+    {
+        /*the input is unmapped by now, so output may name the same file*/
+        write_file(output, sorting);
+        return stats;
+    }
+    sorting = std::vector<T>();
+
+    /*
+     * Every run being merged holds two blocks, and so does the output. Blocks shrink (down to
+     * MIN_MERGE_BLOCK) so all runs can be merged in one pass; below that, extra passes are cheaper
+     * than seeking between tiny reads.
+     */
+    const size_t onePass = options._memoryBudget / (2 * (runs.size() + 1));
+    const size_t blockSize = std::max(std::min(options._blockSize, onePass), std::min(options._blockSize, MIN_MERGE_BLOCK));
+    const size_t blockRecords = std::max<size_t>(1, blockSize / sizeof(T));
+    const size_t blockBytes = blockRecords * sizeof(T);
+    const size_t blockPairs = options._memoryBudget / (2 * blockBytes);
+    const size_t fanIn = std::max<size_t>(2, blockPairs > 1 ? blockPairs - 1 : 0);
+    while (runs.size() > fanIn)
+    {
+        std::vector<std::string> merged;
+        for (size_t first = 0; first < runs.size(); first += fanIn)
+        {
+            std::vector<std::string> group(runs.begin() + first, runs.begin() + std::min(runs.size(), first + fanIn));
+            if (group.size() == 1)
+            {
+                merged.push_back(group.front());
+                continue;
+            }
+            merged.push_back(temps.create());
+            merge_runs<T>(group, merged.back(), blockRecords, comp);
+            for (const auto& path : group)
+            {
+                temps.remove(path);
+            }
+        }
+        runs.swap(merged);
+        ++stats._mergePasses;
+    }
+    merge_runs<T>(runs, output, blockRecords, comp);
+    ++stats._mergePasses;
+    return stats;
+}
+
+#endif //!__EXTERNAL_SORT_H__
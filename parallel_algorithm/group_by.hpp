@@ -0,0 +1,261 @@
+#pragma once
+
+#ifndef __GROUP_BY_H__
+#define __GROUP_BY_H__
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "my_algorithm.hpp"
+#include "threadsafe_map.hpp"
+
+const ULL LOCAL_GROUPS = 4096; //groups a thread pre-aggregates before spilling; keeps its table in L2
+const ULL GROUP_PARTITIONS_PER_THREAD = 4;
+
+/*
+ * Open-addressing table of (hash, key, aggregate) entries kept in insertion order; the slots only
+ * hold entry indices, so a probe touches 4 bytes per step and clearing is a fill of the slot array.
+ */
+template<class Key, class Agg, class Equal>
+class group_table
+{
+public:
+    struct entry
+    {
+        size_t _hash;
+        Key _key;
+        Agg _agg;
+    };
+
+    explicit group_table(size_t expected)
+    {
+        size_t slots = 16;
+        while (slots < 2 * expected)
+        {
+            slots *= 2;
+        }
+        _slots.assign(slots, EMPTY);
+        _entries.reserve(expected);
+    }
+
+    /*Folds value into key's aggregate with aggFn(Agg&, Agg&&), or starts the group with it*/
+    template<class AggFn>
+    void add(size_t hash, Key&& key, Agg&& value, AggFn& aggFn)
+    {
+        const size_t mask = _slots.size() - 1;
+        for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+        {
+            const std::uint32_t index = _slots[slot];
+            if (index == EMPTY)
+            {
+                _slots[slot] = static_cast<std::uint32_t>(_entries.size());
+                _entries.push_back(entry{ hash, std::move(key), std::move(value) });
+                if (_entries.size() * 2 > _slots.size())
+                {
+                    grow();
+                }
+                return;
+            }
+            entry& existing = _entries[index];
+            if (existing._hash == hash && _equal(existing._key, key))
+            {
+                aggFn(existing._agg, std::move(value));
+                return;
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return _entries.size();
+    }
+
+    std::vector<entry>& entries()
+    {
+        return _entries;
+    }
+
+    void clear()
+    {
+        _entries.clear();
+        std::fill(_slots.begin(), _slots.end(), EMPTY);
+    }
+
+private:
+    static constexpr std::uint32_t EMPTY = ~std::uint32_t{ 0 };
+
+    void grow()
+    {
+        _slots.assign(_slots.size() * 2, EMPTY);
+        const size_t mask = _slots.size() - 1;
+        for (size_t i = 0; i < _entries.size(); ++i)
+        {
+            size_t slot = _entries[i]._hash & mask;
+            while (_slots[slot] != EMPTY)
+            {
+                slot = (slot + 1) & mask;
+            }
+            _slots[slot] = static_cast<std::uint32_t>(i);
+        }
+    }
+
+private:
+    std::vector<std::uint32_t> _slots;
+    std::vector<entry> _entries;
+    Equal _equal;
+};
+
+/*Spreads a std::hash result over all 64 bits (murmur3 finaliser); libstdc++ hashes integers to themselves*/
+inline size_t mix_group_hash(size_t hash)
+{
+    std::uint64_t h = hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+}
+
+template<class Iterator, class KeyFn>
+using group_key_t = std::decay_t<std::invoke_result_t<KeyFn&, typename std::iterator_traits<Iterator>::reference>>;
+
+template<class Iterator, class ValueFn>
+using group_value_t = std::decay_t<std::invoke_result_t<ValueFn&, typename std::iterator_traits<Iterator>::reference>>;
+
+/*
+ * Groups [first, last) by keyFn(element) and folds valueFn(element) into one aggregate per key with
+ * aggFn(Agg& into, Agg&& from), which must be associative and commutative (count, sum, min, max...).
+ * Returns one (key, aggregate) pair per group, in no particular order.
+ *
+ * Every thread pre-aggregates its slice into a small table of LOCAL_GROUPS entries; when it fills, its
+ * groups are spilled into per-partition lists chosen by the top bits of the hash. Each partition is
+ * then merged by a single thread into its own table, so no step takes a lock and a hot key costs one
+ * table update per thread instead of a fight over one bucket.
+ */
+template<class Iterator, class KeyFn, class ValueFn, class AggFn, class Hash = std::hash<group_key_t<Iterator, KeyFn>>>
+std::vector<std::pair<group_key_t<Iterator, KeyFn>, group_value_t<Iterator, ValueFn>>> parallel_group_by(
+    Iterator first, Iterator last, KeyFn keyFn, ValueFn valueFn, AggFn aggFn, size_t threads = HARDWARE_THREADS, const Hash& hash = Hash())
+{
+    static_assert(std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>::value,
+        "parallel_group_by needs random access iterators");
+    using Key = group_key_t<Iterator, KeyFn>;
+    using Agg = group_value_t<Iterator, ValueFn>;
+    using table = group_table<Key, Agg, std::equal_to<Key>>;
+    using entry = typename table::entry;
+
+    const size_t length = static_cast<size_t>(last - first);
+    std::vector<std::pair<Key, Agg>> groups;
+    auto collect = [&groups](std::vector<entry>& entries) {
+        for (auto& e : entries)
+        {
+            groups.emplace_back(std::move(e._key), std::move(e._agg));
+        }
+    };
+    const size_t blocks = select_threads(length, threads);
+    if (blocks <= 1)
+    {
+        table all(LOCAL_GROUPS);
+        for (Iterator it = first; it != last; ++it)
+        {
+            Key key = keyFn(*it);
+            const size_t h = mix_group_hash(hash(key));
+            all.add(h, std::move(key), valueFn(*it), aggFn);
+        }
+        groups.reserve(all.size());
+        collect(all.entries());
+        return groups;
+    }
+
+    size_t partitionBits = 0;
+    while ((size_t{ 1 } << partitionBits) < blocks * GROUP_PARTITIONS_PER_THREAD)
+    {
+        ++partitionBits;
+    }
+    const size_t partitions = size_t{ 1 } << partitionBits;
+    /*partitions come from the top bits, slots inside a table from the bottom ones*/
+    auto partition_of = [partitionBits](size_t h) { return static_cast<size_t>(static_cast<std::uint64_t>(h) >> (64 - partitionBits)); };
+
+    /*spills[block][partition]*/
+    std::vector<std::vector<std::vector<entry>>> spills(blocks, std::vector<std::vector<entry>>(partitions));
+    run_blocks(blocks, [&](size_t block) {
+        table local(LOCAL_GROUPS);
+        auto& spill = spills[block];
+        auto flush = [&]() {
+            for (auto& e : local.entries())
+            {
+                spill[partition_of(e._hash)].push_back(std::move(e));
+            }
+            local.clear();
+        };
+        for (Iterator it = first + length * block / blocks; it != first + length * (block + 1) / blocks; ++it)
+        {
+            Key key = keyFn(*it);
+            const size_t h = mix_group_hash(hash(key));
+            local.add(h, std::move(key), valueFn(*it), aggFn);
+            if (local.size() == LOCAL_GROUPS)
+            {
+                flush();
+            }
+        }
+        flush();
+    });
+
+    std::vector<std::vector<entry>> merged(partitions);
+    std::atomic<size_t> nextPartition{ 0 };
+    run_blocks(blocks, [&](size_t) {
+        for (size_t p = nextPartition.fetch_add(1); p < partitions; p = nextPartition.fetch_add(1))
+        {
+            size_t spilled = 0;
+            for (size_t block = 0; block < blocks; ++block)
+            {
+                spilled += spills[block][p].size();
+            }
+            table combined(std::min(spilled, length / partitions + 1));
+            for (size_t block = 0; block < blocks; ++block)
+            {
+                for (auto& e : spills[block][p])
+                {
+                    combined.add(e._hash, std::move(e._key), std::move(e._agg), aggFn);
+                }
+                std::vector<entry>().swap(spills[block][p]);
+            }
+            merged[p] = std::move(combined.entries());
+        }
+    });
+    size_t total = 0;
+    for (const auto& part : merged)
+    {
+        total += part.size();
+    }
+    groups.reserve(total);
+    for (auto& part : merged)
+    {
+        collect(part);
+    }
+    return groups;
+}
+
+/*
+ * parallel_group_by whose groups are then loaded into map with insert_bulk on the same threads: each
+ * one fills its own range of buckets, in bucket order. Keys already in the map are overwritten, as
+ * with addPair.
+ *
+ * The flat vector parallel_group_by returns is the fast path. With many groups the load costs
+ * several times the aggregation: one node and one lock per group, plus, unless map was constructed
+ * with room for them, allocating every bucket while the table grows. Use this only when the result
+ * has to be a shared threadsafe_map.
+ */
+template<class Key, class Value, class Hash, class Iterator, class KeyFn, class ValueFn, class AggFn>
+void parallel_group_by_into(threadsafe_container::threadsafe_map<Key, Value, Hash>& map,
+    Iterator first, Iterator last, KeyFn keyFn, ValueFn valueFn, AggFn aggFn, size_t threads = HARDWARE_THREADS)
+{
+    auto groups = parallel_group_by(first, last, keyFn, valueFn, aggFn, threads, Hash());
+    map.insert_bulk(groups.begin(), groups.end(), threads);
+}
+
+#endif //!__GROUP_BY_H__
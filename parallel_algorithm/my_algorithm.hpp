@@ -8,10 +8,24 @@
 #include <thread>
 #include <functional>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <system_error>
 
 using ULL = unsigned long long;
 const ULL MIN_PER_THREAD = 25;
 const ULL HARDWARE_THREADS = std::thread::hardware_concurrency();
+const ULL MIN_SELECT_PER_THREAD = 1 << 15; //selection is a few compares per element; smaller blocks lose to thread start-up
+const ULL SELECT_SAMPLE = 8192;
 
 template<class Iterator, class T>
 struct AccumulateBlock {
@@ -52,6 +66,74 @@ T parallel_accumulate(Iterator first, Iterator last, T init)
     return std::accumulate(results.begin(), results.end(), init);
 }
 
+/*
+ * Runs work(i) for every i in [0, chunks) on up to threads threads: executor's workers (anything
+ * with post(F), e.g. SimpleThreadPool) plus the calling thread, which claims chunks as well, so this
+ * is safe to call from a pool worker. Returns once every chunk has run and rethrows the first
+ * exception a chunk threw.
+ */
+template<class Executor, class F>
+void parallel_chunks(Executor& executor, size_t chunks, F work, size_t threads = HARDWARE_THREADS)
+{
+    if (chunks == 0)
+    {
+        return;
+    }
+    struct ChunkState
+    {
+        std::atomic<size_t> _next{ 0 };
+        std::mutex _m;
+        std::condition_variable _cv;
+        size_t _done = 0;
+        std::exception_ptr _error;
+    };
+    auto state = std::make_shared<ChunkState>();
+    /*a helper that starts after the last chunk was claimed returns without touching work*/
+    auto drive = [state, chunks, &work]() {
+        for (size_t i = state->_next.fetch_add(1); i < chunks; i = state->_next.fetch_add(1))
+        {
+            std::exception_ptr error;
+            try
+            {
+                work(i);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(state->_m);
+            if (error && !state->_error)
+            {
+                state->_error = error;
+            }
+            if (++state->_done == chunks)
+            {
+                state->_cv.notify_all();
+            }
+        }
+    };
+    const size_t helpers = std::min(chunks, std::max<size_t>(threads, 1)) - 1;
+    for (size_t i = 0; i < helpers; ++i)
+    {
+        try
+        {
+            executor.post(drive);
+        }
+        catch (...)
+        {
+            /*a stopped executor just leaves more chunks to the caller*/
+            break;
+        }
+    }
+    drive();
+    std::unique_lock<std::mutex> lock(state->_m);
+    state->_cv.wait(lock, [&]() { return state->_done == chunks; });
+    if (state->_error)
+    {
+        std::rethrow_exception(state->_error);
+    }
+}
+
 template<class T>
 int partition(std::vector<T>& nums, int left, int right)
 {
@@ -118,13 +200,13 @@ void merge(std::vector<T>& nums, int left, int mid, int right)
     }
 }
 
-int log2num(int num)
+inline int log2num(int num)
 {
     if (num <= 0) return -1;
     float f_num;
-    unsigned long i_num, exp;
+    unsigned int i_num, exp;
     f_num = (float)num;
-    i_num = *(unsigned long*)&f_num;
+    std::memcpy(&i_num, &f_num, sizeof(i_num));
     exp = (i_num >> 23) & 0xFF;
     return exp - 127;
 }
@@ -184,4 +266,298 @@ void parallel_sort(std::vector<T>& nums, int dstThreadNum)
     }
     merge(nums, 0, blockSize - 1, size - 1);
 }
+
+/*Threads worth using on length elements: at most threads, each with at least MIN_SELECT_PER_THREAD elements*/
+inline size_t select_threads(size_t length, size_t threads)
+{
+    const size_t wanted = threads != 0 ? threads : 2;
+    return std::max<size_t>(1, std::min<size_t>(wanted, length / MIN_SELECT_PER_THREAD));
+}
+
+/*
+ * Runs block(i) for every i in [0, blocks) on its own thread, the last one on the calling thread.
+ * Returns once all have finished and rethrows the first exception one of them threw.
+ */
+template<class F>
+void run_blocks(size_t blocks, F block)
+{
+    std::vector<std::exception_ptr> errors(blocks);
+    auto guarded = [&block, &errors](size_t i) {
+        try
+        {
+            block(i);
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(blocks);
+    for (size_t i = 0; i + 1 < blocks; ++i)
+    {
+        try
+        {
+            threads.emplace_back(guarded, i);
+        }
+        catch (const std::system_error&)
+        {
+            /*out of threads: the caller does this block itself*/
+            guarded(i);
+        }
+    }
+    guarded(blocks - 1);
+    std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
+    for (auto& error : errors)
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+/*Drops all but the k elements of items that come first under comp, in no particular order*/
+template<class T, class Compare>
+void keep_first_k(std::vector<T>& items, size_t k, Compare& comp)
+{
+    if (items.size() > k)
+    {
+        std::nth_element(items.begin(), items.begin() + k, items.end(), comp);
+        items.erase(items.begin() + k, items.end());
+    }
+}
+
+/*The k best of one block: a bounded heap whose front is the worst kept so far, so most elements cost one compare*/
+template<class RandomIt, class T, class Compare>
+void top_k_block(RandomIt first, RandomIt last, size_t k, Compare& comp, std::vector<T>& best)
+{
+    const size_t length = last - first;
+    if (k * 8 >= length)
+    {
+        /*k is a large share of the block and the heap top would be replaced too often; select on a copy*/
+        best.assign(first, last);
+        keep_first_k(best, k, comp);
+        return;
+    }
+    best.assign(first, first + k);
+    std::make_heap(best.begin(), best.end(), comp);
+    for (RandomIt it = first + k; it != last; ++it)
+    {
+        if (comp(*it, best.front()))
+        {
+            std::pop_heap(best.begin(), best.end(), comp);
+            best.back() = *it;
+            std::push_heap(best.begin(), best.end(), comp);
+        }
+    }
+}
+
+/*
+ * The k elements of [first, last) that come first under comp, sorted: the k smallest by default,
+ * pass std::greater<>() for the k largest. Every thread keeps the best k of its block, then the
+ * per-thread winners are merged, so the work is linear in the input for the usual small k.
+ */
+template<class RandomIt, class Compare = std::less<>>
+std::vector<typename std::iterator_traits<RandomIt>::value_type> parallel_top_k(
+    RandomIt first, RandomIt last, size_t k, Compare comp = Compare(), size_t threads = HARDWARE_THREADS)
+{
+    using T = typename std::iterator_traits<RandomIt>::value_type;
+    const size_t length = last - first;
+    k = std::min(k, length);
+    if (k == 0)
+    {
+        return {};
+    }
+    const size_t blocks = select_threads(length, threads);
+    std::vector<std::vector<T>> winners(blocks);
+    run_blocks(blocks, [&](size_t i) {
+        top_k_block(first + length * i / blocks, first + length * (i + 1) / blocks, k, comp, winners[i]);
+    });
+    std::vector<T> result = std::move(winners[0]);
+    for (size_t i = 1; i < blocks; ++i)
+    {
+        result.insert(result.end(), std::make_move_iterator(winners[i].begin()), std::make_move_iterator(winners[i].end()));
+    }
+    keep_first_k(result, k, comp);
+    std::sort(result.begin(), result.end(), comp);
+    return result;
+}
+
+/*
+ * Same contract as std::nth_element. Each round takes two splitters from a sorted sample, about
+ * 2*sqrt(SELECT_SAMPLE) ranks either side of nth, and the threads count and then scatter their blocks
+ * into less / between / greater regions through a scratch buffer (so T must be default constructible).
+ * The next round only looks at the region holding nth, which is usually a few percent of the last
+ * one, and std::nth_element finishes once it is small. Linear work overall.
+ */
+template<class RandomIt, class Compare = std::less<>>
+void parallel_nth_element(RandomIt first, RandomIt nth, RandomIt last, Compare comp = Compare(), size_t threads = HARDWARE_THREADS)
+{
+    using T = typename std::iterator_traits<RandomIt>::value_type;
+    if (nth == last)
+    {
+        return;
+    }
+    std::vector<T> buffer;
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+    while (true)
+    {
+        const size_t length = last - first;
+        const size_t blocks = select_threads(length, threads);
+        if (blocks <= 1)
+        {
+            std::nth_element(first, nth, last, comp);
+            return;
+        }
+        if (buffer.empty())
+        {
+            buffer.resize(length);
+        }
+        const size_t sampleSize = std::min<size_t>(length, SELECT_SAMPLE);
+        std::vector<T> sample;
+        sample.reserve(sampleSize);
+        for (size_t i = 0; i < sampleSize; ++i)
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            sample.push_back(first[state % length]);
+        }
+        std::sort(sample.begin(), sample.end(), comp);
+        const size_t target = static_cast<size_t>(nth - first) * sampleSize / length;
+        const size_t margin = static_cast<size_t>(2 * std::sqrt(static_cast<double>(sampleSize)));
+        const T low = sample[target > margin ? target - margin : 0];
+        const T high = sample[std::min(sampleSize - 1, target + margin)];
+        auto bounds = [&](size_t i) { return length * i / blocks; };
+
+        /*per block: how many go below low and how many between low and high*/
+        std::vector<std::array<size_t, 2>> counts(blocks);
+        run_blocks(blocks, [&](size_t i) {
+            std::array<size_t, 2> count{ 0, 0 };
+            for (RandomIt it = first + bounds(i); it != first + bounds(i + 1); ++it)
+            {
+                if (comp(*it, low))
+                {
+                    ++count[0];
+                }
+                else if (!comp(high, *it))
+                {
+                    ++count[1];
+                }
+            }
+            counts[i] = count;
+        });
+        size_t less = 0;
+        size_t between = 0;
+        for (const auto& count : counts)
+        {
+            less += count[0];
+            between += count[1];
+        }
+        std::vector<std::array<size_t, 3>> offsets(blocks);
+        std::array<size_t, 3> next{ 0, less, less + between };
+        for (size_t i = 0; i < blocks; ++i)
+        {
+            offsets[i] = next;
+            next[0] += counts[i][0];
+            next[1] += counts[i][1];
+            next[2] += bounds(i + 1) - bounds(i) - counts[i][0] - counts[i][1];
+        }
+        run_blocks(blocks, [&](size_t i) {
+            std::array<size_t, 3> at = offsets[i];
+            for (RandomIt it = first + bounds(i); it != first + bounds(i + 1); ++it)
+            {
+                const int region = comp(*it, low) ? 0 : (!comp(high, *it) ? 1 : 2);
+                buffer[at[region]++] = std::move(*it);
+            }
+        });
+        run_blocks(blocks, [&](size_t i) {
+            std::move(buffer.begin() + bounds(i), buffer.begin() + bounds(i + 1), first + bounds(i));
+        });
+
+        const size_t rank = nth - first;
+        if (rank < less)
+        {
+            last = first + less;
+        }
+        else if (rank >= less + between)
+        {
+            first += less + between;
+        }
+        else if (!comp(low, high))
+        {
+            /*low and high are equivalent, so is everything between them: nth is already in place*/
+            return;
+        }
+        else if (between == length)
+        {
+            /*the sample gave no split (tiny spread of values); finish sequentially*/
+            std::nth_element(first, nth, last, comp);
+            return;
+        }
+        else
+        {
+            last = first + less + between;
+            first += less;
+        }
+    }
+}
+
+/*Sorts [first, last): each thread sorts a slice, then neighbouring slices are merged pairwise in parallel*/
+template<class RandomIt, class Compare = std::less<>>
+void parallel_sort_range(RandomIt first, RandomIt last, Compare comp = Compare(), size_t threads = HARDWARE_THREADS)
+{
+    const size_t length = last - first;
+    const size_t blocks = select_threads(length, threads);
+    auto bound = [&](size_t i) { return first + length * std::min(i, blocks) / blocks; };
+    run_blocks(blocks, [&](size_t i) { std::sort(bound(i), bound(i + 1), comp); });
+    for (size_t width = 1; width < blocks; width *= 2)
+    {
+        const size_t pairs = (blocks + 2 * width - 1) / (2 * width);
+        run_blocks(pairs, [&](size_t p) {
+            const size_t left = p * 2 * width;
+            if (left + width < blocks)
+            {
+                std::inplace_merge(bound(left), bound(left + width), bound(left + 2 * width), comp);
+            }
+        });
+    }
+}
+
+/*
+ * Same contract as std::partial_sort: the middle - first elements that come first under comp end up
+ * sorted in [first, middle), the rest in unspecified order. A small prefix is taken the std way, one
+ * bounded heap per block, after which each block's winners are swapped to the front and one more
+ * partial_sort picks among them. A large one is gathered by parallel_nth_element and then sorted.
+ */
+template<class RandomIt, class Compare = std::less<>>
+void parallel_partial_sort(RandomIt first, RandomIt middle, RandomIt last, Compare comp = Compare(), size_t threads = HARDWARE_THREADS)
+{
+    const size_t k = middle - first;
+    const size_t length = last - first;
+    if (k == 0)
+    {
+        return;
+    }
+    const size_t blocks = select_threads(length, threads);
+    if (k * blocks * 8 <= length)
+    {
+        auto bound = [&](size_t i) { return first + length * i / blocks; };
+        run_blocks(blocks, [&](size_t i) { std::partial_sort(bound(i), bound(i) + k, bound(i + 1), comp); });
+        /*
+         * Every block holds at least 8 * k elements, so block j's winners start at or after first + 8 * j * k.
+         * The slot block i's winners move into, [first + i * k, first + (i + 1) * k), thus ends before the
+         * winners of block i and of every later block: a swap only ever displaces losers.
+         */
+        for (size_t i = 1; i < blocks; ++i)
+        {
+            std::swap_ranges(bound(i), bound(i) + k, first + i * k);
+        }
+        std::partial_sort(first, middle, first + blocks * k, comp);
+        return;
+    }
+    parallel_nth_element(first, middle, last, comp, threads);
+    parallel_sort_range(first, middle, comp, threads);
+}
 #endif //!__MY_ALGORITHM_H__
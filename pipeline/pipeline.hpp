@@ -0,0 +1,673 @@
+#pragma once
+
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "base_def.h"
+#include "continuable_future.hpp"
+
+PIPELINE_BEGIN
+
+enum class StageMode
+{
+    PARALLEL,
+    SERIAL_IN_ORDER,
+    SERIAL_OUT_OF_ORDER
+};
+
+struct stage_options
+{
+    StageMode _mode = StageMode::PARALLEL;
+    /*cap on concurrent calls of a PARALLEL stage; 0 leaves only the pipeline's token limit*/
+    size_t _concurrency = 0;
+};
+
+inline stage_options parallel(size_t concurrency = 0)
+{
+    return stage_options{ StageMode::PARALLEL, concurrency };
+}
+
+/*One call at a time, in the order the source produced the items*/
+inline stage_options serial_in_order()
+{
+    return stage_options{ StageMode::SERIAL_IN_ORDER, 1 };
+}
+
+/*One call at a time, in whatever order items arrive*/
+inline stage_options serial_out_of_order()
+{
+    return stage_options{ StageMode::SERIAL_OUT_OF_ORDER, 1 };
+}
+
+namespace detail
+{
+    class source_base
+    {
+    public:
+        virtual ~source_base() = default;
+        virtual void wake() = 0;
+    };
+
+    /*State of one run, shared by every stage*/
+    class run_context
+    {
+    public:
+        threadsafe_container::executor_ref _executor;
+        size_t _maxTokens = 1;
+        /*items between the source and the sink; the only bound the pipeline needs on its buffers*/
+        std::atomic<size_t> _inFlight{ 0 };
+        std::atomic<bool> _cancelled{ false };
+        source_base* _source = nullptr;
+
+        /*Runs run(arg) on the executor, or inline if the executor refuses it (e.g. a stopped pool)*/
+        void dispatch(void (*run)(void*), void* arg)
+        {
+            try
+            {
+                _executor.post(run, arg);
+            }
+            catch (...)
+            {
+                run(arg);
+            }
+        }
+
+        void release_tokens(size_t count)
+        {
+            _inFlight.fetch_sub(count);
+            _source->wake();
+        }
+
+        /*The first error cancels the run: the source stops and queued items are dropped*/
+        void fail(std::exception_ptr error)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_m);
+                if (!_error)
+                {
+                    _error = error;
+                }
+            }
+            _cancelled.store(true);
+        }
+
+        void finish()
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _finished = true;
+            _cv.notify_all();
+        }
+
+        void reset(threadsafe_container::executor_ref executor, size_t maxTokens)
+        {
+            _executor = executor;
+            _maxTokens = maxTokens;
+            _inFlight.store(0);
+            _cancelled.store(false);
+            _finished = false;
+            _error = nullptr;
+        }
+
+        /*Blocks until the sink has seen end of stream, then rethrows the run's first error*/
+        void wait()
+        {
+            std::exception_ptr error;
+            {
+                std::unique_lock<std::mutex> lock(_m);
+                _cv.wait(lock, [this]() { return _finished; });
+                error = _error;
+            }
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+
+    private:
+        std::mutex _m;
+        std::condition_variable _cv;
+        bool _finished = false;
+        std::exception_ptr _error;
+    };
+
+    class node_base
+    {
+    public:
+        virtual ~node_base() = default;
+        virtual void reset() = 0;
+    };
+
+    template<class T>
+    class input_port : public node_base
+    {
+    public:
+        virtual void deliver(std::uint64_t seq, T value) = 0;
+        /*called once, after every deliver from upstream has returned; count is how many there were*/
+        virtual void end_of_stream(std::uint64_t count) = 0;
+    };
+
+    template<class T>
+    struct output_port
+    {
+        input_port<T>* _next = nullptr;
+    };
+
+    template<>
+    struct output_port<void>
+    {
+    };
+
+    /*
+     * A function stage; Out = void makes it the sink. Items wait in _ready (or, for an in-order
+     * stage, in _pending keyed by sequence number); a worker task is posted only while the stage is
+     * below its concurrency and has a runnable item, and it keeps draining until there is none.
+     */
+    template<class In, class Out>
+    class stage : public input_port<In>
+    {
+    public:
+        stage(run_context* ctx, stage_options options, std::function<Out(In)> fn)
+            :_ctx(ctx), _options(options), _fn(std::move(fn)) {}
+
+        output_port<Out> _out;
+
+        void reset() override
+        {
+            _ready.clear();
+            _pending.clear();
+            _active = 0;
+            _nextSeq = 0;
+            _taken = 0;
+            _emitted = 0;
+            _expected = 0;
+            _upstreamDone = false;
+            _eosSent = false;
+        }
+
+        void deliver(std::uint64_t seq, In value) override
+        {
+            bool post = false;
+            {
+                std::lock_guard<std::mutex> lock(_m);
+                if (_options._mode == StageMode::SERIAL_IN_ORDER)
+                {
+                    _pending.emplace(seq, std::move(value));
+                }
+                else
+                {
+                    _ready.emplace_back(seq, std::move(value));
+                }
+                post = claim_locked();
+            }
+            if (post)
+            {
+                _ctx->dispatch(&stage::run_worker, this);
+            }
+        }
+
+        void end_of_stream(std::uint64_t count) override
+        {
+            bool post = false;
+            bool eos = false;
+            {
+                std::lock_guard<std::mutex> lock(_m);
+                _upstreamDone = true;
+                _expected = count;
+                /*after a failure an in-order stage may be waiting for an item that was dropped*/
+                post = claim_locked();
+                eos = !post && eos_due_locked();
+            }
+            if (post)
+            {
+                _ctx->dispatch(&stage::run_worker, this);
+            }
+            else if (eos)
+            {
+                send_eos();
+            }
+        }
+
+    private:
+        static void run_worker(void* self)
+        {
+            static_cast<stage*>(self)->drain();
+        }
+
+        void drain()
+        {
+            while (true)
+            {
+                std::optional<std::pair<std::uint64_t, In>> item;
+                bool eos = false;
+                {
+                    std::lock_guard<std::mutex> lock(_m);
+                    if (!runnable_locked())
+                    {
+                        --_active;
+                        eos = eos_due_locked();
+                    }
+                    else
+                    {
+                        item.emplace(take_locked());
+                    }
+                }
+                if (!item)
+                {
+                    if (eos)
+                    {
+                        send_eos();
+                    }
+                    return;
+                }
+                process(item->first, std::move(item->second));
+            }
+        }
+
+        void process(std::uint64_t seq, In value)
+        {
+            bool emitted = false;
+            if (!_ctx->_cancelled.load())
+            {
+                try
+                {
+                    if constexpr (std::is_void_v<Out>)
+                    {
+                        _fn(std::move(value));
+                    }
+                    else
+                    {
+                        _out._next->deliver(seq, _fn(std::move(value)));
+                        emitted = true;
+                    }
+                }
+                catch (...)
+                {
+                    _ctx->fail(std::current_exception());
+                }
+            }
+            if (!emitted)
+            {
+                /*consumed by the sink, or dropped: either way the item has left the pipeline*/
+                _ctx->release_tokens(1);
+            }
+            std::lock_guard<std::mutex> lock(_m);
+            if (emitted)
+            {
+                ++_emitted;
+            }
+        }
+
+        bool runnable_locked() const
+        {
+            if (_options._mode != StageMode::SERIAL_IN_ORDER)
+            {
+                return !_ready.empty();
+            }
+            return !_pending.empty() && (_pending.begin()->first == _nextSeq || _ctx->_cancelled.load());
+        }
+
+        bool claim_locked()
+        {
+            if (!runnable_locked() || (_options._concurrency != 0 && _active >= _options._concurrency))
+            {
+                return false;
+            }
+            ++_active;
+            return true;
+        }
+
+        std::pair<std::uint64_t, In> take_locked()
+        {
+            ++_taken;
+            if (_options._mode != StageMode::SERIAL_IN_ORDER)
+            {
+                std::pair<std::uint64_t, In> item = std::move(_ready.front());
+                _ready.pop_front();
+                return item;
+            }
+            auto first = _pending.begin();
+            std::pair<std::uint64_t, In> item(first->first, std::move(first->second));
+            _pending.erase(first);
+            _nextSeq = item.first + 1;
+            return item;
+        }
+
+        /*Every item upstream sent has been taken and fully processed*/
+        bool eos_due_locked()
+        {
+            if (!_upstreamDone || _eosSent || _active != 0 || _taken != _expected)
+            {
+                return false;
+            }
+            _eosSent = true;
+            return true;
+        }
+
+        void send_eos()
+        {
+            if constexpr (std::is_void_v<Out>)
+            {
+                _ctx->finish();
+            }
+            else
+            {
+                std::uint64_t emitted = 0;
+                {
+                    std::lock_guard<std::mutex> lock(_m);
+                    emitted = _emitted;
+                }
+                _out._next->end_of_stream(emitted);
+            }
+        }
+
+    private:
+        run_context* _ctx;
+        const stage_options _options;
+        std::function<Out(In)> _fn;
+        std::mutex _m;
+        std::deque<std::pair<std::uint64_t, In>> _ready;
+        std::map<std::uint64_t, In> _pending;
+        size_t _active = 0;
+        std::uint64_t _nextSeq = 0;
+        std::uint64_t _taken = 0;
+        std::uint64_t _emitted = 0;
+        std::uint64_t _expected = 0;
+        bool _upstreamDone = false;
+        bool _eosSent = false;
+    };
+
+    /*
+     * Groups consecutive items, in source order, into vectors of up to size; the last one may be
+     * short. Collecting is only a move, so it happens inline on the delivering thread. Absorbed items
+     * give their tokens back and each batch takes one, so a batch larger than the token limit cannot
+     * stall the pipeline.
+     */
+    template<class T>
+    class batch_stage : public input_port<T>
+    {
+    public:
+        batch_stage(run_context* ctx, size_t size)
+            :_ctx(ctx), _size(size) {}
+
+        output_port<std::vector<T>> _out;
+
+        void reset() override
+        {
+            _pending.clear();
+            _current.clear();
+            _nextSeq = 0;
+            _batches = 0;
+        }
+
+        void deliver(std::uint64_t seq, T value) override
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _pending.emplace(seq, std::move(value));
+            size_t absorbed = 0;
+            while (!_pending.empty() && _pending.begin()->first == _nextSeq)
+            {
+                auto first = _pending.begin();
+                _current.push_back(std::move(first->second));
+                _pending.erase(first);
+                ++_nextSeq;
+                ++absorbed;
+                if (_current.size() == _size)
+                {
+                    emit_locked();
+                }
+            }
+            if (absorbed != 0)
+            {
+                _ctx->release_tokens(absorbed);
+            }
+        }
+
+        void end_of_stream(std::uint64_t) override
+        {
+            std::uint64_t batches = 0;
+            {
+                std::lock_guard<std::mutex> lock(_m);
+                if (!_pending.empty())
+                {
+                    /*only after a failure: the gap before these was dropped upstream*/
+                    _ctx->release_tokens(_pending.size());
+                    _pending.clear();
+                }
+                if (!_current.empty() && !_ctx->_cancelled.load())
+                {
+                    emit_locked();
+                }
+                batches = _batches;
+            }
+            /*not under _m: this can end the run, after which the caller may destroy the pipeline*/
+            _out._next->end_of_stream(batches);
+        }
+
+    private:
+        /*Emitting under _m keeps batches in order; downstream never calls back into this stage*/
+        void emit_locked()
+        {
+            _ctx->_inFlight.fetch_add(1);
+            std::vector<T> batch;
+            batch.reserve(_size);
+            batch.swap(_current);
+            _out._next->deliver(_batches++, std::move(batch));
+        }
+
+    private:
+        run_context* _ctx;
+        const size_t _size;
+        std::mutex _m;
+        std::map<std::uint64_t, T> _pending;
+        std::vector<T> _current;
+        std::uint64_t _nextSeq = 0;
+        std::uint64_t _batches = 0;
+    };
+
+    /*
+     * Pulls items while fewer than max tokens are in flight, then returns its thread to the pool;
+     * a released token wakes it again. Only one runner is ever active.
+     */
+    template<class T>
+    class source_stage : public source_base, public node_base
+    {
+    public:
+        source_stage(run_context* ctx, std::function<std::optional<T>()> fn)
+            :_ctx(ctx), _fn(std::move(fn)) {}
+
+        output_port<T> _out;
+
+        void reset() override
+        {
+            _running.store(false);
+            _done.store(false);
+            _seq = 0;
+        }
+
+        void wake() override
+        {
+            if (!_done.load() && !_running.exchange(true))
+            {
+                _ctx->dispatch(&source_stage::run, this);
+            }
+        }
+
+    private:
+        static void run(void* self)
+        {
+            static_cast<source_stage*>(self)->pull();
+        }
+
+        void pull()
+        {
+            while (true)
+            {
+                bool done = false;
+                while (_ctx->_inFlight.load() < _ctx->_maxTokens)
+                {
+                    std::optional<T> item;
+                    if (!_ctx->_cancelled.load())
+                    {
+                        try
+                        {
+                            item = _fn();
+                        }
+                        catch (...)
+                        {
+                            _ctx->fail(std::current_exception());
+                        }
+                    }
+                    if (!item)
+                    {
+                        done = true;
+                        break;
+                    }
+                    _ctx->_inFlight.fetch_add(1);
+                    _out._next->deliver(_seq++, std::move(*item));
+                }
+                if (done)
+                {
+                    /*_running stays set, so no further wake posts a runner*/
+                    _done.store(true);
+                    _out._next->end_of_stream(_seq);
+                    return;
+                }
+                _running.store(false);
+                /*a token released between the check above and the store would otherwise be missed*/
+                if (_ctx->_inFlight.load() >= _ctx->_maxTokens || _running.exchange(true))
+                {
+                    return;
+                }
+            }
+        }
+
+    private:
+        run_context* _ctx;
+        std::function<std::optional<T>()> _fn;
+        std::atomic<bool> _running{ false };
+        std::atomic<bool> _done{ false };
+        std::uint64_t _seq = 0;
+    };
+
+    struct graph
+    {
+        run_context _ctx;
+        std::vector<std::unique_ptr<node_base>> _nodes;
+        source_base* _source = nullptr;
+    };
+}
+
+/*
+ * A pipeline ready to run: source, stages and sink, scheduled as tasks on an executor.
+ * Built with pipeline::source(...).then(...).batch(...).sink(...).
+ */
+class engine
+{
+public:
+    explicit engine(std::unique_ptr<detail::graph> graph)
+        :_graph(std::move(graph)) {}
+
+    /*
+     * Runs the pipeline to end of stream on executor (anything with post(F), e.g. SimpleThreadPool)
+     * with at most maxTokens items between source and sink, and rethrows the first exception a
+     * stage threw. Blocks the caller, so call it from outside the executor's own threads. An engine
+     * can be run again once a run has returned.
+     */
+    void run(threadsafe_container::executor_ref executor, size_t maxTokens)
+    {
+        if (!executor)
+        {
+            throw std::invalid_argument("pipeline::engine::run needs an executor");
+        }
+        detail::graph& graph = *_graph;
+        graph._ctx.reset(executor, maxTokens != 0 ? maxTokens : 1);
+        for (auto& node : graph._nodes)
+        {
+            node->reset();
+        }
+        graph._source->wake();
+        graph._ctx.wait();
+    }
+
+private:
+    std::unique_ptr<detail::graph> _graph;
+};
+
+/*A pipeline under construction whose last stage produces T*/
+template<class T>
+class flow
+{
+public:
+    flow(std::unique_ptr<detail::graph> graph, detail::output_port<T>* tail)
+        :_graph(std::move(graph)), _tail(tail) {}
+
+    /*Appends a stage computing f(T); f must return a value (use sink for the last stage)*/
+    template<class F>
+    auto then(stage_options options, F f) &&
+    {
+        using Out = std::decay_t<std::invoke_result_t<F&, T>>;
+        static_assert(!std::is_void_v<Out>, "a then() stage must return a value; end the pipeline with sink()");
+        auto next = std::make_unique<detail::stage<T, Out>>(&_graph->_ctx, options, std::function<Out(T)>(std::move(f)));
+        detail::output_port<Out>* tail = &next->_out;
+        return flow<Out>(append(std::move(next)), tail);
+    }
+
+    /*Groups items, in source order, into vectors of up to size*/
+    flow<std::vector<T>> batch(size_t size) &&
+    {
+        auto next = std::make_unique<detail::batch_stage<T>>(&_graph->_ctx, size != 0 ? size : 1);
+        detail::output_port<std::vector<T>>* tail = &next->_out;
+        return flow<std::vector<T>>(append(std::move(next)), tail);
+    }
+
+    template<class F>
+    engine sink(stage_options options, F f) &&
+    {
+        auto last = std::make_unique<detail::stage<T, void>>(&_graph->_ctx, options, std::function<void(T)>(std::move(f)));
+        return engine(append(std::move(last)));
+    }
+
+private:
+    std::unique_ptr<detail::graph> append(std::unique_ptr<detail::input_port<T>> next)
+    {
+        _tail->_next = next.get();
+        _graph->_nodes.push_back(std::move(next));
+        return std::move(_graph);
+    }
+
+private:
+    std::unique_ptr<detail::graph> _graph;
+    detail::output_port<T>* _tail;
+};
+
+/*Starts a pipeline; f() returns the next item, or std::nullopt at end of stream. It is called serially*/
+template<class F>
+auto source(F f)
+{
+    using T = typename std::invoke_result_t<F&>::value_type;
+    auto graph = std::make_unique<detail::graph>();
+    auto first = std::make_unique<detail::source_stage<T>>(&graph->_ctx, std::function<std::optional<T>()>(std::move(f)));
+    detail::output_port<T>* tail = &first->_out;
+    graph->_source = first.get();
+    graph->_ctx._source = first.get();
+    graph->_nodes.push_back(std::move(first));
+    return flow<T>(std::move(graph), tail);
+}
+
+PIPELINE_END
+
+#endif //!__PIPELINE_H__
@@ -0,0 +1,93 @@
+/*
+ * Behaviour tests for concurrent_cache.
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check.
+ */
+#include <atomic>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include "test_harness.hpp"
+#include "concurrent_cache.hpp"
+
+using threadsafe_container::concurrent_cache;
+
+void test_concurrent_misses_compute_once()
+{
+    concurrent_cache<int, std::string> cache(64);
+    std::atomic<int> computed{ 0 };
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::vector<std::thread> threads;
+    std::vector<std::string> results(8);
+    for (size_t t = 0; t < results.size(); ++t)
+    {
+        threads.emplace_back([&, t]() {
+            results[t] = cache.get_or_compute(7, [&]() {
+                computed.fetch_add(1);
+                opened.wait();
+                return std::string("seven");
+            });
+        });
+    }
+    CHECK(wait_until([&]() { return cache.stats()._misses == results.size(); }));
+    gate.set_value();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    CHECK(computed.load() == 1);
+    for (const auto& result : results)
+    {
+        CHECK(result == "seven");
+    }
+    CHECK(cache.get(7) == std::string("seven"));
+}
+
+/*Runs get_or_compute(key) with a compute that blocks until write() has happened, then returns its result*/
+template<class Write>
+std::string compute_around(concurrent_cache<int, std::string>& cache, int key, Write write)
+{
+    std::promise<void> started;
+    std::promise<void> gate;
+    std::future<std::string> computed = std::async(std::launch::async, [&]() {
+        return cache.get_or_compute(key, [&]() {
+            started.set_value();
+            gate.get_future().wait();
+            return std::string("stale");
+        });
+    });
+    started.get_future().wait();
+    write();
+    gate.set_value();
+    return computed.get();
+}
+
+void test_put_during_compute_wins()
+{
+    concurrent_cache<int, std::string> cache(64);
+    std::string returned = compute_around(cache, 1, [&]() { cache.put(1, "fresh"); });
+    CHECK(returned == "stale");
+    CHECK(cache.get(1) == std::string("fresh"));
+}
+
+void test_erase_during_compute_wins()
+{
+    concurrent_cache<int, std::string> cache(64);
+    std::string returned = compute_around(cache, 2, [&]() { cache.erase(2); });
+    CHECK(returned == "stale");
+    CHECK(!cache.get(2));
+    /*the next miss computes again and caches normally*/
+    CHECK(cache.get_or_compute(2, []() { return std::string("again"); }) == "again");
+    CHECK(cache.get(2) == std::string("again"));
+}
+
+int main()
+{
+    run_test("concurrent_misses_compute_once", test_concurrent_misses_compute_once);
+    run_test("put_during_compute_wins", test_put_during_compute_wins);
+    run_test("erase_during_compute_wins", test_erase_during_compute_wins);
+    return 0;
+}
@@ -0,0 +1,258 @@
+/*
+ * Behaviour tests for concurrent_ordered_map (lazy skip list) and the epoch reclamation under it.
+ *
+ * Build with the same include directories as main.cpp; the binary exits non-zero on the first
+ * failed check. Worth running under -fsanitize=thread and -fsanitize=address as well.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "test_harness.hpp"
+#include "concurrent_ordered_map.hpp"
+#include "epoch_reclaim.hpp"
+
+using threadsafe_container::concurrent_ordered_map;
+using threadsafe_container::epoch_domain;
+
+const int THREADS = 4;
+
+std::uint64_t next_random(std::uint64_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+/*
+ * Writers race insert/erase on a few hot keys. Every successful insert and erase of a key must
+ * alternate, so per key the successes differ by at most one and the difference is what is left.
+ * Readers meanwhile check that the keys nobody touches are always found and that every value seen
+ * belongs to its key.
+ */
+void test_insert_erase_find_under_contention()
+{
+    const int HOT_KEYS = 32;
+    const int OPS = 20000;
+    concurrent_ordered_map<int, int> map;
+    /*odd keys are hot, even keys stay put for the readers*/
+    for (int key = 0; key < 2 * HOT_KEYS; key += 2)
+    {
+        CHECK(map.insert(key, key * 10));
+    }
+    std::vector<std::atomic<int>> inserted(2 * HOT_KEYS);
+    std::vector<std::atomic<int>> erased(2 * HOT_KEYS);
+    std::atomic<bool> writersDone{ false };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            std::uint64_t state = 0x9E3779B97F4A7C15ull * (t + 1);
+            for (int i = 0; i < OPS; ++i)
+            {
+                const int key = 2 * static_cast<int>(next_random(state) % HOT_KEYS) + 1;
+                if (next_random(state) % 2 == 0)
+                {
+                    if (map.insert(key, key * 10))
+                    {
+                        inserted[key].fetch_add(1);
+                    }
+                }
+                else if (map.erase(key))
+                {
+                    erased[key].fetch_add(1);
+                }
+            }
+        });
+    }
+    std::thread reader([&]() {
+        while (!writersDone.load())
+        {
+            for (int key = 0; key < 2 * HOT_KEYS; ++key)
+            {
+                auto value = map.find(key);
+                CHECK(!value || *value == key * 10);
+                CHECK(key % 2 == 1 || value);
+            }
+            int previous = -1;
+            map.for_each([&previous](const int& key, const int&) {
+                CHECK(key > previous);
+                previous = key;
+            });
+        }
+    });
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    writersDone = true;
+    reader.join();
+
+    size_t present = HOT_KEYS;
+    for (int key = 1; key < 2 * HOT_KEYS; key += 2)
+    {
+        const int balance = inserted[key].load() - erased[key].load();
+        CHECK(balance == 0 || balance == 1);
+        CHECK(map.contains(key) == (balance == 1));
+        present += static_cast<size_t>(balance);
+    }
+    CHECK(map.size() == present);
+}
+
+/*Consumers pop while producers are still inserting; every key must come out exactly once*/
+void test_pop_front_exactly_once()
+{
+    const int KEYS = 40000;
+    concurrent_ordered_map<int, int> map;
+    for (int key = 0; key < KEYS / 2; ++key)
+    {
+        map.insert(key, key);
+    }
+    std::vector<std::atomic<int>> popped(KEYS);
+    std::atomic<int> producersLeft{ THREADS / 2 };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS / 2; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            for (int key = KEYS / 2 + t; key < KEYS; key += THREADS / 2)
+            {
+                CHECK(map.insert(key, key));
+            }
+            producersLeft.fetch_sub(1);
+        });
+    }
+    for (int t = 0; t < THREADS; ++t)
+    {
+        threads.emplace_back([&]() {
+            while (true)
+            {
+                const bool finalRound = producersLeft.load() == 0;
+                auto front = map.pop_front();
+                if (!front)
+                {
+                    if (finalRound)
+                    {
+                        return;
+                    }
+                    continue;
+                }
+                CHECK(front->first == front->second);
+                popped[front->first].fetch_add(1);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    for (int key = 0; key < KEYS; ++key)
+    {
+        CHECK(popped[key].load() == 1);
+    }
+    CHECK(map.empty());
+}
+
+/*Counters outlive the test: whatever is still retired at exit is freed from a thread_local destructor*/
+std::atomic<int> g_trackedFreed{ 0 };
+std::atomic<int> g_fillerFreed{ 0 };
+
+struct tracked
+{
+    std::atomic<int>* _freed;
+
+    ~tracked()
+    {
+        _freed->fetch_add(1);
+    }
+};
+
+/*Nothing retired while a reader is inside a guard may be freed before that reader leaves it*/
+void test_retire_waits_for_guards()
+{
+    const int TRACKED = 100;
+    std::atomic<int>& freed = g_trackedFreed;
+    std::atomic<int>& fillerFreed = g_fillerFreed;
+    std::atomic<bool> inside{ false };
+    std::atomic<bool> leave{ false };
+    std::thread reader([&]() {
+        epoch_domain::guard guard;
+        inside = true;
+        while (!leave.load())
+        {
+            std::this_thread::yield();
+        }
+    });
+    CHECK(wait_until([&]() { return inside.load(); }));
+    epoch_domain& domain = epoch_domain::instance();
+    for (int i = 0; i < TRACKED; ++i)
+    {
+        domain.retire(new tracked{ &freed });
+    }
+    /*plenty of reclaim passes: each one may advance the epoch at most once past the reader*/
+    for (int i = 0; i < 100000; ++i)
+    {
+        domain.retire(new tracked{ &fillerFreed });
+    }
+    CHECK(freed.load() == 0);
+    leave = true;
+    reader.join();
+    CHECK(wait_until([&]() {
+        domain.retire(new tracked{ &fillerFreed });
+        return freed.load() == TRACKED;
+    }));
+}
+
+/*Erasers and readers churn the same keys; ASan catches a node freed under a reader*/
+void test_readers_survive_erase()
+{
+    const int KEYS = 256;
+    concurrent_ordered_map<int, std::shared_ptr<int>> map;
+    std::atomic<bool> stop{ false };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS / 2; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            std::uint64_t state = 12345 + t;
+            for (int i = 0; i < 50000; ++i)
+            {
+                const int key = static_cast<int>(next_random(state) % KEYS);
+                if (!map.erase(key))
+                {
+                    map.insert(key, std::make_shared<int>(key));
+                }
+            }
+        });
+    }
+    for (int t = 0; t < THREADS / 2; ++t)
+    {
+        threads.emplace_back([&]() {
+            while (!stop.load())
+            {
+                map.for_each([](const int& key, const std::shared_ptr<int>& value) {
+                    CHECK(*value == key);
+                });
+            }
+        });
+    }
+    for (int t = 0; t < THREADS / 2; ++t)
+    {
+        threads[t].join();
+    }
+    stop = true;
+    for (size_t t = THREADS / 2; t < threads.size(); ++t)
+    {
+        threads[t].join();
+    }
+}
+
+int main()
+{
+    run_test("insert_erase_find_under_contention", test_insert_erase_find_under_contention);
+    run_test("pop_front_exactly_once", test_pop_front_exactly_once);
+    run_test("retire_waits_for_guards", test_retire_waits_for_guards);
+    run_test("readers_survive_erase", test_readers_survive_erase);
+    return 0;
+}
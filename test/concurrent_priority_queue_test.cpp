@@ -0,0 +1,242 @@
+/*
+ * Behaviour tests for concurrent_priority_queue (strict order, FIFO among equal elements) and
+ * relaxed_priority_queue (no element lost or duplicated, nullopt only when empty).
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check. Worth running under -fsanitize=thread as well.
+ */
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "test_harness.hpp"
+#include "concurrent_priority_queue.hpp"
+
+using threadsafe_container::concurrent_priority_queue;
+using threadsafe_container::relaxed_priority_queue;
+
+/*(key, push index); ordered by key only, so equal keys are ties the queue must keep in push order*/
+using keyed = std::pair<int, int>;
+
+struct key_less
+{
+    bool operator()(const keyed& lhs, const keyed& rhs) const
+    {
+        return lhs.first < rhs.first;
+    }
+};
+
+void test_strict_pops_in_order_fifo_on_ties()
+{
+    concurrent_priority_queue<keyed, key_less> queue;
+    std::mt19937 rng(7);
+    const int count = 20000;
+    for (int i = 0; i < count; ++i)
+    {
+        queue.push(keyed(static_cast<int>(rng() % 50), i));
+    }
+    CHECK(queue.size() == static_cast<size_t>(count));
+    std::optional<keyed> previous;
+    int popped = 0;
+    while (auto item = queue.try_pop_min())
+    {
+        if (previous)
+        {
+            CHECK(previous->first <= item->first);
+            CHECK(previous->first < item->first || previous->second < item->second);
+        }
+        previous = item;
+        ++popped;
+    }
+    CHECK(popped == count);
+    CHECK(queue.empty());
+}
+
+void test_strict_custom_compare()
+{
+    concurrent_priority_queue<int, std::greater<int>> queue;
+    for (int v : { 3, 9, 1, 7, 9, 4 })
+    {
+        queue.push(v);
+    }
+    std::vector<int> order;
+    while (auto item = queue.try_pop_min())
+    {
+        order.push_back(*item);
+    }
+    CHECK((order == std::vector<int>{ 9, 9, 7, 4, 3, 1 }));
+}
+
+/*With nothing pushed meanwhile, each popper sees the minimum shrink away: its own pops never go down*/
+void test_strict_concurrent_pops_stay_ordered()
+{
+    concurrent_priority_queue<int> queue;
+    const int count = 40000;
+    std::vector<int> values(count);
+    for (int i = 0; i < count; ++i)
+    {
+        values[i] = i;
+    }
+    std::shuffle(values.begin(), values.end(), std::mt19937(11));
+    for (int v : values)
+    {
+        queue.push(v);
+    }
+    const int threads = 4;
+    std::vector<std::vector<int>> popped(threads);
+    std::vector<std::thread> poppers;
+    for (int t = 0; t < threads; ++t)
+    {
+        poppers.emplace_back([&queue, &popped, t]() {
+            while (auto item = queue.try_pop_min())
+            {
+                popped[t].push_back(*item);
+            }
+        });
+    }
+    for (auto& popper : poppers)
+    {
+        popper.join();
+    }
+    std::vector<int> all;
+    for (const auto& own : popped)
+    {
+        CHECK(std::is_sorted(own.begin(), own.end()));
+        all.insert(all.end(), own.begin(), own.end());
+    }
+    std::sort(all.begin(), all.end());
+    CHECK(all.size() == static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i)
+    {
+        CHECK(all[i] == i);
+    }
+}
+
+/*Producers and consumers at once: every element comes out exactly once*/
+template<class Queue>
+void check_no_element_lost(Queue& queue)
+{
+    const int producers = 3;
+    const int perProducer = 20000;
+    const int total = producers * perProducer;
+    std::atomic<int> produced{ 0 };
+    std::atomic<int> consumed{ 0 };
+    std::vector<std::vector<int>> taken(2);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&queue, &produced, p]() {
+            for (int i = 0; i < perProducer; ++i)
+            {
+                queue.push(p * perProducer + i);
+                produced.fetch_add(1);
+            }
+        });
+    }
+    for (size_t c = 0; c < taken.size(); ++c)
+    {
+        threads.emplace_back([&queue, &produced, &consumed, &taken, c]() {
+            while (true)
+            {
+                /*read before popping: if everything was produced and the queue is empty, it is drained*/
+                bool allProduced = produced.load() == total;
+                auto item = queue.try_pop_min();
+                if (item)
+                {
+                    taken[c].push_back(*item);
+                    consumed.fetch_add(1);
+                }
+                else if (allProduced)
+                {
+                    return;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    std::vector<int> all;
+    for (const auto& own : taken)
+    {
+        all.insert(all.end(), own.begin(), own.end());
+    }
+    std::sort(all.begin(), all.end());
+    CHECK(consumed.load() == total);
+    CHECK(all.size() == static_cast<size_t>(total));
+    for (int i = 0; i < total; ++i)
+    {
+        CHECK(all[i] == i);
+    }
+    CHECK(queue.empty());
+}
+
+void test_strict_no_element_lost()
+{
+    concurrent_priority_queue<int> queue;
+    check_no_element_lost(queue);
+}
+
+void test_relaxed_no_element_lost()
+{
+    relaxed_priority_queue<int> queue(4);
+    check_no_element_lost(queue);
+    relaxed_priority_queue<int> defaultHeaps;
+    check_no_element_lost(defaultHeaps);
+}
+
+/*Only a full sweep may report empty, so a single element in one of many heaps is always found*/
+void test_relaxed_finds_last_element()
+{
+    relaxed_priority_queue<int> queue(64);
+    for (int round = 0; round < 1000; ++round)
+    {
+        queue.push(round);
+        auto item = queue.try_pop_min();
+        CHECK(item && *item == round);
+        CHECK(!queue.try_pop_min());
+    }
+}
+
+/*Quiescent single-threaded use: everything pushed comes back, in roughly ascending order*/
+void test_relaxed_drains_everything()
+{
+    relaxed_priority_queue<int, std::greater<int>> queue(4);
+    const int count = 10000;
+    for (int i = 0; i < count; ++i)
+    {
+        queue.push(i);
+    }
+    CHECK(queue.size() == static_cast<size_t>(count));
+    std::vector<int> popped;
+    while (auto item = queue.try_pop_min())
+    {
+        popped.push_back(*item);
+    }
+    CHECK(popped.size() == static_cast<size_t>(count));
+    /*the first pop is the better of two heap tops, and each of the 4 heaps almost surely holds one of the top 64*/
+    CHECK(popped.front() >= count - 64);
+    std::sort(popped.begin(), popped.end());
+    for (int i = 0; i < count; ++i)
+    {
+        CHECK(popped[i] == i);
+    }
+    CHECK(queue.empty());
+}
+
+int main()
+{
+    run_test("strict_pops_in_order_fifo_on_ties", test_strict_pops_in_order_fifo_on_ties);
+    run_test("strict_custom_compare", test_strict_custom_compare);
+    run_test("strict_concurrent_pops_stay_ordered", test_strict_concurrent_pops_stay_ordered);
+    run_test("strict_no_element_lost", test_strict_no_element_lost);
+    run_test("relaxed_no_element_lost", test_relaxed_no_element_lost);
+    run_test("relaxed_finds_last_element", test_relaxed_finds_last_element);
+    run_test("relaxed_drains_everything", test_relaxed_drains_everything);
+    return 0;
+}
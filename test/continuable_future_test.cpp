@@ -0,0 +1,94 @@
+/*
+ * Behaviour tests for continuable_future continuations on SimpleThreadPool.
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check. Worth running under -fsanitize=address as well.
+ */
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "test_harness.hpp"
+#include "simple_thread_pool.hpp"
+#include "continuable_future.hpp"
+
+using threadsafe_container::continuable_future;
+using threadsafe_container::continuable_promise;
+
+bool is_broken_promise(continuable_future<int>& future)
+{
+    try
+    {
+        future.get();
+    }
+    catch (const std::future_error& e)
+    {
+        return e.code() == std::future_errc::broken_promise;
+    }
+    return false;
+}
+
+void test_then_and_when_all_on_pool()
+{
+    SimpleThreadPool pool(2);
+    std::vector<continuable_future<int>> parts;
+    for (int i = 0; i < 8; ++i)
+    {
+        parts.push_back(pool.submit([i]() { return i; }).then([](int v) { return v * 10; }));
+    }
+    std::vector<int> values = threadsafe_container::when_all(std::move(parts)).get();
+    CHECK(values.size() == 8);
+    for (int i = 0; i < 8; ++i)
+    {
+        CHECK(values[i] == i * 10);
+    }
+}
+
+/*A continuation shutdown_now() drops from the queue breaks its future, and the chain behind it*/
+void test_discarded_continuation_breaks_future()
+{
+    SimpleThreadPool pool(1);
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::atomic<bool> blocking{ false };
+    pool.post([&blocking, opened]() {
+        blocking = true;
+        opened.wait();
+    });
+    CHECK(wait_until([&]() { return blocking.load(); }));
+    std::atomic<bool> ran{ false };
+    continuable_promise<int> promise(pool);
+    continuable_future<int> next = promise.get_future().then([&ran](int v) { ran = true; return v + 1; });
+    continuable_future<int> after = next.then([&ran](int v) { ran = true; return v + 1; });
+    promise.set_value(1);
+    size_t discarded = 0;
+    std::thread stopper([&]() { discarded = pool.shutdown_now(); });
+    CHECK(wait_until([&]() { return after.is_ready(); }));
+    gate.set_value();
+    stopper.join();
+    CHECK(discarded == 1);
+    CHECK(!ran.load());
+    CHECK(is_broken_promise(after));
+}
+
+/*Once the pool is stopped, post throws and the continuation runs inline instead*/
+void test_continuation_runs_inline_on_stopped_pool()
+{
+    SimpleThreadPool pool(1);
+    continuable_promise<int> promise(pool);
+    continuable_future<int> next = promise.get_future().then([](int v) { return v + 1; });
+    pool.drain();
+    promise.set_value(41);
+    CHECK(next.is_ready());
+    CHECK(next.get() == 42);
+}
+
+int main()
+{
+    run_test("then_and_when_all_on_pool", test_then_and_when_all_on_pool);
+    run_test("discarded_continuation_breaks_future", test_discarded_continuation_breaks_future);
+    run_test("continuation_runs_inline_on_stopped_pool", test_continuation_runs_inline_on_stopped_pool);
+    return 0;
+}
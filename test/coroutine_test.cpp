@@ -0,0 +1,72 @@
+/*
+ * Behaviour tests for the coroutine layer: async_pop on threadsafe_queue and threadsaft_stack.
+ *
+ * Needs C++20; build with the same include directories as main.cpp (linked against boost_thread).
+ * The binary exits non-zero on the first failed check.
+ */
+#include <atomic>
+#include <stdexcept>
+#include "test_harness.hpp"
+#include "simple_thread_pool.hpp"
+#include "threadsafe_queue.hpp"
+#include "threadsafe_stack.hpp"
+#include "task.hpp"
+
+using threadsafe_container::threadsafe_queue;
+using threadsafe_container::threadsaft_stack;
+
+template<class Container>
+coro::task<void> pop_into(Container& container, SimpleThreadPool& pool, std::atomic<int>& result)
+{
+    result = co_await container.async_pop(pool);
+}
+
+void test_async_pop_resumes_on_pool()
+{
+    SimpleThreadPool pool(2);
+    threadsafe_queue<int> queue;
+    std::atomic<int> result{ -1 };
+    coro::spawn(pop_into(queue, pool, result));
+    queue.push(7);
+    CHECK(wait_until([&]() { return result.load() == 7; }));
+}
+
+/*With the pool stopped the waiter resumes on the pusher; the push neither throws nor loses its value*/
+template<class Container>
+void check_push_to_waiters_of_stopped_pool()
+{
+    SimpleThreadPool pool(1);
+    Container container;
+    std::atomic<int> first{ -1 };
+    std::atomic<int> second{ -1 };
+    coro::spawn(pop_into(container, pool, first));
+    coro::spawn(pop_into(container, pool, second));
+    pool.drain();
+    bool threw = false;
+    try
+    {
+        container.push(42);
+        container.push(43);
+    }
+    catch (const std::runtime_error&)
+    {
+        threw = true;
+    }
+    CHECK(!threw);
+    CHECK(first.load() != -1 && second.load() != -1);
+    CHECK(first.load() + second.load() == 85);
+    CHECK(container.empty());
+}
+
+void test_push_to_waiters_of_stopped_pool()
+{
+    check_push_to_waiters_of_stopped_pool<threadsafe_queue<int>>();
+    check_push_to_waiters_of_stopped_pool<threadsaft_stack<int>>();
+}
+
+int main()
+{
+    run_test("async_pop_resumes_on_pool", test_async_pop_resumes_on_pool);
+    run_test("push_to_waiters_of_stopped_pool", test_push_to_waiters_of_stopped_pool);
+    return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * Behaviour tests for external_sort: single-run and multi-pass merges against std::sort, empty
+ * input, sorting a file onto itself, and cleanup of the run files after success and failure.
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check. It writes a few MB below the system temp directory.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "test_harness.hpp"
+#include "external_sort.hpp"
+
+struct record
+{
+    std::uint32_t _key;
+    std::uint32_t _id;
+};
+
+/*A scratch directory of its own, removed with everything in it*/
+struct scratch_dir
+{
+    scratch_dir()
+        :_path(std::filesystem::temp_directory_path() / ("external_sort_test_" + std::to_string(std::random_device()())))
+    {
+        std::filesystem::create_directories(_path);
+    }
+
+    ~scratch_dir()
+    {
+        std::error_code ignored;
+        std::filesystem::remove_all(_path, ignored);
+    }
+
+    std::string file(const std::string& name) const
+    {
+        return (_path / name).string();
+    }
+
+    size_t run_files() const
+    {
+        size_t count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(_path))
+        {
+            count += entry.path().extension() == ".run";
+        }
+        return count;
+    }
+
+    std::filesystem::path _path;
+};
+
+template<class T>
+void save(const std::string& path, const std::vector<T>& records)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+    CHECK(out.good());
+}
+
+template<class T>
+std::vector<T> load(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CHECK(bytes.size() % sizeof(T) == 0);
+    std::vector<T> records(bytes.size() / sizeof(T));
+    if (!bytes.empty())
+    {
+        std::memcpy(records.data(), bytes.data(), bytes.size());
+    }
+    return records;
+}
+
+std::vector<std::uint64_t> random_values(size_t n, std::uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<std::uint64_t> values(n);
+    for (auto& v : values)
+    {
+        v = rng() % 1000003;
+    }
+    return values;
+}
+
+void test_single_run_sorts_in_memory()
+{
+    scratch_dir dir;
+    std::vector<std::uint64_t> values = random_values(10000, 1);
+    save(dir.file("in"), values);
+    external_sort_options options;
+    options._tempDir = dir._path.string();
+    external_sort_stats stats = external_sort<std::uint64_t>(dir.file("in"), dir.file("out"), std::less<>(), options);
+    std::sort(values.begin(), values.end());
+    CHECK(load<std::uint64_t>(dir.file("out")) == values);
+    CHECK(stats._records == values.size());
+    CHECK(stats._runs == 1);
+    CHECK(stats._mergePasses == 0);
+    CHECK(dir.run_files() == 0);
+}
+
+/*64 KB of budget and 8 KB blocks merge 3 runs at a time, so 2.4 MB of input takes several passes*/
+void test_multi_pass_merge()
+{
+    scratch_dir dir;
+    std::vector<std::uint64_t> values = random_values(300000, 2);
+    save(dir.file("in"), values);
+    external_sort_options options;
+    options._memoryBudget = size_t{ 64 } << 10;
+    options._blockSize = size_t{ 8 } << 10;
+    options._threads = 3;
+    options._tempDir = dir._path.string();
+    external_sort_stats stats = external_sort<std::uint64_t>(dir.file("in"), dir.file("out"), std::less<>(), options);
+    std::sort(values.begin(), values.end());
+    CHECK(load<std::uint64_t>(dir.file("out")) == values);
+    CHECK(stats._records == values.size());
+    CHECK(stats._runs == (values.size() * sizeof(std::uint64_t) + (32 << 10) - 1) / (32 << 10));
+    CHECK(stats._mergePasses > 1);
+    CHECK(dir.run_files() == 0);
+
+    /*a roomier budget merges every run in one pass*/
+    options._memoryBudget = size_t{ 1 } << 20;
+    stats = external_sort<std::uint64_t>(dir.file("in"), dir.file("out"), std::less<>(), options);
+    CHECK(load<std::uint64_t>(dir.file("out")) == values);
+    CHECK(stats._runs > 1);
+    CHECK(stats._mergePasses == 1);
+}
+
+void test_sort_file_onto_itself()
+{
+    scratch_dir dir;
+    std::vector<std::uint64_t> values = random_values(100000, 3);
+    save(dir.file("data"), values);
+    external_sort_options options;
+    options._memoryBudget = size_t{ 128 } << 10;
+    options._blockSize = size_t{ 8 } << 10;
+    options._tempDir = dir._path.string();
+    external_sort<std::uint64_t>(dir.file("data"), dir.file("data"), std::greater<>(), options);
+    std::sort(values.begin(), values.end(), std::greater<>());
+    CHECK(load<std::uint64_t>(dir.file("data")) == values);
+}
+
+void test_empty_input()
+{
+    scratch_dir dir;
+    save(dir.file("in"), std::vector<std::uint64_t>());
+    external_sort_options options;
+    options._tempDir = dir._path.string();
+    external_sort_stats stats = external_sort<std::uint64_t>(dir.file("in"), dir.file("out"), std::less<>(), options);
+    CHECK(std::filesystem::exists(dir.file("out")));
+    CHECK(std::filesystem::file_size(dir.file("out")) == 0);
+    CHECK(stats._records == 0);
+    CHECK(stats._mergePasses == 0);
+}
+
+/*Records sorted by a key with many duplicates: keys come out in order and no record is lost*/
+void test_records_by_key()
+{
+    scratch_dir dir;
+    std::mt19937_64 rng(4);
+    std::vector<record> records(200000);
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        records[i] = record{ static_cast<std::uint32_t>(rng() % 100), static_cast<std::uint32_t>(i) };
+    }
+    save(dir.file("in"), records);
+    external_sort_options options;
+    options._memoryBudget = size_t{ 256 } << 10;
+    options._blockSize = size_t{ 4 } << 10;
+    options._tempDir = dir._path.string();
+    auto byKey = [](const record& lhs, const record& rhs) { return lhs._key < rhs._key; };
+    external_sort_stats stats = external_sort<record>(dir.file("in"), dir.file("out"), byKey, options);
+    CHECK(stats._runs > 1);
+    std::vector<record> sorted = load<record>(dir.file("out"));
+    CHECK(sorted.size() == records.size());
+    CHECK(std::is_sorted(sorted.begin(), sorted.end(), byKey));
+    std::vector<bool> seen(records.size(), false);
+    for (const record& r : sorted)
+    {
+        CHECK(r._id < seen.size() && !seen[r._id]);
+        CHECK(records[r._id]._key == r._key);
+        seen[r._id] = true;
+    }
+}
+
+void test_bad_input_leaves_no_run_files()
+{
+    scratch_dir dir;
+    {
+        std::ofstream odd(dir.file("odd"), std::ios::binary);
+        odd << "abc";
+    }
+    external_sort_options options;
+    options._tempDir = dir._path.string();
+    bool threw = false;
+    try
+    {
+        external_sort<std::uint64_t>(dir.file("odd"), dir.file("out"), std::less<>(), options);
+    }
+    catch (const std::runtime_error&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    threw = false;
+    try
+    {
+        external_sort<std::uint64_t>(dir.file("missing"), dir.file("out"), std::less<>(), options);
+    }
+    catch (const std::system_error&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(dir.run_files() == 0);
+}
+
+int main()
+{
+    run_test("single_run_sorts_in_memory", test_single_run_sorts_in_memory);
+    run_test("multi_pass_merge", test_multi_pass_merge);
+    run_test("sort_file_onto_itself", test_sort_file_onto_itself);
+    run_test("empty_input", test_empty_input);
+    run_test("records_by_key", test_records_by_key);
+    run_test("bad_input_leaves_no_run_files", test_bad_input_leaves_no_run_files);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Behaviour tests for parallel_group_by and parallel_group_by_into against a serial std::map count,
+ * across group counts below and above LOCAL_GROUPS and with a hash that puts every key in one bucket.
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check.
+ */
+#include <cstdint>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "test_harness.hpp"
+#include "group_by.hpp"
+
+using row = std::pair<long, int>;
+
+std::vector<row> make_rows(size_t n, size_t groups, std::uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<row> rows(n);
+    for (auto& r : rows)
+    {
+        r = row(static_cast<long>(rng() % groups), static_cast<int>(rng() % 10));
+    }
+    return rows;
+}
+
+std::map<long, long> serial_sums(const std::vector<row>& rows)
+{
+    std::map<long, long> sums;
+    for (const auto& r : rows)
+    {
+        sums[r.first] += r.second;
+    }
+    return sums;
+}
+
+/*One group, a few hundred, and more than LOCAL_GROUPS, so the local tables spill to partitions*/
+void test_sums_match_serial()
+{
+    std::uint64_t seed = 1;
+    for (size_t n : { size_t(0), size_t(10), size_t(50000), size_t(400000) })
+    {
+        for (size_t groups : { size_t(1), size_t(300), size_t(100000) })
+        {
+            std::vector<row> rows = make_rows(n, groups, seed++);
+            std::map<long, long> expected = serial_sums(rows);
+            for (size_t threads : { size_t(1), size_t(4) })
+            {
+                auto result = parallel_group_by(rows.begin(), rows.end(), [](const row& r) { return r.first; },
+                    [](const row& r) { return static_cast<long>(r.second); }, [](long& into, long&& from) { into += from; }, threads);
+                CHECK(result.size() == expected.size());
+                std::map<long, long> got(result.begin(), result.end());
+                CHECK(got == expected);
+            }
+        }
+    }
+}
+
+/*Every key hashes alike: grouping must still go by key equality*/
+void test_colliding_hash()
+{
+    std::vector<row> rows = make_rows(100000, 2000, 7);
+    std::map<long, long> expected = serial_sums(rows);
+    auto sameHash = [](long) { return size_t{ 42 }; };
+    auto result = parallel_group_by(rows.begin(), rows.end(), [](const row& r) { return r.first; },
+        [](const row& r) { return static_cast<long>(r.second); }, [](long& into, long&& from) { into += from; }, 4, sameHash);
+    std::map<long, long> got(result.begin(), result.end());
+    CHECK(result.size() == expected.size());
+    CHECK(got == expected);
+}
+
+void test_word_count_and_min()
+{
+    std::mt19937_64 rng(3);
+    std::vector<std::string> words;
+    for (int i = 0; i < 200000; ++i)
+    {
+        words.push_back("w" + std::to_string(rng() % 5000));
+    }
+    std::map<std::string, size_t> counts;
+    std::map<size_t, std::string> shortest;
+    for (const auto& w : words)
+    {
+        ++counts[w];
+        auto it = shortest.find(w.size());
+        if (it == shortest.end() || w < it->second)
+        {
+            shortest[w.size()] = w;
+        }
+    }
+
+    threadsafe_container::threadsafe_map<std::string, size_t, threadsafe_container::string_hash> map;
+    parallel_group_by_into(map, words.begin(), words.end(), [](const std::string& w) { return w; },
+        [](const std::string&) { return size_t{ 1 }; }, [](size_t& into, size_t&& from) { into += from; }, 3);
+    CHECK(map.size() == counts.size());
+    for (const auto& kv : counts)
+    {
+        CHECK(map.getValue(kv.first) == kv.second);
+    }
+
+    auto mins = parallel_group_by(words.begin(), words.end(), [](const std::string& w) { return w.size(); },
+        [](const std::string& w) { return w; }, [](std::string& into, std::string&& from) {
+            if (from < into)
+            {
+                into = std::move(from);
+            }
+        }, 4);
+    std::map<size_t, std::string> got(mins.begin(), mins.end());
+    CHECK(got == shortest);
+}
+
+/*An exception from keyFn on a worker thread reaches the caller*/
+void test_key_exception_propagates()
+{
+    std::vector<int> v(200000, 1);
+    bool threw = false;
+    try
+    {
+        parallel_group_by(v.begin(), v.end(), [](int x) -> int {
+                if (x != 0)
+                {
+                    throw std::runtime_error("key failed");
+                }
+                return x;
+            }, [](int x) { return x; }, [](int& into, int&& from) { into += from; }, 4);
+    }
+    catch (const std::runtime_error&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+int main()
+{
+    run_test("sums_match_serial", test_sums_match_serial);
+    run_test("colliding_hash", test_colliding_hash);
+    run_test("word_count_and_min", test_word_count_and_min);
+    run_test("key_exception_propagates", test_key_exception_propagates);
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Behaviour tests for the logger's config reloading.
+ *
+ * Build with the same include directories as main.cpp, together with log/logger.cpp; the binary
+ * exits non-zero on the first failed check.
+ */
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "test_harness.hpp"
+#include "logger.h"
+
+std::string write_config(const std::string& name, const char* level)
+{
+    std::filesystem::path path = std::filesystem::temp_directory_path() / name;
+    std::ofstream out(path);
+    out << "{\"LOG\":{\"flush time\":50,\"log level\":\"" << level << "\",\"log method\":\"console\",\"log path\":\"\"}}";
+    return path.string();
+}
+
+void test_watch_config_twice()
+{
+    Log::Logger& log = Log::Logger::getInstance();
+    const std::string first = write_config("logger_test_first.json", "info");
+    const std::string second = write_config("logger_test_second.json", "warning");
+    CHECK(log.watchConfig(first));
+    CHECK(log.watchConfig(second));
+    CHECK(log.getConfig()->_logLevel == Log::LogLevel::WARNING);
+    log.stopWatchConfig();
+}
+
+void test_watch_config_concurrently()
+{
+    Log::Logger& log = Log::Logger::getInstance();
+    const std::string path = write_config("logger_test_concurrent.json", "info");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&log, &path]() {
+            for (int i = 0; i < 10; ++i)
+            {
+                CHECK(log.watchConfig(path));
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    log.stopWatchConfig();
+    CHECK(log.getConfig()->_logLevel == Log::LogLevel::INFO);
+}
+
+int main()
+{
+    run_test("watch_config_twice", test_watch_config_twice);
+    run_test("watch_config_concurrently", test_watch_config_concurrently);
+    return 0;
+}
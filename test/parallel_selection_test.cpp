@@ -0,0 +1,202 @@
+/*
+ * Behaviour tests for parallel_nth_element, parallel_top_k and parallel_partial_sort, checked
+ * against the std:: algorithms on random, duplicate-heavy, constant and presorted input.
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check.
+ */
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "test_harness.hpp"
+#include "my_algorithm.hpp"
+
+enum class Shape
+{
+    RANDOM,
+    FEW_VALUES,
+    CONSTANT,
+    DESCENDING
+};
+
+std::vector<long> make_input(size_t n, Shape shape, std::mt19937_64& rng)
+{
+    std::vector<long> v(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        switch (shape)
+        {
+        case Shape::RANDOM:
+            v[i] = static_cast<long>(rng() % 1000000000);
+            break;
+        case Shape::FEW_VALUES:
+            v[i] = static_cast<long>(rng() % 3);
+            break;
+        case Shape::CONSTANT:
+            v[i] = 42;
+            break;
+        case Shape::DESCENDING:
+            v[i] = static_cast<long>(n - i);
+            break;
+        }
+    }
+    return v;
+}
+
+/*Sizes on both sides of MIN_SELECT_PER_THREAD, so the serial and the threaded paths both run*/
+const size_t SIZES[] = { 0, 1, 5, 1000, 100000, 300007 };
+const Shape SHAPES[] = { Shape::RANDOM, Shape::FEW_VALUES, Shape::CONSTANT, Shape::DESCENDING };
+
+std::vector<size_t> ranks_for(size_t n)
+{
+    return { 0, 1, 100, n / 3, n / 2, n > 0 ? n - 1 : 0, n };
+}
+
+void test_nth_element_matches_std()
+{
+    std::mt19937_64 rng(1);
+    for (size_t n : SIZES)
+    {
+        for (Shape shape : SHAPES)
+        {
+            std::vector<long> input = make_input(n, shape, rng);
+            std::vector<long> sorted = input;
+            std::sort(sorted.begin(), sorted.end());
+            for (size_t k : ranks_for(n))
+            {
+                if (k >= n)
+                {
+                    continue;
+                }
+                std::vector<long> v = input;
+                parallel_nth_element(v.begin(), v.begin() + k, v.end(), std::less<>(), 4);
+                CHECK(v[k] == sorted[k]);
+                CHECK(std::all_of(v.begin(), v.begin() + k, [&](long x) { return x <= v[k]; }));
+                CHECK(std::all_of(v.begin() + k, v.end(), [&](long x) { return x >= v[k]; }));
+                std::sort(v.begin(), v.end());
+                CHECK(v == sorted);
+            }
+        }
+    }
+}
+
+void test_top_k_matches_std()
+{
+    std::mt19937_64 rng(2);
+    for (size_t n : SIZES)
+    {
+        for (Shape shape : SHAPES)
+        {
+            std::vector<long> input = make_input(n, shape, rng);
+            std::vector<long> sorted = input;
+            std::sort(sorted.begin(), sorted.end());
+            for (size_t k : ranks_for(n))
+            {
+                std::vector<long> smallest = parallel_top_k(input.begin(), input.end(), k, std::less<>(), 4);
+                CHECK(smallest.size() == std::min(k, n));
+                CHECK(std::equal(smallest.begin(), smallest.end(), sorted.begin()));
+                std::vector<long> largest = parallel_top_k(input.begin(), input.end(), k, std::greater<>(), 4);
+                CHECK(largest.size() == std::min(k, n));
+                CHECK(std::equal(largest.begin(), largest.end(), sorted.rbegin()));
+            }
+        }
+    }
+}
+
+void test_partial_sort_matches_std()
+{
+    std::mt19937_64 rng(3);
+    for (size_t n : SIZES)
+    {
+        for (Shape shape : SHAPES)
+        {
+            std::vector<long> input = make_input(n, shape, rng);
+            std::vector<long> sorted = input;
+            std::sort(sorted.begin(), sorted.end());
+            for (size_t k : ranks_for(n))
+            {
+                if (k > n)
+                {
+                    continue;
+                }
+                std::vector<long> v = input;
+                parallel_partial_sort(v.begin(), v.begin() + k, v.end(), std::less<>(), 4);
+                CHECK(std::equal(v.begin(), v.begin() + k, sorted.begin()));
+                std::sort(v.begin(), v.end());
+                CHECK(v == sorted);
+            }
+        }
+    }
+}
+
+/*More than 8 blocks with block 0 shorter than blocks * k: the winners still gather without clobbering*/
+void test_partial_sort_many_blocks()
+{
+    std::mt19937_64 rng(4);
+    const size_t n = 600000;
+    const size_t threads = 12;
+    for (Shape shape : SHAPES)
+    {
+        std::vector<long> input = make_input(n, shape, rng);
+        std::vector<long> sorted = input;
+        std::sort(sorted.begin(), sorted.end());
+        for (size_t k : { size_t(1), size_t(777), n / (threads * 8) })
+        {
+            std::vector<long> v = input;
+            parallel_partial_sort(v.begin(), v.begin() + k, v.end(), std::less<>(), threads);
+            CHECK(std::equal(v.begin(), v.begin() + k, sorted.begin()));
+            std::sort(v.begin(), v.end());
+            CHECK(v == sorted);
+        }
+    }
+}
+
+void test_non_trivial_elements()
+{
+    std::mt19937_64 rng(5);
+    std::vector<std::string> input;
+    for (int i = 0; i < 200000; ++i)
+    {
+        input.push_back(std::to_string(rng() % 100000));
+    }
+    std::vector<std::string> expected = input;
+    std::sort(expected.begin(), expected.end());
+    std::vector<std::string> top = parallel_top_k(input.begin(), input.end(), 10, std::less<>(), 3);
+    CHECK(std::equal(top.begin(), top.end(), expected.begin()));
+    std::vector<std::string> v = input;
+    parallel_nth_element(v.begin(), v.begin() + 77777, v.end(), std::less<>(), 3);
+    CHECK(v[77777] == expected[77777]);
+    v = input;
+    parallel_partial_sort(v.begin(), v.begin() + 500, v.end(), std::less<>(), 3);
+    CHECK(std::equal(v.begin(), v.begin() + 500, expected.begin()));
+}
+
+/*An exception from comp on a worker thread reaches the caller*/
+void test_comparator_exception_propagates()
+{
+    std::vector<int> v(200000, 1);
+    bool threw = false;
+    try
+    {
+        parallel_top_k(v.begin(), v.end(), 5, [](int, int) -> bool { throw std::runtime_error("compare failed"); }, 4);
+    }
+    catch (const std::runtime_error&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+int main()
+{
+    run_test("nth_element_matches_std", test_nth_element_matches_std);
+    run_test("top_k_matches_std", test_top_k_matches_std);
+    run_test("partial_sort_matches_std", test_partial_sort_matches_std);
+    run_test("partial_sort_many_blocks", test_partial_sort_many_blocks);
+    run_test("non_trivial_elements", test_non_trivial_elements);
+    run_test("comparator_exception_propagates", test_comparator_exception_propagates);
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * Behaviour tests for pipeline::engine on SimpleThreadPool: in-order stages behind parallel ones,
+ * the token bound, batching, end of stream, and a stage exception cancelling the run.
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check. Worth running under -fsanitize=thread as well.
+ */
+#include <atomic>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "test_harness.hpp"
+#include "simple_thread_pool.hpp"
+#include "pipeline.hpp"
+
+/*A source producing 0 .. count - 1; the source function is only ever called serially*/
+struct counting_source
+{
+    int _count;
+    int* _next;
+    int* _calls;
+
+    std::optional<int> operator()() const
+    {
+        ++*_calls;
+        if (*_next == _count)
+        {
+            return std::nullopt;
+        }
+        return (*_next)++;
+    }
+};
+
+void test_in_order_stage_after_parallel_stage()
+{
+    const int count = 5000;
+    const size_t tokens = 8;
+    SimpleThreadPool pool(4);
+    int next = 0;
+    int calls = 0;
+    std::atomic<int> live{ 0 };
+    std::atomic<int> maxLive{ 0 };
+    int expected = 0;
+    bool ordered = true;
+    long long sum = 0;
+    auto p = pipeline::source(counting_source{ count, &next, &calls })
+        .then(pipeline::parallel(), [&](int v) {
+            int now = ++live;
+            int seen = maxLive.load();
+            while (now > seen && !maxLive.compare_exchange_weak(seen, now))
+            {
+            }
+            /*uneven work so items overtake each other in the parallel stage*/
+            if (v % 7 == 0)
+            {
+                std::this_thread::yield();
+            }
+            return v;
+        })
+        .then(pipeline::serial_in_order(), [&](int v) {
+            --live;
+            ordered = ordered && v == expected;
+            ++expected;
+            return std::to_string(v);
+        })
+        .sink(pipeline::serial_out_of_order(), [&](std::string s) { sum += std::stoll(s); });
+    p.run(pool, tokens);
+    CHECK(ordered);
+    CHECK(expected == count);
+    CHECK(sum == static_cast<long long>(count) * (count - 1) / 2);
+    CHECK(maxLive.load() <= static_cast<int>(tokens));
+    /*end of stream: the source is not called again once it returned nullopt*/
+    CHECK(calls == count + 1);
+
+    /*an engine runs again once a run has returned*/
+    next = 0;
+    calls = 0;
+    expected = 0;
+    sum = 0;
+    p.run(pool, 1);
+    CHECK(ordered);
+    CHECK(expected == count);
+    CHECK(sum == static_cast<long long>(count) * (count - 1) / 2);
+}
+
+/*Fewer tokens than the batch size must not stall: the batch stage does not hold tokens back*/
+void test_batches_keep_source_order()
+{
+    const int count = 1000;
+    SimpleThreadPool pool(3);
+    int next = 0;
+    int calls = 0;
+    int seen = 0;
+    int batches = 0;
+    bool ok = true;
+    auto p = pipeline::source(counting_source{ count, &next, &calls })
+        .then(pipeline::parallel(2), [](int v) { return v; })
+        .batch(7)
+        .sink(pipeline::serial_in_order(), [&](std::vector<int> batch) {
+            ++batches;
+            ok = ok && !batch.empty() && (batch.size() == 7 || seen + static_cast<int>(batch.size()) == count);
+            for (int v : batch)
+            {
+                ok = ok && v == seen;
+                ++seen;
+            }
+        });
+    p.run(pool, 4);
+    CHECK(ok);
+    CHECK(seen == count);
+    CHECK(batches == (count + 6) / 7);
+}
+
+void test_empty_source()
+{
+    SimpleThreadPool pool(2);
+    bool called = false;
+    auto p = pipeline::source([]() -> std::optional<int> { return std::nullopt; })
+        .then(pipeline::parallel(), [](int v) { return v; })
+        .batch(4)
+        .sink(pipeline::parallel(), [&called](std::vector<int>) { called = true; });
+    p.run(pool, 4);
+    CHECK(!called);
+}
+
+/*The first exception ends the run early: the source stops pulling and run() rethrows it*/
+void test_exception_cancels_run()
+{
+    const int count = 100000;
+    SimpleThreadPool pool(3);
+    int next = 0;
+    int calls = 0;
+    std::atomic<int> sunk{ 0 };
+    auto p = pipeline::source(counting_source{ count, &next, &calls })
+        .then(pipeline::parallel(3), [](int v) {
+            if (v == 100)
+            {
+                throw std::runtime_error("stage failed");
+            }
+            return v;
+        })
+        .then(pipeline::serial_in_order(), [](int v) { return v; })
+        .batch(10)
+        .sink(pipeline::parallel(), [&sunk](std::vector<int> batch) { sunk += static_cast<int>(batch.size()); });
+    bool threw = false;
+    try
+    {
+        p.run(pool, 16);
+    }
+    catch (const std::runtime_error& e)
+    {
+        threw = std::string(e.what()) == "stage failed";
+    }
+    CHECK(threw);
+    CHECK(next < count);
+    /*the in-order stage never gets past the missing item*/
+    CHECK(sunk.load() <= 100);
+
+    /*the failure does not stick to the engine*/
+    bool reran = true;
+    next = 100000;
+    try
+    {
+        p.run(pool, 16);
+    }
+    catch (...)
+    {
+        reran = false;
+    }
+    CHECK(reran);
+}
+
+void test_source_exception_cancels_run()
+{
+    SimpleThreadPool pool(2);
+    int next = 0;
+    auto p = pipeline::source([&next]() -> std::optional<int> {
+            if (next == 50)
+            {
+                throw std::logic_error("source failed");
+            }
+            return next++;
+        })
+        .sink(pipeline::serial_in_order(), [](int) {});
+    bool threw = false;
+    try
+    {
+        p.run(pool, 4);
+    }
+    catch (const std::logic_error&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(next == 50);
+}
+
+/*On a stopped pool every task is refused, so the whole run happens inline on the caller*/
+void test_run_on_stopped_pool()
+{
+    SimpleThreadPool pool(1);
+    pool.drain();
+    int next = 0;
+    int calls = 0;
+    long long sum = 0;
+    auto p = pipeline::source(counting_source{ 100, &next, &calls })
+        .then(pipeline::parallel(), [](int v) { return v * 2; })
+        .sink(pipeline::serial_in_order(), [&sum](int v) { sum += v; });
+    p.run(pool, 8);
+    CHECK(sum == 9900);
+}
+
+int main()
+{
+    run_test("in_order_stage_after_parallel_stage", test_in_order_stage_after_parallel_stage);
+    run_test("batches_keep_source_order", test_batches_keep_source_order);
+    run_test("empty_source", test_empty_source);
+    run_test("exception_cancels_run", test_exception_cancels_run);
+    run_test("source_exception_cancels_run", test_source_exception_cancels_run);
+    run_test("run_on_stopped_pool", test_run_on_stopped_pool);
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * Behaviour tests for pool_task_queue scheduling: priority order, aging of waiting tasks, deadlines
+ * and the earliest-deadline-first policy, plus the same order seen through SimpleThreadPool.
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check.
+ */
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "test_harness.hpp"
+#include "simple_thread_pool.hpp"
+#include "pool_task_queue.hpp"
+
+using threadsafe_container::pool_task_queue;
+using threadsafe_container::SchedulingOptions;
+using threadsafe_container::SchedulingPolicy;
+using threadsafe_container::TaskPriority;
+
+using Clock = std::chrono::steady_clock;
+
+/*Pops and runs everything queued, in the order the queue hands it out*/
+void run_all(pool_task_queue& queue)
+{
+    pool_task_queue::Task task;
+    while (queue.try_pop(task))
+    {
+        task();
+    }
+}
+
+std::function<void()> record(std::vector<int>& order, int value)
+{
+    return [&order, value]() { order.push_back(value); };
+}
+
+SchedulingOptions without_aging()
+{
+    SchedulingOptions options;
+    options._agingThreshold = std::chrono::microseconds(0);
+    return options;
+}
+
+void test_levels_pop_in_priority_order()
+{
+    pool_task_queue queue(without_aging());
+    std::vector<int> order;
+    queue.push(record(order, 5), TaskPriority::LOW);
+    queue.push(record(order, 3), TaskPriority::NORMAL);
+    queue.push(record(order, 1), TaskPriority::HIGH);
+    queue.push(record(order, 6), TaskPriority::LOW);
+    queue.push(record(order, 4), TaskPriority::NORMAL);
+    queue.push(record(order, 2), TaskPriority::HIGH);
+    run_all(queue);
+    CHECK((order == std::vector<int>{ 1, 2, 3, 4, 5, 6 }));
+}
+
+void test_deadlines_run_ahead_earliest_first()
+{
+    pool_task_queue queue(without_aging());
+    std::vector<int> order;
+    Clock::time_point now = Clock::now();
+    queue.push(record(order, 4), TaskPriority::HIGH);
+    queue.push(record(order, 3), now + std::chrono::seconds(2));
+    queue.push(record(order, 1), now + std::chrono::seconds(1));
+    queue.push(record(order, 2), now + std::chrono::seconds(1));
+    run_all(queue);
+    CHECK((order == std::vector<int>{ 1, 2, 3, 4 }));
+}
+
+/*LOW is level 2: three thresholds of waiting put it ahead of a fresh HIGH task; short of one it stays behind*/
+void test_aging_promotes_waiting_low_task()
+{
+    SchedulingOptions options;
+    options._agingThreshold = std::chrono::milliseconds(20);
+    pool_task_queue queue(options);
+    std::vector<int> order;
+    queue.push(record(order, 1), TaskPriority::LOW);
+    std::this_thread::sleep_for(std::chrono::milliseconds(70));
+    queue.push(record(order, 2), TaskPriority::HIGH);
+    run_all(queue);
+    CHECK((order == std::vector<int>{ 1, 2 }));
+
+    options._agingThreshold = std::chrono::seconds(10);
+    pool_task_queue slowAging(options);
+    order.clear();
+    slowAging.push(record(order, 2), TaskPriority::LOW);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    slowAging.push(record(order, 1), TaskPriority::HIGH);
+    run_all(slowAging);
+    CHECK((order == std::vector<int>{ 1, 2 }));
+}
+
+/*Each level's implicit deadline is enqueue time + its budget, so order follows the deadlines*/
+void test_edf_orders_by_latency_budget()
+{
+    SchedulingOptions options;
+    options._policy = SchedulingPolicy::EARLIEST_DEADLINE_FIRST;
+    options._latencyBudget = { { std::chrono::milliseconds(1), std::chrono::milliseconds(20), std::chrono::milliseconds(200) } };
+    pool_task_queue queue(options);
+    std::vector<int> order;
+    queue.push(record(order, 3), TaskPriority::LOW);
+    queue.push(record(order, 2), TaskPriority::NORMAL);
+    queue.push(record(order, 1), TaskPriority::HIGH);
+    run_all(queue);
+    CHECK((order == std::vector<int>{ 1, 2, 3 }));
+
+    /*a NORMAL task whose deadline is already near beats a fresh HIGH one*/
+    order.clear();
+    queue.push(record(order, 1), TaskPriority::NORMAL);
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    queue.push(record(order, 2), TaskPriority::HIGH);
+    queue.push(record(order, 0), Clock::now() - std::chrono::seconds(1));
+    run_all(queue);
+    CHECK((order == std::vector<int>{ 0, 1, 2 }));
+}
+
+void test_pool_runs_in_priority_order()
+{
+    SimpleThreadPool pool(1, without_aging());
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::promise<void> started;
+    pool.post([&started, opened]() {
+        started.set_value();
+        opened.wait();
+    });
+    started.get_future().wait();
+    std::mutex m;
+    std::vector<int> order;
+    auto rec = [&m, &order](int value) {
+        std::lock_guard<std::mutex> lock(m);
+        order.push_back(value);
+    };
+    pool.enqueue(TaskPriority::LOW, rec, 4);
+    pool.enqueue(TaskPriority::NORMAL, rec, 3);
+    pool.enqueue(TaskPriority::HIGH, rec, 2);
+    pool.enqueue(Clock::now() + std::chrono::seconds(1), rec, 1);
+    gate.set_value();
+    pool.drain();
+    CHECK((order == std::vector<int>{ 1, 2, 3, 4 }));
+}
+
+int main()
+{
+    run_test("levels_pop_in_priority_order", test_levels_pop_in_priority_order);
+    run_test("deadlines_run_ahead_earliest_first", test_deadlines_run_ahead_earliest_first);
+    run_test("aging_promotes_waiting_low_task", test_aging_promotes_waiting_low_task);
+    run_test("edf_orders_by_latency_budget", test_edf_orders_by_latency_budget);
+    run_test("pool_runs_in_priority_order", test_pool_runs_in_priority_order);
+    return 0;
+}
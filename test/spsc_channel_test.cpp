@@ -0,0 +1,180 @@
+/*
+ * Behaviour tests for spsc_channel: FIFO order across ring wraparound, staging, and futex wakeups
+ * of a parked producer or consumer.
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check. Worth running under -fsanitize=thread as well.
+ */
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "test_harness.hpp"
+#include "spsc_channel.hpp"
+
+using threadsafe_container::spsc_channel;
+using threadsafe_container::spsc_wait;
+
+void test_fifo_under_wraparound()
+{
+    spsc_channel<int> channel(5);
+    CHECK(channel.capacity() == 8);
+    int next = 0;
+    int expected = 0;
+    /*uneven push/pop counts walk the indices through the ring many times over*/
+    for (int round = 0; round < 1000; ++round)
+    {
+        for (int i = 0; i < 1 + round % 7 && next - expected < 8; ++i)
+        {
+            CHECK(channel.try_push(next));
+            ++next;
+        }
+        for (int i = 0; i < 1 + (round * 5) % 6; ++i)
+        {
+            int value;
+            if (!channel.try_pop(value))
+            {
+                break;
+            }
+            CHECK(value == expected);
+            ++expected;
+        }
+    }
+    std::vector<int> rest(8);
+    size_t count = channel.try_pop_batch(rest.begin(), rest.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        CHECK(rest[i] == expected);
+        ++expected;
+    }
+    CHECK(expected == next);
+    CHECK(channel.empty());
+}
+
+void test_full_ring_rejects_push()
+{
+    spsc_channel<int> channel(4);
+    for (int i = 0; i < 4; ++i)
+    {
+        CHECK(channel.try_push(i));
+    }
+    CHECK(!channel.try_push(4));
+    int value;
+    CHECK(channel.try_pop(value) && value == 0);
+    CHECK(channel.try_push(4));
+    for (int i = 1; i <= 4; ++i)
+    {
+        CHECK(channel.try_pop(value) && value == i);
+    }
+    CHECK(!channel.try_pop(value));
+}
+
+void test_staged_items_wait_for_publish()
+{
+    spsc_channel<int> channel(8);
+    for (int i = 0; i < 3; ++i)
+    {
+        int value = i;
+        CHECK(channel.try_stage(value));
+    }
+    int value;
+    CHECK(!channel.try_pop(value));
+    channel.publish();
+    for (int i = 0; i < 3; ++i)
+    {
+        CHECK(channel.try_pop(value) && value == i);
+    }
+}
+
+void test_destructor_releases_unpopped_items()
+{
+    auto item = std::make_shared<int>(1);
+    {
+        spsc_channel<std::shared_ptr<int>> channel(4);
+        channel.push(item);
+        channel.push(item);
+        std::shared_ptr<int> staged = item;
+        CHECK(channel.try_stage(staged));
+        CHECK(item.use_count() == 4);
+    }
+    CHECK(item.use_count() == 1);
+}
+
+/*A tiny ring keeps both sides going through full/empty, and so through the futex waits*/
+void check_ordered_stream(spsc_wait mode)
+{
+    const int count = 200000;
+    spsc_channel<int> channel(2, mode);
+    std::thread producer([&]() {
+        for (int i = 0; i < count; ++i)
+        {
+            channel.push(i);
+        }
+    });
+    bool ordered = true;
+    for (int i = 0; i < count; ++i)
+    {
+        int value;
+        channel.wait_and_pop(value);
+        ordered = ordered && value == i;
+    }
+    producer.join();
+    CHECK(ordered);
+    CHECK(channel.empty());
+}
+
+void test_ordered_stream_between_threads()
+{
+    check_ordered_stream(spsc_wait::BLOCK);
+    check_ordered_stream(spsc_wait::SPIN);
+}
+
+/*The sleeps outlast the spin phase, so the waiting side is parked on the futex when woken*/
+void test_parked_consumer_wakes_on_push()
+{
+    spsc_channel<int> channel(4, spsc_wait::BLOCK);
+    std::atomic<int> received{ -1 };
+    std::thread consumer([&]() {
+        int value;
+        channel.wait_and_pop(value);
+        received = value;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(received.load() == -1);
+    channel.push(7);
+    consumer.join();
+    CHECK(received.load() == 7);
+}
+
+void test_parked_producer_wakes_on_pop()
+{
+    spsc_channel<int> channel(2, spsc_wait::BLOCK);
+    channel.push(0);
+    channel.push(1);
+    std::atomic<bool> pushed{ false };
+    std::thread producer([&]() {
+        channel.push(2);
+        pushed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(!pushed.load());
+    int value;
+    CHECK(channel.try_pop(value) && value == 0);
+    producer.join();
+    CHECK(pushed.load());
+    CHECK(channel.try_pop(value) && value == 1);
+    CHECK(channel.try_pop(value) && value == 2);
+}
+
+int main()
+{
+    run_test("fifo_under_wraparound", test_fifo_under_wraparound);
+    run_test("full_ring_rejects_push", test_full_ring_rejects_push);
+    run_test("staged_items_wait_for_publish", test_staged_items_wait_for_publish);
+    run_test("destructor_releases_unpopped_items", test_destructor_releases_unpopped_items);
+    run_test("ordered_stream_between_threads", test_ordered_stream_between_threads);
+    run_test("parked_consumer_wakes_on_push", test_parked_consumer_wakes_on_push);
+    run_test("parked_producer_wakes_on_pop", test_parked_producer_wakes_on_pop);
+    return 0;
+}
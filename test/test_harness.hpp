@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef __TEST_HARNESS_H__
+#define __TEST_HARNESS_H__
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+
+/*
+ * Minimal support for the behaviour tests: CHECK aborts on the first failure (also under NDEBUG),
+ * so a test binary exits non-zero and the failing line is on stderr.
+ */
+#define CHECK(cond) \
+    do \
+    { \
+        if (!(cond)) \
+        { \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            std::abort(); \
+        } \
+    } while (false)
+
+inline void run_test(const char* name, const std::function<void()>& test)
+{
+    test();
+    std::printf("ok %s\n", name);
+    std::fflush(stdout);
+}
+
+/*Polls pred until it holds or timeout passes; for outcomes that arrive on other threads*/
+template<class Pred>
+bool wait_until(Pred pred, std::chrono::milliseconds timeout = std::chrono::milliseconds(10000))
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pred())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+#endif //!__TEST_HARNESS_H__
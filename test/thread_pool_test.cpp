@@ -0,0 +1,279 @@
+/*
+ * Behaviour tests for SimpleThreadPool and the actors running on it.
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check. Worth running under -fsanitize=thread as well.
+ */
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "test_harness.hpp"
+#include "simple_thread_pool.hpp"
+#include "actor.hpp"
+
+struct Tick
+{
+    int _value;
+};
+
+void test_throwing_task_keeps_worker()
+{
+    std::atomic<int> errors{ 0 };
+    std::atomic<int> ran{ 0 };
+    SimpleThreadPool::Options options;
+    options._onTaskError = [&errors](std::exception_ptr error) {
+        try
+        {
+            std::rethrow_exception(error);
+        }
+        catch (const std::runtime_error&)
+        {
+            errors.fetch_add(1);
+        }
+    };
+    SimpleThreadPool pool(options);
+    for (int i = 0; i < 100; ++i)
+    {
+        pool.post([&ran, i]() {
+            ran.fetch_add(1);
+            if (i % 2 == 0)
+            {
+                throw std::runtime_error("task " + std::to_string(i));
+            }
+        });
+    }
+    pool.drain();
+    CHECK(ran.load() == 100);
+    CHECK(errors.load() == 50);
+}
+
+void test_throwing_handler_keeps_actor()
+{
+    std::atomic<int> errors{ 0 };
+    std::atomic<int> handled{ 0 };
+    SimpleThreadPool::Options options;
+    options._onTaskError = [&errors](std::exception_ptr) { errors.fetch_add(1); };
+    SimpleThreadPool pool(options);
+    auto actor = messaging::spawn<messaging::actor>(pool, 4);
+    actor->handle<Tick>([&handled](Tick& tick) {
+        handled.fetch_add(1);
+        if (tick._value % 10 == 0)
+        {
+            throw std::logic_error("bad tick");
+        }
+    });
+    for (int i = 0; i < 1000; ++i)
+    {
+        actor->send(Tick{ i });
+    }
+    CHECK(wait_until([&]() { return handled.load() == 1000; }));
+    CHECK(wait_until([&]() { return actor->pending() == 0; }));
+    pool.drain();
+    CHECK(errors.load() == 100);
+}
+
+void test_destroy_pool_with_busy_actor()
+{
+    std::atomic<int> handled{ 0 };
+    std::shared_ptr<messaging::actor> actor;
+    {
+        SimpleThreadPool pool(1);
+        actor = messaging::spawn<messaging::actor>(pool, 4);
+        actor->handle<Tick>([&handled](Tick&) { handled.fetch_add(1); });
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        pool.post([opened]() { opened.wait(); });
+        for (int i = 0; i < 1000; ++i)
+        {
+            actor->send(Tick{ i });
+        }
+        gate.set_value();
+        /*the destructor drains while the actor still reschedules itself every 4 messages*/
+    }
+    CHECK(handled.load() == 1000);
+    CHECK(actor->pending() == 0);
+}
+
+/*Tasks keep posting follow-ups while drain() runs; all of them must run before it returns*/
+void check_follow_ups_run_during_drain(SimpleThreadPool& pool)
+{
+    std::atomic<int> ran{ 0 };
+    std::function<void(int)> chain = [&](int left) {
+        ran.fetch_add(1);
+        if (left > 0)
+        {
+            pool.post([&chain, left]() { chain(left - 1); });
+        }
+    };
+    for (int i = 0; i < 4; ++i)
+    {
+        pool.post([&chain]() { chain(99); });
+    }
+    pool.drain();
+    CHECK(ran.load() == 400);
+    bool threw = false;
+    try
+    {
+        pool.post([]() {});
+    }
+    catch (const std::runtime_error&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+/*
+ * Per-node queues, one worker per node. Two tasks queued back to back on one node while its worker
+ * is parked: that worker takes the first, and the other worker is not kicked, so drain() wakes it
+ * straight into stealing the second. That one posts its follow-up, onto the thief's own queue, only
+ * after the first worker has exited.
+ */
+void check_follow_up_of_stolen_task()
+{
+    SimpleThreadPool::Options options;
+    options._minThreads = 2;
+    options._maxThreads = 2;
+    options._perNodeQueues = true;
+    options._topology = threadsafe_container::cpu_topology::emulate(2, 1);
+    SimpleThreadPool pool(options);
+    /*both workers parked*/
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::atomic<bool> followUpRan{ false };
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    pool.post([opened]() { opened.wait(); });
+    pool.post([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        pool.post([&followUpRan]() { followUpRan = true; });
+    });
+    std::thread drainer([&pool]() { pool.drain(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    gate.set_value();
+    drainer.join();
+    CHECK(followUpRan.load());
+}
+
+void test_follow_ups_run_during_drain()
+{
+    {
+        SimpleThreadPool pool(2);
+        check_follow_ups_run_during_drain(pool);
+    }
+    {
+        SimpleThreadPool::Options options;
+        options._minThreads = 2;
+        options._maxThreads = 2;
+        options._perNodeQueues = true;
+        options._topology = threadsafe_container::cpu_topology::emulate(2, 1);
+        SimpleThreadPool pool(options);
+        check_follow_ups_run_during_drain(pool);
+    }
+    for (int round = 0; round < 5; ++round)
+    {
+        check_follow_up_of_stolen_task();
+    }
+}
+
+void test_send_to_actor_on_stopped_pool()
+{
+    SimpleThreadPool pool(1);
+    auto actor = messaging::spawn<messaging::actor>(pool);
+    actor->handle<Tick>([](Tick&) {});
+    pool.drain();
+    actor->send(Tick{ 1 });
+    actor->send(Tick{ 2 });
+    CHECK(actor->pending() == 2);
+}
+
+void test_drain_runs_queued_tasks()
+{
+    std::atomic<int> ran{ 0 };
+    SimpleThreadPool pool(2);
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    for (int i = 0; i < 2; ++i)
+    {
+        pool.post([opened]() { opened.wait(); });
+    }
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 100; ++i)
+    {
+        results.push_back(pool.enqueue([&ran, i]() { ran.fetch_add(1); return i; }));
+    }
+    std::thread drainer([&pool]() { pool.drain(); });
+    gate.set_value();
+    drainer.join();
+    CHECK(ran.load() == 100);
+    for (int i = 0; i < 100; ++i)
+    {
+        CHECK(results[i].get() == i);
+    }
+}
+
+void test_shutdown_now_discards_queued_tasks()
+{
+    std::atomic<int> ran{ 0 };
+    std::atomic<bool> followUpRefused{ false };
+    SimpleThreadPool pool(1);
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::future<void> running = pool.enqueue([&, opened]() {
+        opened.wait();
+        try
+        {
+            pool.post([&ran]() { ran.fetch_add(1); });
+        }
+        catch (const std::runtime_error&)
+        {
+            followUpRefused = true;
+        }
+    });
+    std::vector<std::future<void>> queued;
+    for (int i = 0; i < 100; ++i)
+    {
+        queued.push_back(pool.enqueue([&ran]() { ran.fetch_add(1); }));
+    }
+    size_t discarded = 0;
+    std::thread stopper([&]() { discarded = pool.shutdown_now(); });
+    /*the queued futures break as soon as shutdown_now has cleared the queue; only then let the running task go*/
+    CHECK(wait_until([&]() { return queued.back().wait_for(std::chrono::seconds(0)) == std::future_status::ready; }));
+    gate.set_value();
+    stopper.join();
+    running.get();
+    CHECK(discarded == 100);
+    CHECK(ran.load() == 0);
+    CHECK(followUpRefused.load());
+    for (auto& result : queued)
+    {
+        bool broken = false;
+        try
+        {
+            result.get();
+        }
+        catch (const std::future_error& e)
+        {
+            broken = e.code() == std::future_errc::broken_promise;
+        }
+        CHECK(broken);
+    }
+}
+
+int main()
+{
+    run_test("throwing_task_keeps_worker", test_throwing_task_keeps_worker);
+    run_test("throwing_handler_keeps_actor", test_throwing_handler_keeps_actor);
+    run_test("destroy_pool_with_busy_actor", test_destroy_pool_with_busy_actor);
+    run_test("follow_ups_run_during_drain", test_follow_ups_run_during_drain);
+    run_test("send_to_actor_on_stopped_pool", test_send_to_actor_on_stopped_pool);
+    run_test("drain_runs_queued_tasks", test_drain_runs_queued_tasks);
+    run_test("shutdown_now_discards_queued_tasks", test_shutdown_now_discards_queued_tasks);
+    return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * Behaviour tests for threadsafe_map, above all growth while other threads read and write.
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check. Worth running under -fsanitize=thread and
+ * -fsanitize=address as well.
+ */
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "test_harness.hpp"
+#include "threadsafe_map.hpp"
+
+using threadsafe_container::threadsafe_map;
+
+const int WRITERS = 2;
+const int READERS = 2;
+const int KEYS_PER_WRITER = 30000;
+
+/*
+ * Writers fill a map that starts at the smallest table, so it grows a dozen times under them.
+ * Every key a writer has published must stay visible to readers throughout, and the walks must
+ * never see a key twice.
+ */
+void test_grow_while_reading()
+{
+    threadsafe_map<int, int> map;
+    std::vector<std::atomic<int>> published(WRITERS);
+    std::atomic<int> writersLeft{ WRITERS };
+    std::vector<std::thread> threads;
+    for (int w = 0; w < WRITERS; ++w)
+    {
+        threads.emplace_back([&, w]() {
+            for (int i = 0; i < KEYS_PER_WRITER; ++i)
+            {
+                const int key = i * WRITERS + w;
+                map.addPair(key, -key);
+                published[w].store(i + 1, std::memory_order_release);
+            }
+            writersLeft.fetch_sub(1);
+        });
+    }
+    for (int r = 0; r < READERS; ++r)
+    {
+        threads.emplace_back([&, r]() {
+            int round = 0;
+            while (writersLeft.load() != 0)
+            {
+                const int w = round % WRITERS;
+                const int seen = published[w].load(std::memory_order_acquire);
+                if (seen > 0)
+                {
+                    const int key = (round * 7919 % seen) * WRITERS + w;
+                    CHECK(map.getValue(key, 1) == -key);
+                    std::vector<int> batch;
+                    for (int i = std::max(0, seen - 16); i < seen; ++i)
+                    {
+                        batch.push_back(i * WRITERS + w);
+                    }
+                    std::vector<int> values = map.multi_get(batch, 1);
+                    for (size_t i = 0; i < batch.size(); ++i)
+                    {
+                        CHECK(values[i] == -batch[i]);
+                    }
+                }
+                if (r == 0 && round % 64 == 0)
+                {
+                    std::unordered_set<int> keys;
+                    map.for_each([&keys](const int& key, const int& value) {
+                        CHECK(value == -key);
+                        CHECK(keys.insert(key).second);
+                    });
+                }
+                if (r == 1 && round % 64 == 0)
+                {
+                    auto entries = map.snapshot();
+                    std::unordered_set<int> keys;
+                    for (const auto& entry : entries)
+                    {
+                        CHECK(keys.insert(entry.first).second);
+                    }
+                }
+                ++round;
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    CHECK(map.size() == static_cast<size_t>(WRITERS * KEYS_PER_WRITER));
+    auto entries = map.snapshot();
+    CHECK(entries.size() == map.size());
+    for (int key = 0; key < WRITERS * KEYS_PER_WRITER; ++key)
+    {
+        CHECK(map.getValue(key, 1) == -key);
+    }
+}
+
+/*Removals racing with growth must neither lose other keys nor leave removed ones behind*/
+void test_grow_while_removing()
+{
+    threadsafe_map<int, int> map;
+    std::vector<std::thread> threads;
+    for (int w = 0; w < WRITERS; ++w)
+    {
+        threads.emplace_back([&, w]() {
+            for (int i = 0; i < KEYS_PER_WRITER; ++i)
+            {
+                const int key = i * WRITERS + w;
+                map.addPair(key, key);
+                if (i % 2 == 1)
+                {
+                    map.removePair(key - WRITERS);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    CHECK(map.size() == static_cast<size_t>(WRITERS * KEYS_PER_WRITER / 2));
+    for (int key = 0; key < WRITERS * KEYS_PER_WRITER; ++key)
+    {
+        const bool kept = (key / WRITERS) % 2 == 1;
+        CHECK(map.getValue(key, -1) == (kept ? key : -1));
+    }
+}
+
+/*insert_bulk grows the table once up front while single inserts keep growing it too*/
+void test_insert_bulk_while_inserting()
+{
+    threadsafe_map<int, int> map;
+    std::vector<std::pair<int, int>> bulk;
+    for (int key = 0; key < KEYS_PER_WRITER; ++key)
+    {
+        bulk.emplace_back(2 * key, 2 * key);
+    }
+    std::thread single([&]() {
+        for (int key = 0; key < KEYS_PER_WRITER; ++key)
+        {
+            map.addPair(2 * key + 1, 2 * key + 1);
+        }
+    });
+    for (size_t begin = 0; begin < bulk.size(); begin += 1000)
+    {
+        map.insert_bulk(bulk.begin() + begin, bulk.begin() + std::min(bulk.size(), begin + 1000));
+    }
+    single.join();
+    CHECK(map.size() == static_cast<size_t>(2 * KEYS_PER_WRITER));
+    for (int key = 0; key < 2 * KEYS_PER_WRITER; ++key)
+    {
+        CHECK(map.getValue(key, -1) == key);
+    }
+}
+
+/*The threaded insert_bulk fills buckets in bucket order; duplicates in the input still end on the last value*/
+void test_insert_bulk_on_threads_keeps_last_duplicate()
+{
+    threadsafe_map<int, int> map;
+    std::vector<std::pair<int, int>> bulk;
+    for (int round = 0; round < 3; ++round)
+    {
+        for (int key = 0; key < KEYS_PER_WRITER; ++key)
+        {
+            bulk.emplace_back(key * 7919, round * KEYS_PER_WRITER + key);
+        }
+    }
+    map.insert_bulk(bulk.begin(), bulk.end(), size_t{ 4 });
+    CHECK(map.size() == static_cast<size_t>(KEYS_PER_WRITER));
+    for (int key = 0; key < KEYS_PER_WRITER; ++key)
+    {
+        CHECK(map.getValue(key * 7919, -1) == 2 * KEYS_PER_WRITER + key);
+    }
+}
+
+/*upsert counters and first-wins inserts while the map grows from its smallest table*/
+void test_upsert_and_emplace_while_growing()
+{
+    const int KEYS = 20000;
+    threadsafe_map<int, int> counts;
+    threadsafe_map<int, int> owners;
+    std::atomic<int> emplaced{ 0 };
+    std::vector<std::thread> threads;
+    for (int w = 0; w < WRITERS; ++w)
+    {
+        threads.emplace_back([&, w]() {
+            for (int key = 0; key < KEYS; ++key)
+            {
+                counts.upsert(key, [](int& count) { ++count; }, 1);
+                const bool mine = key % 2 == 0 ? owners.try_emplace(key, w) : owners.emplace(key, w);
+                if (mine)
+                {
+                    emplaced.fetch_add(1);
+                }
+                int owner = -1;
+                CHECK(owners.find_fn(key, [&owner](const int& value) { owner = value; }));
+                CHECK(owner >= 0 && owner < WRITERS);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    CHECK(counts.size() == static_cast<size_t>(KEYS));
+    CHECK(owners.size() == static_cast<size_t>(KEYS));
+    CHECK(emplaced.load() == KEYS);
+    for (int key = 0; key < KEYS; ++key)
+    {
+        CHECK(counts.getValue(key) == WRITERS);
+    }
+}
+
+int main()
+{
+    run_test("grow_while_reading", test_grow_while_reading);
+    run_test("grow_while_removing", test_grow_while_removing);
+    run_test("insert_bulk_while_inserting", test_insert_bulk_while_inserting);
+    run_test("insert_bulk_on_threads_keeps_last_duplicate", test_insert_bulk_on_threads_keeps_last_duplicate);
+    run_test("upsert_and_emplace_while_growing", test_upsert_and_emplace_while_growing);
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Behaviour tests for timer_wheel and SimpleThreadPool's schedule_* functions: due order, cascade
+ * from the coarse levels, cancel racing the fire, and periodic timers.
+ *
+ * Build with the same include directories as main.cpp (linked against boost_thread); the binary
+ * exits non-zero on the first failed check. Worth running under -fsanitize=thread as well.
+ */
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "test_harness.hpp"
+#include "simple_thread_pool.hpp"
+#include "timer_wheel.hpp"
+
+using threadsafe_container::timer_handle;
+using threadsafe_container::timer_wheel;
+
+using Clock = timer_wheel::Clock;
+
+/*Level 0 spans 256 ticks, so the 300ms and 600ms timers start on level 1 and have to cascade down*/
+void test_timers_fire_in_due_order_not_early()
+{
+    timer_wheel wheel;
+    std::mutex m;
+    std::vector<int> order;
+    std::vector<bool> early;
+    const int delays[] = { 600, 5, 300, 40, 120 };
+    Clock::time_point start = Clock::now();
+    for (int delay : delays)
+    {
+        Clock::time_point due = start + std::chrono::milliseconds(delay);
+        wheel.schedule_at(due, [&m, &order, &early, delay, due]() {
+            std::lock_guard<std::mutex> lock(m);
+            order.push_back(delay);
+            early.push_back(Clock::now() < due);
+        });
+    }
+    CHECK(wheel.pending() == 5);
+    CHECK(wait_until([&]() { return wheel.pending() == 0; }));
+    std::lock_guard<std::mutex> lock(m);
+    CHECK((order == std::vector<int>{ 5, 40, 120, 300, 600 }));
+    for (bool firedEarly : early)
+    {
+        CHECK(!firedEarly);
+    }
+}
+
+void test_cancel_pending_timer()
+{
+    timer_wheel wheel;
+    std::atomic<int> fired{ 0 };
+    timer_handle near = wheel.schedule_after(std::chrono::milliseconds(20), [&fired]() { fired += 1; });
+    timer_handle far = wheel.schedule_after(std::chrono::milliseconds(400), [&fired]() { fired += 100; });
+    CHECK(wheel.cancel(far));
+    CHECK(!wheel.cancel(far));
+    CHECK(wait_until([&]() { return fired.load() != 0; }));
+    /*already fired: nothing left to cancel*/
+    CHECK(!wheel.cancel(near));
+    std::this_thread::sleep_for(std::chrono::milliseconds(450));
+    CHECK(fired.load() == 1);
+    CHECK(wheel.pending() == 0);
+    CHECK(!wheel.cancel(timer_handle()));
+}
+
+/*A cancel that loses the race with the fire waits for the running callback to return*/
+void test_cancel_waits_for_running_callback()
+{
+    timer_wheel wheel;
+    std::atomic<bool> entered{ false };
+    std::atomic<bool> finished{ false };
+    timer_handle handle = wheel.schedule_after(std::chrono::milliseconds(1), [&]() {
+        entered = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        finished = true;
+    });
+    CHECK(wait_until([&]() { return entered.load(); }));
+    wheel.cancel(handle);
+    CHECK(finished.load());
+}
+
+void test_schedule_every_until_cancelled()
+{
+    timer_wheel wheel;
+    std::mutex m;
+    std::vector<Clock::time_point> runs;
+    Clock::time_point start = Clock::now();
+    timer_handle handle = wheel.schedule_every(std::chrono::milliseconds(10), [&]() {
+        std::lock_guard<std::mutex> lock(m);
+        runs.push_back(Clock::now());
+    });
+    CHECK(wait_until([&]() {
+        std::lock_guard<std::mutex> lock(m);
+        return runs.size() >= 10;
+    }));
+    CHECK(wheel.cancel(handle));
+    CHECK(!wheel.cancel(handle));
+    std::unique_lock<std::mutex> lock(m);
+    size_t count = runs.size();
+    /*runs stay on the start + k * period grid instead of drifting by each run's lateness*/
+    for (size_t i = 0; i < count; ++i)
+    {
+        CHECK(runs[i] >= start + std::chrono::milliseconds(10 * (i + 1)));
+    }
+    lock.unlock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    lock.lock();
+    CHECK(runs.size() == count);
+}
+
+/*A periodic callback may cancel its own timer without waiting on itself*/
+void test_periodic_timer_cancels_itself()
+{
+    timer_wheel wheel;
+    std::atomic<int> runs{ 0 };
+    timer_handle handle;
+    /*held until handle is assigned, so the callback never reads it half-written*/
+    std::mutex m;
+    std::unique_lock<std::mutex> scheduling(m);
+    handle = wheel.schedule_every(std::chrono::milliseconds(5), [&]() {
+        std::lock_guard<std::mutex> lock(m);
+        if (++runs == 3)
+        {
+            wheel.cancel(handle);
+        }
+    });
+    scheduling.unlock();
+    CHECK(wait_until([&]() { return wheel.pending() == 0; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    CHECK(runs.load() == 3);
+}
+
+void test_pool_timers()
+{
+    std::atomic<int> oneShot{ 0 };
+    std::atomic<int> periodic{ 0 };
+    std::atomic<int> cancelled{ 0 };
+    {
+        SimpleThreadPool pool(2);
+        pool.schedule_after(std::chrono::milliseconds(10), [&oneShot]() { ++oneShot; });
+        pool.schedule_at(SimpleThreadPool::Clock::now() + std::chrono::milliseconds(20), [&oneShot]() { ++oneShot; },
+            SimpleThreadPool::TaskPriority::HIGH);
+        SimpleThreadPool::TimerHandle every = pool.schedule_every(std::chrono::milliseconds(5), [&periodic]() { ++periodic; });
+        SimpleThreadPool::TimerHandle dropped = pool.schedule_after(std::chrono::milliseconds(30), [&cancelled]() { ++cancelled; });
+        CHECK(pool.cancel(dropped));
+        CHECK(wait_until([&]() { return oneShot.load() == 2 && periodic.load() >= 3; }));
+        CHECK(pool.cancel(every));
+        /*a timer still pending when the pool stops is dropped, not run*/
+        pool.schedule_after(std::chrono::milliseconds(100), [&cancelled]() { ++cancelled; });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    CHECK(oneShot.load() == 2);
+    CHECK(cancelled.load() == 0);
+}
+
+int main()
+{
+    run_test("timers_fire_in_due_order_not_early", test_timers_fire_in_due_order_not_early);
+    run_test("cancel_pending_timer", test_cancel_pending_timer);
+    run_test("cancel_waits_for_running_callback", test_cancel_waits_for_running_callback);
+    run_test("schedule_every_until_cancelled", test_schedule_every_until_cancelled);
+    run_test("periodic_timer_cancels_itself", test_periodic_timer_cancels_itself);
+    run_test("pool_timers", test_pool_timers);
+    return 0;
+}
@@ -0,0 +1,354 @@
+#pragma once
+
+#ifndef __CONCURRENT_CACHE_H__
+#define __CONCURRENT_CACHE_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "boost/thread/shared_mutex.hpp"
+#include "boost/thread/locks.hpp"
+#include "base_def.h"
+#include "container_metrics.hpp"
+
+THREADSAFT_CONTAINER_BEGIN
+
+struct cache_stats
+{
+    std::uint64_t _hits = 0;
+    std::uint64_t _misses = 0;
+    std::uint64_t _evictions = 0;
+    /*misses that waited for another thread's get_or_compute instead of computing themselves*/
+    std::uint64_t _coalesced = 0;
+    size_t _size = 0;
+};
+
+/*
+ * Capacity-bounded cache, sharded like threadsafe_map's buckets, with CLOCK eviction per shard.
+ * A hit takes only its shard's shared lock and sets the entry's reference bit; inserts and misses
+ * take the shard's exclusive lock and, when the shard is full, sweep the clock hand past referenced
+ * entries (clearing their bit) to the first unreferenced one and evict it.
+ *
+ * Capacity is split evenly between the shards, so an individual shard may evict while the cache as
+ * a whole still has room; with a reasonable hash this evens out.
+ */
+template<class Key, class Value, class Hash = std::hash<Key>>
+class concurrent_cache
+{
+private:
+    /*Shared by every caller missing on the same key while one of them computes it*/
+    struct inflight
+    {
+        std::mutex _m;
+        std::condition_variable _cv;
+        bool _done = false;
+        std::optional<Value> _value;
+        std::exception_ptr _error;
+        /*set under the shard lock by a put or erase of the key while it computes; its result is then not cached*/
+        bool _superseded = false;
+
+        void finish(std::optional<Value> value, std::exception_ptr error)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_m);
+                _value = std::move(value);
+                _error = error;
+                _done = true;
+            }
+            _cv.notify_all();
+        }
+
+        Value wait()
+        {
+            std::unique_lock<std::mutex> lock(_m);
+            _cv.wait(lock, [this]() { return _done; });
+            if (_error)
+            {
+                std::rethrow_exception(_error);
+            }
+            return *_value;
+        }
+    };
+
+    struct slot
+    {
+        const Key* _key = nullptr;
+        std::optional<Value> _value;
+        std::atomic<bool> _referenced{ false };
+    };
+
+    class shard
+    {
+    public:
+        shard(size_t capacity, const Hash& hashFun)
+            :_slots(new slot[capacity]), _capacity(capacity), _index(capacity, hashFun), _inflight(0, hashFun) {}
+
+        mutable boost::shared_mutex _rwm;
+        std::unique_ptr<slot[]> _slots;
+        const size_t _capacity;
+        size_t _used = 0;
+        size_t _hand = 0;
+        std::unordered_map<Key, size_t, Hash> _index;
+        std::unordered_map<Key, std::shared_ptr<inflight>, Hash> _inflight;
+    };
+
+public:
+    concurrent_cache(size_t capacity, size_t shards = 16, const Hash& hashFun = Hash())
+        :_hashFunc(hashFun)
+    {
+        shards = std::max<size_t>(1, std::min(shards, capacity));
+        const size_t perShard = std::max<size_t>(1, (capacity + shards - 1) / shards);
+        _shards.reserve(shards);
+        for (size_t i = 0; i < shards; ++i)
+        {
+            _shards.emplace_back(new shard(perShard, hashFun));
+        }
+    }
+
+    concurrent_cache(const concurrent_cache&) = delete;
+    concurrent_cache& operator=(const concurrent_cache&) = delete;
+
+    std::optional<Value> get(const Key& key)
+    {
+        std::optional<Value> value = lookup(key);
+        (value ? _hits : _misses).add();
+        return value;
+    }
+
+    /*Inserts or overwrites, evicting the shard's clock victim if it is full*/
+    void put(const Key& key, Value value)
+    {
+        shard& s = get_shard(key);
+        std::unique_lock<boost::shared_mutex> writeLock(s._rwm);
+        supersede_locked(s, key);
+        store_locked(s, key, std::move(value));
+    }
+
+    bool erase(const Key& key)
+    {
+        shard& s = get_shard(key);
+        std::unique_lock<boost::shared_mutex> writeLock(s._rwm);
+        supersede_locked(s, key);
+        auto entry = s._index.find(key);
+        if (entry == s._index.end())
+        {
+            return false;
+        }
+        /*the slot stays in the clock ring; an empty slot is the first thing the hand reuses*/
+        slot& freed = s._slots[entry->second];
+        freed._value.reset();
+        freed._key = nullptr;
+        freed._referenced.store(false, std::memory_order_relaxed);
+        s._index.erase(entry);
+        return true;
+    }
+
+    /*
+     * Returns the cached value, or calls compute() and caches what it returns. Concurrent misses on
+     * the same key wait for the first caller's computation rather than repeating it; if compute
+     * throws, every waiter gets the exception and nothing is cached. A put or erase of the key while
+     * compute runs wins: the computed value is still returned to the waiting callers, but not cached.
+     */
+    template<class F>
+    Value get_or_compute(const Key& key, F&& compute)
+    {
+        if (std::optional<Value> value = lookup(key))
+        {
+            _hits.add();
+            return std::move(*value);
+        }
+        shard& s = get_shard(key);
+        std::shared_ptr<inflight> flight;
+        {
+            std::unique_lock<boost::shared_mutex> writeLock(s._rwm);
+            auto entry = s._index.find(key);
+            if (entry != s._index.end())
+            {
+                /*filled in by another thread between the two lookups*/
+                slot& found = s._slots[entry->second];
+                found._referenced.store(true, std::memory_order_relaxed);
+                _hits.add();
+                return *found._value;
+            }
+            auto running = s._inflight.find(key);
+            if (running != s._inflight.end())
+            {
+                flight = running->second;
+            }
+            else
+            {
+                s._inflight.emplace(key, std::make_shared<inflight>());
+            }
+        }
+        _misses.add();
+        if (flight)
+        {
+            _coalesced.add();
+            return flight->wait();
+        }
+        return compute_and_publish(s, key, std::forward<F>(compute));
+    }
+
+    cache_stats stats() const
+    {
+        cache_stats result;
+        result._hits = _hits.load();
+        result._misses = _misses.load();
+        result._evictions = _evictions.load();
+        result._coalesced = _coalesced.load();
+        result._size = size();
+        return result;
+    }
+
+    size_t size() const
+    {
+        size_t total = 0;
+        for (const auto& s : _shards)
+        {
+            boost::shared_lock<boost::shared_mutex> readLock(s->_rwm);
+            total += s->_index.size();
+        }
+        return total;
+    }
+
+    size_t capacity() const
+    {
+        return _shards.size() * _shards.front()->_capacity;
+    }
+
+private:
+    shard& get_shard(const Key& key) const
+    {
+        return *_shards[_hashFunc(key) % _shards.size()];
+    }
+
+    std::optional<Value> lookup(const Key& key) const
+    {
+        shard& s = get_shard(key);
+        boost::shared_lock<boost::shared_mutex> readLock(s._rwm);
+        auto entry = s._index.find(key);
+        if (entry == s._index.end())
+        {
+            return std::nullopt;
+        }
+        slot& found = s._slots[entry->second];
+        /*relaxed and only written when clear, so hot entries do not bounce the cache line*/
+        if (!found._referenced.load(std::memory_order_relaxed))
+        {
+            found._referenced.store(true, std::memory_order_relaxed);
+        }
+        return found._value;
+    }
+
+    template<class F>
+    Value compute_and_publish(shard& s, const Key& key, F&& compute)
+    {
+        std::optional<Value> value;
+        std::exception_ptr error;
+        try
+        {
+            value.emplace(compute());
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        std::shared_ptr<inflight> flight;
+        {
+            std::unique_lock<boost::shared_mutex> writeLock(s._rwm);
+            auto running = s._inflight.find(key);
+            flight = std::move(running->second);
+            s._inflight.erase(running);
+            if (value && !flight->_superseded)
+            {
+                store_locked(s, key, *value);
+            }
+        }
+        if (error)
+        {
+            flight->finish(std::nullopt, error);
+            std::rethrow_exception(error);
+        }
+        flight->finish(value, nullptr);
+        return std::move(*value);
+    }
+
+    /*Keeps a computation already running for key from overwriting what the caller writes now*/
+    static void supersede_locked(shard& s, const Key& key)
+    {
+        if (s._inflight.empty())
+        {
+            return;
+        }
+        auto running = s._inflight.find(key);
+        if (running != s._inflight.end())
+        {
+            running->second->_superseded = true;
+        }
+    }
+
+    void store_locked(shard& s, const Key& key, Value value)
+    {
+        auto entry = s._index.find(key);
+        if (entry != s._index.end())
+        {
+            slot& found = s._slots[entry->second];
+            found._value = std::move(value);
+            found._referenced.store(true, std::memory_order_relaxed);
+            return;
+        }
+        size_t position = s._used < s._capacity ? s._used++ : evict_locked(s);
+        auto inserted = s._index.emplace(key, position).first;
+        slot& target = s._slots[position];
+        /*unordered_map nodes are stable, so the slot can point at the index's copy of the key*/
+        target._key = &inserted->first;
+        target._value = std::move(value);
+        /*a new entry gets no second chance until it is hit once*/
+        target._referenced.store(false, std::memory_order_relaxed);
+    }
+
+    /*Advances the clock hand to a victim and returns its now free slot; ends within two sweeps*/
+    size_t evict_locked(shard& s)
+    {
+        while (true)
+        {
+            const size_t position = s._hand;
+            s._hand = (s._hand + 1) % s._capacity;
+            slot& candidate = s._slots[position];
+            if (candidate._key == nullptr)
+            {
+                return position;
+            }
+            if (candidate._referenced.load(std::memory_order_relaxed))
+            {
+                candidate._referenced.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            s._index.erase(*candidate._key);
+            candidate._key = nullptr;
+            candidate._value.reset();
+            _evictions.add();
+            return position;
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<shard>> _shards;
+    Hash _hashFunc;
+    metrics::striped_counter _hits;
+    metrics::striped_counter _misses;
+    metrics::striped_counter _evictions;
+    metrics::striped_counter _coalesced;
+};
+
+THREADSAFT_CONTAINER_END
+
+#endif //!__CONCURRENT_CACHE_H__
@@ -0,0 +1,462 @@
+#pragma once
+
+#ifndef __CONCURRENT_ORDERED_MAP_H__
+#define __CONCURRENT_ORDERED_MAP_H__
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <optional>
+#include <thread>
+#include <utility>
+#include "base_def.h"
+#include "container_metrics.hpp"
+#include "epoch_reclaim.hpp"
+
+THREADSAFT_CONTAINER_BEGIN
+
+/*
+ * Ordered map built as a lazy skip list (Herlihy, Lev, Luchangco, Shavit). Lookups, lower_bound and
+ * range walks take no locks at all; insert and erase lock only the predecessors of the node they
+ * change, so writers on different key ranges do not contend. Unlinked nodes are retired through the
+ * epoch_domain and freed once no reader can still be standing on them.
+ *
+ * Values are immutable once inserted (readers copy them without a lock); replace one with erase and
+ * insert. Range walks are weakly consistent: they see every key present for the whole walk, and may
+ * or may not see keys inserted or erased while it runs.
+ */
+template<class Key, class Value, class Compare = std::less<Key>>
+class concurrent_ordered_map
+{
+private:
+    static constexpr int MAX_HEIGHT = 24;
+
+    struct node;
+
+    /*Links and flags; the head sentinel is a bare tower, every element a node*/
+    struct tower
+    {
+        tower(int height, std::atomic<node*>* next)
+            :_next(next), _height(height) {}
+
+        void lock()
+        {
+            while (_locked.exchange(true, std::memory_order_acquire))
+            {
+                while (_locked.load(std::memory_order_relaxed))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        void unlock()
+        {
+            _locked.store(false, std::memory_order_release);
+        }
+
+        std::atomic<node*>* const _next;
+        const int _height;
+        std::atomic<bool> _marked{ false };
+        std::atomic<bool> _fullyLinked{ false };
+        std::atomic<bool> _locked{ false };
+    };
+
+    /*Allocated together with its _next array, which sits right behind it*/
+    struct node : tower
+    {
+        template<class K, class V>
+        node(int height, std::atomic<node*>* next, K&& key, V&& value)
+            :tower(height, next), _key(std::forward<K>(key)), _value(std::forward<V>(value)) {}
+
+        const Key _key;
+        const Value _value;
+    };
+
+public:
+    explicit concurrent_ordered_map(const Compare& compare = Compare())
+        :_head(MAX_HEIGHT, _headNext), _compare(compare)
+    {
+        for (auto& link : _headNext)
+        {
+            link.store(nullptr, std::memory_order_relaxed);
+        }
+        _head._fullyLinked.store(true, std::memory_order_relaxed);
+    }
+
+    concurrent_ordered_map(const concurrent_ordered_map&) = delete;
+    concurrent_ordered_map& operator=(const concurrent_ordered_map&) = delete;
+
+    /*No other thread may still be using the map*/
+    ~concurrent_ordered_map()
+    {
+        node* curr = _headNext[0].load(std::memory_order_relaxed);
+        while (curr != nullptr)
+        {
+            node* next = curr->_next[0].load(std::memory_order_relaxed);
+            destroy_node(curr);
+            curr = next;
+        }
+    }
+
+    /*false, leaving the stored value alone, if key is already present*/
+    template<class K, class V>
+    bool insert(K&& key, V&& value)
+    {
+        const int height = random_height();
+        tower* preds[MAX_HEIGHT];
+        node* succs[MAX_HEIGHT];
+        epoch_domain::guard guard;
+        while (true)
+        {
+            int found = find_position(key, preds, succs);
+            if (found != -1)
+            {
+                node* existing = succs[found];
+                if (!existing->_marked.load(std::memory_order_acquire))
+                {
+                    /*it is being linked in; report it only once it is visible to every reader*/
+                    while (!existing->_fullyLinked.load(std::memory_order_acquire))
+                    {
+                        std::this_thread::yield();
+                    }
+                    return false;
+                }
+                /*erased but not yet unlinked; retry once it is gone*/
+                std::this_thread::yield();
+                continue;
+            }
+            int highestLocked = -1;
+            bool valid = true;
+            for (int level = 0; valid && level < height; ++level)
+            {
+                if (level == 0 || preds[level] != preds[level - 1])
+                {
+                    preds[level]->lock();
+                    highestLocked = level;
+                }
+                valid = !preds[level]->_marked.load(std::memory_order_acquire)
+                    && (succs[level] == nullptr || !succs[level]->_marked.load(std::memory_order_acquire))
+                    && preds[level]->_next[level].load(std::memory_order_acquire) == succs[level];
+            }
+            if (!valid)
+            {
+                unlock_preds(preds, highestLocked);
+                continue;
+            }
+            node* created = create_node(height, std::forward<K>(key), std::forward<V>(value));
+            for (int level = 0; level < height; ++level)
+            {
+                created->_next[level].store(succs[level], std::memory_order_relaxed);
+            }
+            for (int level = 0; level < height; ++level)
+            {
+                preds[level]->_next[level].store(created, std::memory_order_release);
+            }
+            created->_fullyLinked.store(true, std::memory_order_release);
+            unlock_preds(preds, highestLocked);
+            _size.fetch_add(1, std::memory_order_relaxed);
+            _metrics.on_push();
+            return true;
+        }
+    }
+
+    bool erase(const Key& key)
+    {
+        tower* preds[MAX_HEIGHT];
+        node* succs[MAX_HEIGHT];
+        epoch_domain::guard guard;
+        int found = find_position(key, preds, succs);
+        if (found == -1)
+        {
+            return false;
+        }
+        node* candidate = succs[found];
+        /*only a fully linked node found at its own top level can be unlinked from every level*/
+        if (!candidate->_fullyLinked.load(std::memory_order_acquire)
+            || candidate->_height - 1 != found
+            || !try_mark(candidate))
+        {
+            return false;
+        }
+        unlink(candidate, preds, succs);
+        return true;
+    }
+
+    /*
+     * Removes and returns the entry with the smallest key, or std::nullopt if there is none.
+     * Concurrent callers each get a different entry; contention is confined to the front of the list.
+     */
+    std::optional<std::pair<Key, Value>> pop_front()
+    {
+        epoch_domain::guard guard;
+        for (node* curr = skip_dead(_headNext[0].load(std::memory_order_acquire)); curr != nullptr; curr = next_live(curr))
+        {
+            if (!try_mark(curr))
+            {
+                continue;
+            }
+            std::optional<std::pair<Key, Value>> front(std::in_place, curr->_key, curr->_value);
+            tower* preds[MAX_HEIGHT];
+            node* succs[MAX_HEIGHT];
+            find_position(curr->_key, preds, succs);
+            unlink(curr, preds, succs);
+            return front;
+        }
+        return std::nullopt;
+    }
+
+    std::optional<Value> find(const Key& key) const
+    {
+        _metrics.on_lookup();
+        epoch_domain::guard guard;
+        node* match = find_node(key);
+        return match != nullptr ? std::optional<Value>(match->_value) : std::nullopt;
+    }
+
+    bool contains(const Key& key) const
+    {
+        _metrics.on_lookup();
+        epoch_domain::guard guard;
+        return find_node(key) != nullptr;
+    }
+
+    /*The first entry whose key is not less than key*/
+    std::optional<std::pair<Key, Value>> lower_bound(const Key& key) const
+    {
+        _metrics.on_lookup();
+        epoch_domain::guard guard;
+        node* first = first_not_less(key);
+        return first != nullptr ? std::optional<std::pair<Key, Value>>(std::in_place, first->_key, first->_value) : std::nullopt;
+    }
+
+    /*
+     * Calls f(key, value) in key order for every entry in [from, to) and returns how many it visited.
+     * f runs inside an epoch guard and must not block: a long walk holds back reclamation.
+     */
+    template<class F>
+    size_t for_each_range(const Key& from, const Key& to, F f) const
+    {
+        epoch_domain::guard guard;
+        size_t visited = 0;
+        for (node* curr = first_not_less(from); curr != nullptr && _compare(curr->_key, to); curr = next_live(curr))
+        {
+            f(curr->_key, curr->_value);
+            ++visited;
+        }
+        return visited;
+    }
+
+    template<class F>
+    size_t for_each(F f) const
+    {
+        epoch_domain::guard guard;
+        size_t visited = 0;
+        for (node* curr = skip_dead(_headNext[0].load(std::memory_order_acquire)); curr != nullptr; curr = next_live(curr))
+        {
+            f(curr->_key, curr->_value);
+            ++visited;
+        }
+        return visited;
+    }
+
+    /*Exact when quiescent, approximate while writers are active*/
+    size_t size() const
+    {
+        return _size.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    const metrics::container_metrics_t& get_metrics() const
+    {
+        return _metrics;
+    }
+
+private:
+    /*
+     * Fills preds/succs with the neighbours of key on every level and returns the highest level on
+     * which a node with an equal key was seen, or -1.
+     */
+    int find_position(const Key& key, tower** preds, node** succs) const
+    {
+        int found = -1;
+        tower* pred = &_head;
+        for (int level = MAX_HEIGHT - 1; level >= 0; --level)
+        {
+            node* curr = pred->_next[level].load(std::memory_order_acquire);
+            while (curr != nullptr && _compare(curr->_key, key))
+            {
+                pred = curr;
+                curr = pred->_next[level].load(std::memory_order_acquire);
+            }
+            if (found == -1 && curr != nullptr && !_compare(key, curr->_key))
+            {
+                found = level;
+            }
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+        return found;
+    }
+
+    node* find_node(const Key& key) const
+    {
+        node* first = first_not_less(key);
+        return first != nullptr && !_compare(key, first->_key) ? first : nullptr;
+    }
+
+    node* first_not_less(const Key& key) const
+    {
+        tower* pred = &_head;
+        node* curr = nullptr;
+        for (int level = MAX_HEIGHT - 1; level >= 0; --level)
+        {
+            curr = pred->_next[level].load(std::memory_order_acquire);
+            while (curr != nullptr && _compare(curr->_key, key))
+            {
+                pred = curr;
+                curr = pred->_next[level].load(std::memory_order_acquire);
+            }
+        }
+        return skip_dead(curr);
+    }
+
+    /*Erased or half-inserted nodes are still reachable for a moment; readers step over them*/
+    static node* skip_dead(node* curr)
+    {
+        while (curr != nullptr
+            && (curr->_marked.load(std::memory_order_acquire) || !curr->_fullyLinked.load(std::memory_order_acquire)))
+        {
+            curr = curr->_next[0].load(std::memory_order_acquire);
+        }
+        return curr;
+    }
+
+    static node* next_live(node* curr)
+    {
+        return skip_dead(curr->_next[0].load(std::memory_order_acquire));
+    }
+
+    /*Linearisation point of a removal: from here on lookups treat the key as absent. Leaves the node locked*/
+    static bool try_mark(node* candidate)
+    {
+        if (candidate->_marked.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        candidate->lock();
+        if (candidate->_marked.load(std::memory_order_relaxed))
+        {
+            candidate->unlock();
+            return false;
+        }
+        candidate->_marked.store(true, std::memory_order_release);
+        return true;
+    }
+
+    /*Unlinks a node marked by try_mark; preds/succs come from a find_position for its key*/
+    void unlink(node* victim, tower** preds, node** succs)
+    {
+        while (true)
+        {
+            int highestLocked = -1;
+            bool valid = true;
+            for (int level = 0; valid && level < victim->_height; ++level)
+            {
+                if (level == 0 || preds[level] != preds[level - 1])
+                {
+                    preds[level]->lock();
+                    highestLocked = level;
+                }
+                valid = !preds[level]->_marked.load(std::memory_order_acquire)
+                    && preds[level]->_next[level].load(std::memory_order_acquire) == victim;
+            }
+            if (!valid)
+            {
+                unlock_preds(preds, highestLocked);
+                find_position(victim->_key, preds, succs);
+                continue;
+            }
+            for (int level = victim->_height - 1; level >= 0; --level)
+            {
+                preds[level]->_next[level].store(victim->_next[level].load(std::memory_order_relaxed), std::memory_order_release);
+            }
+            victim->unlock();
+            unlock_preds(preds, highestLocked);
+            _size.fetch_sub(1, std::memory_order_relaxed);
+            _metrics.on_pop();
+            epoch_domain::instance().retire(victim, &destroy_node);
+            return;
+        }
+    }
+
+    static void unlock_preds(tower** preds, int highestLocked)
+    {
+        for (int level = 0; level <= highestLocked; ++level)
+        {
+            if (level == 0 || preds[level] != preds[level - 1])
+            {
+                preds[level]->unlock();
+            }
+        }
+    }
+
+    /*Geometric with p = 1/4, which keeps the expected tower at 1.33 links per node*/
+    static int random_height()
+    {
+        static thread_local std::uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        std::uint64_t bits = state;
+        int height = 1;
+        while (height < MAX_HEIGHT && (bits & 3) == 0)
+        {
+            ++height;
+            bits >>= 2;
+        }
+        return height;
+    }
+
+    template<class K, class V>
+    static node* create_node(int height, K&& key, V&& value)
+    {
+        void* raw = ::operator new(sizeof(node) + height * sizeof(std::atomic<node*>));
+        auto* next = reinterpret_cast<std::atomic<node*>*>(static_cast<char*>(raw) + sizeof(node));
+        for (int level = 0; level < height; ++level)
+        {
+            new (next + level) std::atomic<node*>(nullptr);
+        }
+        try
+        {
+            return new (raw) node(height, next, std::forward<K>(key), std::forward<V>(value));
+        }
+        catch (...)
+        {
+            ::operator delete(raw);
+            throw;
+        }
+    }
+
+    static void destroy_node(void* p)
+    {
+        static_cast<node*>(p)->~node();
+        ::operator delete(p);
+    }
+
+private:
+    std::atomic<node*> _headNext[MAX_HEIGHT];
+    mutable tower _head;
+    Compare _compare;
+    std::atomic<size_t> _size{ 0 };
+    mutable metrics::container_metrics_t _metrics;
+};
+
+THREADSAFT_CONTAINER_END
+
+#endif //!__CONCURRENT_ORDERED_MAP_H__
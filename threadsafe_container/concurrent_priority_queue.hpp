@@ -0,0 +1,256 @@
+#pragma once
+
+#ifndef __CONCURRENT_PRIORITY_QUEUE_H__
+#define __CONCURRENT_PRIORITY_QUEUE_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "base_def.h"
+#include "container_metrics.hpp"
+#include "concurrent_ordered_map.hpp"
+
+THREADSAFT_CONTAINER_BEGIN
+
+/*
+ * Strict priority queue: try_pop_min always returns the smallest element present (by Compare), and
+ * equal elements come out in push order. Elements live in a lazy skip list keyed by (value, push
+ * sequence); push locks only the predecessors of the new node, and try_pop_min claims the first node
+ * by marking it, so concurrent poppers each take a different element without a global lock.
+ * Elements are copied out, so T must be copyable.
+ */
+template<class T, class Compare = std::less<T>>
+class concurrent_priority_queue
+{
+private:
+    struct entry
+    {
+        T _value;
+        std::uint64_t _seq;
+    };
+
+    struct entry_compare
+    {
+        bool operator()(const entry& lhs, const entry& rhs) const
+        {
+            if (_compare(lhs._value, rhs._value))
+            {
+                return true;
+            }
+            if (_compare(rhs._value, lhs._value))
+            {
+                return false;
+            }
+            return lhs._seq < rhs._seq;
+        }
+
+        Compare _compare;
+    };
+
+    struct no_value {};
+
+public:
+    explicit concurrent_priority_queue(const Compare& compare = Compare())
+        :_list(entry_compare{ compare }) {}
+
+    concurrent_priority_queue(const concurrent_priority_queue&) = delete;
+    concurrent_priority_queue& operator=(const concurrent_priority_queue&) = delete;
+
+    void push(T value)
+    {
+        _list.insert(entry{ std::move(value), _seq.fetch_add(1, std::memory_order_relaxed) }, no_value{});
+    }
+
+    std::optional<T> try_pop_min()
+    {
+        auto front = _list.pop_front();
+        return front ? std::optional<T>(std::move(front->first._value)) : std::nullopt;
+    }
+
+    /*Exact when quiescent, approximate while other threads push or pop*/
+    size_t size() const
+    {
+        return _list.size();
+    }
+
+    bool empty() const
+    {
+        return _list.empty();
+    }
+
+    const metrics::container_metrics_t& get_metrics() const
+    {
+        return _list.get_metrics();
+    }
+
+private:
+    concurrent_ordered_map<entry, no_value, entry_compare> _list;
+    std::atomic<std::uint64_t> _seq{ 0 };
+};
+
+/*
+ * Relaxed priority queue (MultiQueue, Rihani/Sanders/Dementiev): elements are spread over several
+ * binary heaps, each behind its own mutex. push adds to a random heap; try_pop_min looks at two
+ * random heaps and pops the smaller of their tops. Contention stays flat as threads are added, at the
+ * price of order: try_pop_min returns an element close to the minimum rather than the minimum itself.
+ * It only returns std::nullopt after finding every heap empty.
+ */
+template<class T, class Compare = std::less<T>>
+class relaxed_priority_queue
+{
+private:
+    /*Two random picks that are both busy or empty are retried this often before a full sweep*/
+    static constexpr int POP_ATTEMPTS = 8;
+    static constexpr size_t HEAPS_PER_THREAD = 2;
+
+    struct alignas(64) heap
+    {
+        std::mutex _m;
+        std::vector<T> _items;
+        /*Written under _m, read without it to skip empty heaps*/
+        std::atomic<size_t> _count{ 0 };
+    };
+
+public:
+    /*heaps == 0 picks two per hardware thread*/
+    explicit relaxed_priority_queue(size_t heaps = 0, const Compare& compare = Compare())
+        :_heapCount(heaps != 0 ? heaps : std::max<size_t>(2, HEAPS_PER_THREAD * std::thread::hardware_concurrency())),
+        _heaps(std::make_unique<heap[]>(_heapCount)), _compare(compare) {}
+
+    relaxed_priority_queue(const relaxed_priority_queue&) = delete;
+    relaxed_priority_queue& operator=(const relaxed_priority_queue&) = delete;
+
+    void push(T value)
+    {
+        while (true)
+        {
+            heap& target = _heaps[random_index()];
+            std::unique_lock<std::mutex> lock(target._m, std::try_to_lock);
+            if (!lock.owns_lock())
+            {
+                continue;
+            }
+            target._items.push_back(std::move(value));
+            std::push_heap(target._items.begin(), target._items.end(), heap_compare());
+            target._count.store(target._items.size(), std::memory_order_relaxed);
+            _metrics.on_push();
+            return;
+        }
+    }
+
+    std::optional<T> try_pop_min()
+    {
+        for (int attempt = 0; attempt < POP_ATTEMPTS; ++attempt)
+        {
+            heap& first = _heaps[random_index()];
+            heap& second = _heaps[random_index()];
+            if (first._count.load(std::memory_order_relaxed) == 0 && second._count.load(std::memory_order_relaxed) == 0)
+            {
+                continue;
+            }
+            std::unique_lock<std::mutex> firstLock(first._m, std::try_to_lock);
+            if (!firstLock.owns_lock())
+            {
+                continue;
+            }
+            std::unique_lock<std::mutex> secondLock;
+            if (&second != &first)
+            {
+                secondLock = std::unique_lock<std::mutex>(second._m, std::try_to_lock);
+                if (!secondLock.owns_lock())
+                {
+                    continue;
+                }
+            }
+            heap* best = &first;
+            if (first._items.empty() || (!second._items.empty() && _compare(second._items.front(), first._items.front())))
+            {
+                best = &second;
+            }
+            if (!best->_items.empty())
+            {
+                return pop_locked(*best);
+            }
+        }
+        /*the picks kept missing: look at every heap before reporting the queue empty*/
+        const size_t start = random_index();
+        for (size_t i = 0; i < _heapCount; ++i)
+        {
+            heap& target = _heaps[(start + i) % _heapCount];
+            if (target._count.load(std::memory_order_relaxed) == 0)
+            {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(target._m);
+            if (!target._items.empty())
+            {
+                return pop_locked(target);
+            }
+        }
+        return std::nullopt;
+    }
+
+    /*Exact when quiescent, approximate while other threads push or pop*/
+    size_t size() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < _heapCount; ++i)
+        {
+            total += _heaps[i]._count.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    const metrics::container_metrics_t& get_metrics() const
+    {
+        return _metrics;
+    }
+
+private:
+    /*std heap algorithms build a max-heap, so invert Compare to keep the minimum at the front*/
+    auto heap_compare() const
+    {
+        return [this](const T& lhs, const T& rhs) { return _compare(rhs, lhs); };
+    }
+
+    T pop_locked(heap& target)
+    {
+        std::pop_heap(target._items.begin(), target._items.end(), heap_compare());
+        T value = std::move(target._items.back());
+        target._items.pop_back();
+        target._count.store(target._items.size(), std::memory_order_relaxed);
+        _metrics.on_pop();
+        return value;
+    }
+
+    size_t random_index() const
+    {
+        static thread_local std::uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<size_t>(state % _heapCount);
+    }
+
+private:
+    const size_t _heapCount;
+    std::unique_ptr<heap[]> _heaps;
+    Compare _compare;
+    metrics::container_metrics_t _metrics;
+};
+
+THREADSAFT_CONTAINER_END
+
+#endif //!__CONCURRENT_PRIORITY_QUEUE_H__
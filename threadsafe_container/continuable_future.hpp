@@ -0,0 +1,789 @@
+#pragma once
+
+#ifndef __CONTINUABLE_FUTURE_H__
+#define __CONTINUABLE_FUTURE_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "base_def.h"
+
+THREADSAFT_CONTAINER_BEGIN
+
+namespace detail
+{
+    struct future_state_base;
+}
+
+/*Non-owning handle to anything with post(F), e.g. SimpleThreadPool; empty means "run inline"*/
+class executor_ref
+{
+public:
+    executor_ref() = default;
+
+    template<class Executor, class = std::enable_if_t<!std::is_same_v<std::decay_t<Executor>, executor_ref>>>
+    executor_ref(Executor& executor)
+        :_executor(&executor),
+        _post([](void* ex, void (*run)(void*), void* arg) {
+            static_cast<Executor*>(ex)->post([run, arg]() { run(arg); });
+        }),
+        _postContinuation(&post_continuation_to<Executor>)
+    {
+    }
+
+    explicit operator bool() const
+    {
+        return _executor != nullptr;
+    }
+
+    void post(void (*run)(void*), void* arg) const
+    {
+        _post(_executor, run, arg);
+    }
+
+    /*Posts state's continuation as a run_handle, so the state hears of it if the executor drops it unrun*/
+    void post_continuation(detail::future_state_base* state) const
+    {
+        _postContinuation(_executor, state);
+    }
+
+private:
+    template<class Executor>
+    static void post_continuation_to(void* executor, detail::future_state_base* state);
+
+    void* _executor = nullptr;
+    void (*_post)(void*, void (*)(void*), void*) = nullptr;
+    void (*_postContinuation)(void*, detail::future_state_base*) = nullptr;
+};
+
+template<class T>
+class continuable_future;
+
+template<class T>
+class continuable_promise;
+
+namespace detail
+{
+    /*
+     * Intrusively counted shared state. _next holds the single continuation (another state waiting on
+     * this one) until the value is published, after which it holds a tag; whoever loses the race
+     * between publish() and attach() dispatches the continuation, so neither side takes a lock.
+     */
+    struct future_state_base
+    {
+        future_state_base() = default;
+        future_state_base(const future_state_base&) = delete;
+        future_state_base& operator=(const future_state_base&) = delete;
+        virtual ~future_state_base() = default;
+
+        /*Runs once the state this one is attached to is ready*/
+        virtual void on_ready() {}
+
+        /*The executor dropped the posted on_ready unrun (shutdown_now)*/
+        virtual void on_abandoned()
+        {
+            on_ready();
+        }
+
+        /*run_handle's two ends: whichever comes first takes effect, the other does nothing*/
+        void execute()
+        {
+            if (!_started.exchange(true))
+            {
+                on_ready();
+            }
+        }
+
+        void abandon()
+        {
+            if (!_started.exchange(true))
+            {
+                on_abandoned();
+            }
+        }
+
+        virtual void release()
+        {
+            if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                delete this;
+            }
+        }
+
+        void add_ref()
+        {
+            _refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        bool is_ready() const
+        {
+            return _next.load(std::memory_order_acquire) == ready_tag();
+        }
+
+        void publish()
+        {
+            future_state_base* next = _next.exchange(ready_tag(), std::memory_order_acq_rel);
+            if (next != nullptr)
+            {
+                dispatch(next);
+            }
+        }
+
+        /*At most one continuation per state*/
+        void attach(future_state_base* next)
+        {
+            future_state_base* expected = nullptr;
+            if (!_next.compare_exchange_strong(expected, next, std::memory_order_acq_rel))
+            {
+                dispatch(next);
+            }
+        }
+
+        void wait();
+
+        static future_state_base* ready_tag()
+        {
+            return reinterpret_cast<future_state_base*>(std::uintptr_t{ 1 });
+        }
+
+        /*
+         * A stopped executor throws from post; the continuation then runs inline rather than never.
+         * Posting holds a handle (and a reference) of its own, so only an executor that took the
+         * continuation and later dropped it (shutdown_now) can abandon it.
+         */
+        static void dispatch(future_state_base* next)
+        {
+            if (!next->_executor)
+            {
+                next->on_ready();
+                return;
+            }
+            next->add_ref();
+            next->_handles.fetch_add(1, std::memory_order_relaxed);
+            bool posted = false;
+            try
+            {
+                next->_executor.post_continuation(next);
+                posted = true;
+            }
+            catch (...)
+            {
+            }
+            if (next->_handles.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                posted ? next->abandon() : next->execute();
+            }
+            next->release();
+        }
+
+        std::atomic<std::uint32_t> _refs{ 1 };
+        std::atomic<future_state_base*> _next{ nullptr };
+        executor_ref _executor;
+        /*live run_handles (and a dispatch in progress)*/
+        std::atomic<std::uint32_t> _handles{ 0 };
+        std::atomic<bool> _started{ false };
+    };
+
+    /*Lives on the waiting thread's stack and occupies the continuation slot while it blocks*/
+    struct blocking_waiter : future_state_base
+    {
+        void on_ready() override
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _done = true;
+            _cv.notify_one();
+        }
+
+        void release() override {}
+
+        std::mutex _m;
+        std::condition_variable _cv;
+        bool _done = false;
+    };
+
+    inline void future_state_base::wait()
+    {
+        if (is_ready())
+        {
+            return;
+        }
+        blocking_waiter waiter;
+        attach(&waiter);
+        std::unique_lock<std::mutex> lock(waiter._m);
+        waiter._cv.wait(lock, [&]() { return waiter._done; });
+    }
+
+    template<class T>
+    struct future_state : future_state_base
+    {
+        using value_type = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+        template<class... A>
+        void set_value(A&&... value)
+        {
+            _result.template emplace<1>(std::forward<A>(value)...);
+            publish();
+        }
+
+        void set_exception(std::exception_ptr error)
+        {
+            _result.template emplace<2>(std::move(error));
+            publish();
+        }
+
+        bool has_exception() const
+        {
+            return _result.index() == 2;
+        }
+
+        std::exception_ptr exception() const
+        {
+            return std::get<2>(_result);
+        }
+
+        value_type take()
+        {
+            if (has_exception())
+            {
+                std::rethrow_exception(exception());
+            }
+            return std::move(std::get<1>(_result));
+        }
+
+        std::variant<std::monostate, value_type, std::exception_ptr> _result;
+    };
+
+    /*Invokes func and stores its result or exception into state*/
+    template<class R, class F, class... A>
+    void fulfil(future_state<R>& state, F& func, A&&... args)
+    {
+        std::exception_ptr error;
+        if constexpr (std::is_void_v<R>)
+        {
+            try
+            {
+                std::invoke(func, std::forward<A>(args)...);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            error ? state.set_exception(error) : state.set_value();
+        }
+        else
+        {
+            std::optional<R> value;
+            try
+            {
+                value.emplace(std::invoke(func, std::forward<A>(args)...));
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            error ? state.set_exception(error) : state.set_value(std::move(*value));
+        }
+    }
+
+    template<class T, class F>
+    using then_result_t = typename std::conditional_t<std::is_void_v<T>, std::invoke_result<F>, std::invoke_result<F, T>>::type;
+
+    /*The continuation's functor and its result in one allocation; the antecedent's exception skips func*/
+    template<class T, class F>
+    struct then_state : future_state<then_result_t<T, F>>
+    {
+        then_state(F&& func, future_state<T>* antecedent)
+            :_func(std::move(func)), _antecedent(antecedent) {}
+
+        void on_ready() override
+        {
+            future_state<T>* source = _antecedent;
+            _antecedent = nullptr;
+            if (source->has_exception())
+            {
+                this->set_exception(source->exception());
+            }
+            else if constexpr (std::is_void_v<T>)
+            {
+                fulfil(*this, _func);
+            }
+            else
+            {
+                fulfil(*this, _func, std::move(std::get<1>(source->_result)));
+            }
+            source->release();
+            /*the reference the antecedent's continuation slot held*/
+            this->release();
+        }
+
+        void on_abandoned() override
+        {
+            std::exchange(_antecedent, nullptr)->release();
+            this->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            this->release();
+        }
+
+        F _func;
+        future_state<T>* _antecedent;
+    };
+
+    /*
+     * SimpleThreadPool::submit: the bound call and its result in one allocation. The pool queue holds
+     * run_handles; if every handle is destroyed unrun (shutdown_now) the future gets broken_promise.
+     */
+    template<class R, class F>
+    struct task_state : future_state<R>
+    {
+        explicit task_state(F&& func)
+            :_func(std::move(func)) {}
+
+        void on_ready() override
+        {
+            fulfil(*this, _func);
+        }
+
+        void on_abandoned() override
+        {
+            this->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        }
+
+        F _func;
+    };
+
+    /*What an executor queues for a state (any future_state_base): execute() when run, abandon() when every copy dies unrun*/
+    template<class State>
+    class run_handle
+    {
+    public:
+        explicit run_handle(State* state)
+            :_state(state)
+        {
+            acquire();
+        }
+
+        run_handle(const run_handle& rhs)
+            :_state(rhs._state)
+        {
+            acquire();
+        }
+
+        run_handle(run_handle&& rhs) noexcept
+            :_state(std::exchange(rhs._state, nullptr)) {}
+
+        run_handle& operator=(const run_handle&) = delete;
+        run_handle& operator=(run_handle&&) = delete;
+
+        ~run_handle()
+        {
+            if (_state != nullptr)
+            {
+                if (_state->_handles.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    _state->abandon();
+                }
+                _state->release();
+            }
+        }
+
+        void operator()()
+        {
+            _state->execute();
+        }
+
+    private:
+        void acquire()
+        {
+            _state->add_ref();
+            _state->_handles.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        State* _state;
+    };
+
+    template<class T>
+    using when_all_value_t = std::conditional_t<std::is_void_v<T>, void, std::vector<T>>;
+
+    template<class T>
+    using when_any_value_t = std::conditional_t<std::is_void_v<T>, size_t, std::pair<size_t, T>>;
+
+    /*Fan-in over n sources; slot i occupies source i's continuation slot and reports back inline*/
+    template<class T, class R>
+    struct fan_in_state : future_state<R>
+    {
+        struct slot : future_state_base
+        {
+            void on_ready() override
+            {
+                _parent->arrive(*this);
+            }
+
+            void release() override {}
+
+            fan_in_state* _parent = nullptr;
+            future_state<T>* _source = nullptr;
+            size_t _index = 0;
+        };
+
+        explicit fan_in_state(size_t count)
+            :_slots(new slot[count]), _count(count), _remaining(count) {}
+
+        virtual void arrive(slot& s) = 0;
+
+        std::unique_ptr<slot[]> _slots;
+        const size_t _count;
+        std::atomic<size_t> _remaining;
+    };
+
+    template<class T>
+    struct when_all_state : fan_in_state<T, when_all_value_t<T>>
+    {
+        using base = fan_in_state<T, when_all_value_t<T>>;
+        using base::base;
+
+        void arrive(typename base::slot&) override
+        {
+            if (this->_remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            {
+                return;
+            }
+            std::exception_ptr error;
+            for (size_t i = 0; i < this->_count && !error; ++i)
+            {
+                if (this->_slots[i]._source->has_exception())
+                {
+                    error = this->_slots[i]._source->exception();
+                }
+            }
+            if (error)
+            {
+                this->set_exception(error);
+            }
+            else if constexpr (std::is_void_v<T>)
+            {
+                this->set_value();
+            }
+            else
+            {
+                std::vector<T> values;
+                values.reserve(this->_count);
+                for (size_t i = 0; i < this->_count; ++i)
+                {
+                    values.push_back(std::move(std::get<1>(this->_slots[i]._source->_result)));
+                }
+                this->set_value(std::move(values));
+            }
+            for (size_t i = 0; i < this->_count; ++i)
+            {
+                this->_slots[i]._source->release();
+            }
+            this->release();
+        }
+    };
+
+    template<class T>
+    struct when_any_state : fan_in_state<T, when_any_value_t<T>>
+    {
+        using base = fan_in_state<T, when_any_value_t<T>>;
+        using base::base;
+
+        void arrive(typename base::slot& s) override
+        {
+            if (!_won.exchange(true))
+            {
+                if (s._source->has_exception())
+                {
+                    this->set_exception(s._source->exception());
+                }
+                else if constexpr (std::is_void_v<T>)
+                {
+                    this->set_value(s._index);
+                }
+                else
+                {
+                    this->set_value(s._index, std::move(std::get<1>(s._source->_result)));
+                }
+            }
+            s._source->release();
+            /*the losers still have to report before the slots can go away*/
+            if (this->_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                this->release();
+            }
+        }
+
+        std::atomic<bool> _won{ false };
+    };
+
+    struct future_access
+    {
+        template<class T>
+        static continuable_future<T> make(future_state<T>* state)
+        {
+            return continuable_future<T>(state);
+        }
+
+        template<class T>
+        static future_state<T>* peek(const continuable_future<T>& future)
+        {
+            return future._state;
+        }
+
+        template<class T>
+        static future_state<T>* detach(continuable_future<T>& future)
+        {
+            return std::exchange(future._state, nullptr);
+        }
+    };
+}
+
+/*
+ * Single-consumer future whose continuations run on an executor instead of blocking a thread.
+ * then() consumes the future; get() blocks, but only the thread that calls it. The shared state
+ * (value, reference count, continuation link) is one allocation per future, including the functor
+ * for then() and the bound call for SimpleThreadPool::submit.
+ */
+template<class T>
+class continuable_future
+{
+public:
+    continuable_future() = default;
+
+    continuable_future(continuable_future&& rhs) noexcept
+        :_state(std::exchange(rhs._state, nullptr)) {}
+
+    continuable_future& operator=(continuable_future&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            reset();
+            _state = std::exchange(rhs._state, nullptr);
+        }
+        return *this;
+    }
+
+    continuable_future(const continuable_future&) = delete;
+    continuable_future& operator=(const continuable_future&) = delete;
+
+    ~continuable_future()
+    {
+        reset();
+    }
+
+    bool valid() const
+    {
+        return _state != nullptr;
+    }
+
+    bool is_ready() const
+    {
+        return _state != nullptr && _state->is_ready();
+    }
+
+    void wait() const
+    {
+        _state->wait();
+    }
+
+    /*Blocks until ready, then returns the value or rethrows; the future is empty afterwards*/
+    T get()
+    {
+        _state->wait();
+        detail::future_state<T>* state = std::exchange(_state, nullptr);
+        struct releaser
+        {
+            detail::future_state<T>* _s;
+            ~releaser() { _s->release(); }
+        } guard{ state };
+        if constexpr (std::is_void_v<T>)
+        {
+            state->take();
+        }
+        else
+        {
+            return state->take();
+        }
+    }
+
+    /*func(T) (or func() for void) runs on this future's executor once the value is ready*/
+    template<class F>
+    auto then(F&& func)->continuable_future<detail::then_result_t<T, F>>
+    {
+        return then(_state->_executor, std::forward<F>(func));
+    }
+
+    template<class F>
+    auto then(executor_ref executor, F&& func)->continuable_future<detail::then_result_t<T, F>>
+    {
+        using Next = detail::then_state<T, std::decay_t<F>>;
+        Next* next = new Next(std::decay_t<F>(std::forward<F>(func)), std::exchange(_state, nullptr));
+        next->_executor = executor;
+        /*one reference for the returned future, one for the antecedent's continuation slot*/
+        next->add_ref();
+        next->_antecedent->attach(next);
+        return continuable_future<detail::then_result_t<T, F>>(next);
+    }
+
+private:
+    friend struct detail::future_access;
+    template<class U>
+    friend class continuable_future;
+    friend class continuable_promise<T>;
+
+    explicit continuable_future(detail::future_state<T>* state)
+        :_state(state) {}
+
+    void reset()
+    {
+        if (_state != nullptr)
+        {
+            std::exchange(_state, nullptr)->release();
+        }
+    }
+
+    detail::future_state<T>* _state = nullptr;
+};
+
+/*Producer side for results that do not come from a pool task; unsatisfied promises break their future*/
+template<class T>
+class continuable_promise
+{
+public:
+    explicit continuable_promise(executor_ref executor = executor_ref())
+        :_state(new detail::future_state<T>())
+    {
+        _state->_executor = executor;
+    }
+
+    continuable_promise(continuable_promise&& rhs) noexcept
+        :_state(std::exchange(rhs._state, nullptr)),
+        _satisfied(rhs._satisfied) {}
+
+    continuable_promise(const continuable_promise&) = delete;
+    continuable_promise& operator=(const continuable_promise&) = delete;
+    continuable_promise& operator=(continuable_promise&&) = delete;
+
+    ~continuable_promise()
+    {
+        if (_state == nullptr)
+        {
+            return;
+        }
+        if (!_satisfied)
+        {
+            _state->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        }
+        _state->release();
+    }
+
+    continuable_future<T> get_future()
+    {
+        if (_retrieved)
+        {
+            throw std::future_error(std::future_errc::future_already_retrieved);
+        }
+        _retrieved = true;
+        _state->add_ref();
+        return continuable_future<T>(_state);
+    }
+
+    template<class... A>
+    void set_value(A&&... value)
+    {
+        satisfy();
+        _state->set_value(std::forward<A>(value)...);
+    }
+
+    void set_exception(std::exception_ptr error)
+    {
+        satisfy();
+        _state->set_exception(std::move(error));
+    }
+
+private:
+    void satisfy()
+    {
+        if (_satisfied)
+        {
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+        }
+        _satisfied = true;
+    }
+
+    detail::future_state<T>* _state;
+    bool _satisfied = false;
+    bool _retrieved = false;
+};
+
+template<class Executor>
+void executor_ref::post_continuation_to(void* executor, detail::future_state_base* state)
+{
+    static_cast<Executor*>(executor)->post(detail::run_handle<detail::future_state_base>(state));
+}
+
+namespace detail
+{
+    template<class State, class R, class T>
+    continuable_future<R> start_fan_in(std::vector<continuable_future<T>>& futures)
+    {
+        State* state = new State(futures.size());
+        if (!futures.empty())
+        {
+            future_state<T>* first = future_access::peek(futures.front());
+            state->_executor = first == nullptr ? executor_ref() : first->_executor;
+        }
+        /*one reference for the returned future, one shared by the slots*/
+        state->add_ref();
+        continuable_future<R> result = future_access::make<R>(state);
+        for (size_t i = 0; i < futures.size(); ++i)
+        {
+            state->_slots[i]._parent = state;
+            state->_slots[i]._index = i;
+            state->_slots[i]._source = future_access::detach(futures[i]);
+        }
+        for (size_t i = 0; i < futures.size(); ++i)
+        {
+            state->_slots[i]._source->attach(&state->_slots[i]);
+        }
+        return result;
+    }
+}
+
+/*Ready when every input is; the values in input order, or the first failed input's exception*/
+template<class T>
+continuable_future<detail::when_all_value_t<T>> when_all(std::vector<continuable_future<T>> futures)
+{
+    using R = detail::when_all_value_t<T>;
+    if (futures.empty())
+    {
+        auto* state = new detail::future_state<R>();
+        state->set_value();
+        return detail::future_access::make<R>(state);
+    }
+    return detail::start_fan_in<detail::when_all_state<T>, R>(futures);
+}
+
+/*Ready when the first input is: its index (and value), or its exception; futures must not be empty*/
+template<class T>
+continuable_future<detail::when_any_value_t<T>> when_any(std::vector<continuable_future<T>> futures)
+{
+    if (futures.empty())
+    {
+        throw std::invalid_argument("when_any of no futures");
+    }
+    return detail::start_fan_in<detail::when_any_state<T>, detail::when_any_value_t<T>>(futures);
+}
+
+THREADSAFT_CONTAINER_END
+
+#endif //!__CONTINUABLE_FUTURE_H__
@@ -0,0 +1,223 @@
+#pragma once
+
+#ifndef __CPU_TOPOLOGY_H__
+#define __CPU_TOPOLOGY_H__
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "base_def.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+THREADSAFT_CONTAINER_BEGIN
+
+enum class AffinityPolicy
+{
+    NONE = 0,       /*workers float, the scheduler places them*/
+    COMPACT = 1,    /*fill node 0's cpus first, then node 1, ...*/
+    SCATTER = 2,    /*round-robin across nodes: worker 0 on node 0, worker 1 on node 1, ...*/
+    CORE_LIST = 3   /*worker i on the i-th entry of an explicit cpu list (wrapping)*/
+};
+
+/*
+ * Which cpus belong to which NUMA node. detect() reads /sys/devices/system/node on linux and falls
+ * back to one node holding every cpu; emulate() builds an arbitrary layout so node-aware code can be
+ * exercised on a single-node machine (pinning to cpus that do not exist simply fails).
+ */
+class cpu_topology
+{
+public:
+    cpu_topology() = default;
+
+    explicit cpu_topology(std::vector<std::vector<int>> nodes)
+        :_nodes(std::move(nodes))
+    {
+        _nodes.erase(std::remove_if(_nodes.begin(), _nodes.end(), [](const std::vector<int>& cpus) { return cpus.empty(); }), _nodes.end());
+        if (_nodes.empty())
+        {
+            _nodes.push_back({ 0 });
+        }
+        for (size_t node = 0; node < _nodes.size(); ++node)
+        {
+            for (int cpu : _nodes[node])
+            {
+                if (cpu >= static_cast<int>(_nodeOfCpu.size()))
+                {
+                    _nodeOfCpu.resize(cpu + 1, 0);
+                }
+                _nodeOfCpu[cpu] = node;
+            }
+        }
+    }
+
+    static cpu_topology detect()
+    {
+        std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+        for (int node = 0; ; ++node)
+        {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if (!in || !std::getline(in, list))
+            {
+                break;
+            }
+            nodes.push_back(parse_cpu_list(list));
+        }
+#endif
+        if (nodes.empty())
+        {
+            std::vector<int> cpus;
+            for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+            {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+            nodes.push_back(std::move(cpus));
+        }
+        return cpu_topology(std::move(nodes));
+    }
+
+    /*nodeCount nodes of cpusPerNode consecutive cpu ids each*/
+    static cpu_topology emulate(size_t nodeCount, size_t cpusPerNode)
+    {
+        std::vector<std::vector<int>> nodes(std::max<size_t>(1, nodeCount));
+        int cpu = 0;
+        for (auto& cpus : nodes)
+        {
+            for (size_t i = 0; i < std::max<size_t>(1, cpusPerNode); ++i)
+            {
+                cpus.push_back(cpu++);
+            }
+        }
+        return cpu_topology(std::move(nodes));
+    }
+
+    /*"0-3,8,10-11" as found in sysfs cpulist files*/
+    static std::vector<int> parse_cpu_list(const std::string& list)
+    {
+        std::vector<int> cpus;
+        size_t posi = 0;
+        while (posi < list.size())
+        {
+            size_t comma = list.find(',', posi);
+            std::string range = list.substr(posi, comma == std::string::npos ? std::string::npos : comma - posi);
+            size_t dash = range.find('-');
+            if (!range.empty() && range[0] >= '0' && range[0] <= '9')
+            {
+                int first = std::atoi(range.c_str());
+                int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+                for (int cpu = first; cpu <= last; ++cpu)
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+            if (comma == std::string::npos)
+            {
+                break;
+            }
+            posi = comma + 1;
+        }
+        return cpus;
+    }
+
+    size_t node_count() const
+    {
+        return _nodes.size();
+    }
+
+    const std::vector<int>& cpus_of(size_t node) const
+    {
+        return _nodes[node];
+    }
+
+    /*Cpus outside the topology (e.g. real cpu ids under an emulated one) wrap around onto it*/
+    size_t node_of_cpu(int cpu) const
+    {
+        if (cpu < 0 || _nodeOfCpu.empty())
+        {
+            return 0;
+        }
+        return _nodeOfCpu[static_cast<size_t>(cpu) % _nodeOfCpu.size()];
+    }
+
+    /*The cpu for each worker slot under policy; empty for NONE*/
+    std::vector<int> placement(AffinityPolicy policy, const std::vector<int>& coreList = {}) const
+    {
+        std::vector<int> order;
+        switch (policy)
+        {
+        case AffinityPolicy::COMPACT:
+            for (const auto& cpus : _nodes)
+            {
+                order.insert(order.end(), cpus.begin(), cpus.end());
+            }
+            break;
+        case AffinityPolicy::SCATTER:
+            for (size_t i = 0; ; ++i)
+            {
+                bool any = false;
+                for (const auto& cpus : _nodes)
+                {
+                    if (i < cpus.size())
+                    {
+                        order.push_back(cpus[i]);
+                        any = true;
+                    }
+                }
+                if (!any)
+                {
+                    break;
+                }
+            }
+            break;
+        case AffinityPolicy::CORE_LIST:
+            order = coreList;
+            break;
+        default:
+            break;
+        }
+        return order;
+    }
+
+    /*Node of the cpu the calling thread is running on right now*/
+    size_t current_node() const
+    {
+#ifdef __linux__
+        return node_of_cpu(sched_getcpu());
+#else
+        return 0;
+#endif
+    }
+
+    static bool pin_current_thread(int cpu)
+    {
+#ifdef __linux__
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+
+private:
+    std::vector<std::vector<int>> _nodes;
+    std::vector<size_t> _nodeOfCpu;
+};
+
+THREADSAFT_CONTAINER_END
+
+#endif //!__CPU_TOPOLOGY_H__
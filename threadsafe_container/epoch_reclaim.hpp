@@ -0,0 +1,230 @@
+#pragma once
+
+#ifndef __EPOCH_RECLAIM_H__
+#define __EPOCH_RECLAIM_H__
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "base_def.h"
+
+THREADSAFT_CONTAINER_BEGIN
+
+/*
+ * Epoch-based reclamation for containers whose readers take no locks. A reader holds an
+ * epoch_domain::guard while it dereferences shared nodes; a writer that unlinks a node retires it
+ * instead of deleting it, and the node is freed once every thread has left the epoch in which it
+ * could still have been reachable (two global epoch advances later).
+ *
+ * One process-wide domain; each thread claims a record on first use and hands it back, together
+ * with anything it retired but could not free yet, when it exits.
+ */
+class epoch_domain
+{
+    struct record;
+
+public:
+    static epoch_domain& instance()
+    {
+        static epoch_domain domain;
+        return domain;
+    }
+
+    class guard
+    {
+    public:
+        guard()
+            :_record(instance().local_record())
+        {
+            if (_record->_nesting++ == 0)
+            {
+                _record->_epoch.store(instance()._global.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                /*the announcement must be visible before any shared pointer is read*/
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+        ~guard()
+        {
+            if (--_record->_nesting == 0)
+            {
+                _record->_epoch.store(IDLE, std::memory_order_release);
+            }
+        }
+
+    private:
+        record* _record;
+    };
+
+    /*p must already be unreachable for threads that enter a guard from now on*/
+    void retire(void* p, void (*deleter)(void*))
+    {
+        record* r = local_record();
+        r->_retired.push_back(retired{ p, deleter, _global.load(std::memory_order_relaxed) });
+        if (r->_retired.size() >= RECLAIM_BATCH)
+        {
+            reclaim(*r);
+        }
+    }
+
+    template<class T>
+    void retire(T* p)
+    {
+        retire(p, [](void* q) { delete static_cast<T*>(q); });
+    }
+
+    ~epoch_domain()
+    {
+        /*static destruction: no thread is inside a guard any more*/
+        free_all(_orphans);
+        for (record* r = _records.load(); r != nullptr; )
+        {
+            record* next = r->_next;
+            free_all(r->_retired);
+            delete r;
+            r = next;
+        }
+    }
+
+private:
+    static constexpr std::uint64_t IDLE = UINT64_MAX;
+    static constexpr size_t RECLAIM_BATCH = 64;
+
+    struct retired
+    {
+        void* _p;
+        void (*_deleter)(void*);
+        std::uint64_t _epoch;
+    };
+
+    struct alignas(64) record
+    {
+        std::atomic<std::uint64_t> _epoch{ IDLE };
+        std::atomic<bool> _inUse{ true };
+        record* _next = nullptr;
+        /*owner-thread only*/
+        unsigned _nesting = 0;
+        std::vector<retired> _retired;
+    };
+
+    epoch_domain() = default;
+
+    /*Returns the thread's record to the domain at thread exit*/
+    struct local_holder
+    {
+        record* _record = nullptr;
+
+        ~local_holder()
+        {
+            if (_record != nullptr)
+            {
+                instance().release_record(_record);
+            }
+        }
+    };
+
+    record* local_record()
+    {
+        static thread_local local_holder holder;
+        if (holder._record == nullptr)
+        {
+            holder._record = acquire_record();
+        }
+        return holder._record;
+    }
+
+    record* acquire_record()
+    {
+        for (record* r = _records.load(std::memory_order_acquire); r != nullptr; r = r->_next)
+        {
+            bool expected = false;
+            if (!r->_inUse.load(std::memory_order_relaxed) && r->_inUse.compare_exchange_strong(expected, true))
+            {
+                return r;
+            }
+        }
+        record* r = new record();
+        r->_next = _records.load(std::memory_order_relaxed);
+        while (!_records.compare_exchange_weak(r->_next, r))
+        {
+        }
+        return r;
+    }
+
+    void release_record(record* r)
+    {
+        reclaim(*r);
+        if (!r->_retired.empty())
+        {
+            std::lock_guard<std::mutex> lock(_orphansMutex);
+            _orphans.insert(_orphans.end(), r->_retired.begin(), r->_retired.end());
+        }
+        r->_retired.clear();
+        r->_retired.shrink_to_fit();
+        r->_inUse.store(false, std::memory_order_release);
+    }
+
+    /*Advances the global epoch if every active thread has caught up, then frees what is two epochs old*/
+    void reclaim(record& self)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::uint64_t global = _global.load();
+        bool caughtUp = true;
+        for (record* r = _records.load(std::memory_order_acquire); r != nullptr && caughtUp; r = r->_next)
+        {
+            std::uint64_t epoch = r->_epoch.load(std::memory_order_acquire);
+            caughtUp = epoch == IDLE || epoch == global;
+        }
+        if (caughtUp)
+        {
+            _global.compare_exchange_strong(global, global + 1);
+        }
+        std::uint64_t safe = _global.load();
+        free_older(self._retired, safe);
+        std::unique_lock<std::mutex> lock(_orphansMutex, std::try_to_lock);
+        if (lock.owns_lock())
+        {
+            free_older(_orphans, safe);
+        }
+    }
+
+    static void free_older(std::vector<retired>& list, std::uint64_t safe)
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < list.size(); ++i)
+        {
+            if (list[i]._epoch + 2 <= safe)
+            {
+                list[i]._deleter(list[i]._p);
+            }
+            else
+            {
+                list[kept++] = list[i];
+            }
+        }
+        list.resize(kept);
+    }
+
+    static void free_all(std::vector<retired>& list)
+    {
+        for (auto& item : list)
+        {
+            item._deleter(item._p);
+        }
+        list.clear();
+    }
+
+private:
+    std::atomic<std::uint64_t> _global{ 1 };
+    std::atomic<record*> _records{ nullptr };
+    std::mutex _orphansMutex;
+    std::vector<retired> _orphans;
+};
+
+THREADSAFT_CONTAINER_END
+
+#endif //!__EPOCH_RECLAIM_H__
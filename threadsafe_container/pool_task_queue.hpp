@@ -0,0 +1,373 @@
+#pragma once
+
+#ifndef __POOL_TASK_QUEUE_H__
+#define __POOL_TASK_QUEUE_H__
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "base_def.h"
+
+THREADSAFT_CONTAINER_BEGIN
+
+enum class TaskPriority
+{
+    HIGH = 0,
+    NORMAL = 1,
+    LOW = 2
+};
+
+enum class SchedulingPolicy
+{
+    /*strict priority levels with aging; explicit deadlines run ahead of HIGH, earliest first*/
+    PRIORITY = 0,
+    /*one queue ordered by deadline; priority-only tasks get enqueue time + the level's budget*/
+    EARLIEST_DEADLINE_FIRST = 1
+};
+
+enum class QueueStatus
+{
+    POPPED = 0,
+    TIMEOUT = 1,
+    STOPPED = 2,
+    /*woken by kick() with nothing queued here, e.g. to steal from another queue*/
+    KICKED = 3
+};
+
+struct SchedulingOptions
+{
+    SchedulingPolicy _policy = SchedulingPolicy::PRIORITY;
+    /*PRIORITY: every full threshold a task has waited raises it one level*/
+    std::chrono::microseconds _agingThreshold{ 20000 };
+    /*EARLIEST_DEADLINE_FIRST: implicit deadline per level, indexed by TaskPriority*/
+    std::array<std::chrono::microseconds, 3> _latencyBudget{ { std::chrono::microseconds{ 1000 },
+                                                              std::chrono::microseconds{ 20000 },
+                                                              std::chrono::microseconds{ 200000 } } };
+};
+
+/*
+ * The run queue behind SimpleThreadPool: one FIFO per priority level plus a deadline heap, all
+ * under one mutex so a pop can compare heads across levels. Under PRIORITY the effective level of a
+ * task is its level minus the number of aging thresholds it has waited, so low-priority work is
+ * delayed by at most a few thresholds however much high-priority work arrives.
+ */
+class pool_task_queue
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Task = std::function<void()>;
+    static constexpr size_t LEVELS = 3;
+
+    explicit pool_task_queue(const SchedulingOptions& options = SchedulingOptions())
+        :_options(options)
+    {
+    }
+
+    pool_task_queue(const pool_task_queue&) = delete;
+    pool_task_queue& operator=(const pool_task_queue&) = delete;
+
+    /*
+     * Returns false, dropping task, once the queue is stopped. A task still running on the queue's
+     * own workers may pass fromWorker to queue a follow-up while the queue drains; that is refused
+     * only after clear().
+     */
+    bool push(Task task, TaskPriority priority = TaskPriority::NORMAL, bool fromWorker = false)
+    {
+        Clock::time_point now = Clock::now();
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            if (!accepts_locked(fromWorker))
+            {
+                return false;
+            }
+            size_t level = static_cast<size_t>(priority);
+            if (_options._policy == SchedulingPolicy::EARLIEST_DEADLINE_FIRST)
+            {
+                push_deadline_locked(std::move(task), now, now + _options._latencyBudget[level]);
+            }
+            else
+            {
+                _levels[level].push_back(Entry{ std::move(task), now, now, _seq++ });
+            }
+            ++_size;
+            wake = _waiting != 0;
+        }
+        if (wake)
+        {
+            _cv.notify_one();
+        }
+        return true;
+    }
+
+    bool push(Task task, Clock::time_point deadline, bool fromWorker = false)
+    {
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            if (!accepts_locked(fromWorker))
+            {
+                return false;
+            }
+            push_deadline_locked(std::move(task), Clock::now(), deadline);
+            ++_size;
+            wake = _waiting != 0;
+        }
+        if (wake)
+        {
+            _cv.notify_one();
+        }
+        return true;
+    }
+
+    bool try_pop(Task& task)
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        return pop_locked(task);
+    }
+
+    /*Blocks until a task is available; returns false once stopped and drained*/
+    bool wait_and_pop(Task& task)
+    {
+        std::unique_lock<std::mutex> lock(_m);
+        ++_waiting;
+        _cv.wait(lock, [this]() { return _size != 0 || _stopped; });
+        --_waiting;
+        return pop_locked(task);
+    }
+
+    /*
+     * Waits at most timeout for a task (Clock::duration::max() waits forever). onWait runs under the
+     * queue lock right before the caller blocks, so "went to sleep" is observed without a race.
+     */
+    template<class OnWait>
+    QueueStatus wait_and_pop_for(Task& task, Clock::duration timeout, OnWait onWait)
+    {
+        std::unique_lock<std::mutex> lock(_m);
+        bool kicked = false;
+        if (_size == 0 && !_stopped)
+        {
+            onWait();
+            ++_waiting;
+            auto ready = [this]() { return _size != 0 || _stopped || _kicks != 0; };
+            if (timeout == Clock::duration::max())
+            {
+                _cv.wait(lock, ready);
+            }
+            else
+            {
+                _cv.wait_for(lock, timeout, ready);
+            }
+            --_waiting;
+            if (_kicks != 0)
+            {
+                --_kicks;
+                kicked = true;
+            }
+        }
+        if (pop_locked(task))
+        {
+            return QueueStatus::POPPED;
+        }
+        if (_stopped)
+        {
+            return QueueStatus::STOPPED;
+        }
+        return kicked ? QueueStatus::KICKED : QueueStatus::TIMEOUT;
+    }
+
+    /*Wakes one blocked waiter even though nothing was pushed here; false if nobody is blocked*/
+    bool kick()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            if (_waiting <= _kicks)
+            {
+                return false;
+            }
+            ++_kicks;
+        }
+        _cv.notify_one();
+        return true;
+    }
+
+    /*Rejects further pushes and wakes every waiter; queued tasks are still handed out until none are left*/
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _stopped = true;
+        }
+        _cv.notify_all();
+    }
+
+    /*
+     * Drops every queued task and returns how many there were; they are destroyed outside the lock.
+     * On a stopped queue this also ends the follow-ups allowed by push(fromWorker).
+     */
+    size_t clear()
+    {
+        std::array<std::deque<Entry>, LEVELS> levels;
+        std::vector<Entry> deadlines;
+        size_t dropped = 0;
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            levels.swap(_levels);
+            deadlines.swap(_deadlines);
+            dropped = _size;
+            _size = 0;
+            _cleared = _stopped;
+        }
+        return dropped;
+    }
+
+    /*How long the oldest queued task has waited; zero when empty*/
+    Clock::duration oldest_wait() const
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        Clock::time_point oldest = Clock::time_point::max();
+        for (const auto& level : _levels)
+        {
+            if (!level.empty())
+            {
+                oldest = std::min(oldest, level.front()._enqueued);
+            }
+        }
+        if (!_deadlines.empty())
+        {
+            /*the heap top is the next deadline task to run, close enough to the oldest one*/
+            oldest = std::min(oldest, _deadlines.front()._enqueued);
+        }
+        return oldest == Clock::time_point::max() ? Clock::duration::zero() : Clock::now() - oldest;
+    }
+
+    /*Callers blocked in wait_and_pop(_for) right now*/
+    size_t waiting() const
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        return _waiting;
+    }
+
+    bool empty() const
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        return _size == 0;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        return _size;
+    }
+
+private:
+    struct Entry
+    {
+        Task _task;
+        Clock::time_point _enqueued;
+        Clock::time_point _deadline;
+        std::uint64_t _seq;
+    };
+
+    /*max-heap comparator that puts the earliest deadline on top, FIFO among equal deadlines*/
+    struct LaterDeadline
+    {
+        bool operator()(const Entry& lhs, const Entry& rhs) const
+        {
+            return lhs._deadline != rhs._deadline ? lhs._deadline > rhs._deadline : lhs._seq > rhs._seq;
+        }
+    };
+
+    void push_deadline_locked(Task task, Clock::time_point now, Clock::time_point deadline)
+    {
+        _deadlines.push_back(Entry{ std::move(task), now, deadline, _seq++ });
+        std::push_heap(_deadlines.begin(), _deadlines.end(), LaterDeadline());
+    }
+
+    /*Deadline tasks count as level -1; aging subtracts one level per threshold waited*/
+    long long effective_level(long long level, const Entry& entry, Clock::time_point now) const
+    {
+        if (_options._agingThreshold.count() <= 0)
+        {
+            return level;
+        }
+        return level - (now - entry._enqueued) / _options._agingThreshold;
+    }
+
+    bool accepts_locked(bool fromWorker) const
+    {
+        return !_stopped || (fromWorker && !_cleared);
+    }
+
+    bool pop_locked(Task& task)
+    {
+        if (_size == 0)
+        {
+            return false;
+        }
+        Clock::time_point now = Clock::now();
+        const Entry* best = nullptr;
+        long long bestLevel = 0;
+        int bestSource = -1;
+        if (!_deadlines.empty())
+        {
+            best = &_deadlines.front();
+            bestLevel = effective_level(-1, *best, now);
+        }
+        for (size_t i = 0; i < LEVELS; ++i)
+        {
+            if (_levels[i].empty())
+            {
+                continue;
+            }
+            const Entry& head = _levels[i].front();
+            long long level = effective_level(static_cast<long long>(i), head, now);
+            /*equal effective levels go to whichever task has waited longer*/
+            if (best == nullptr || level < bestLevel || (level == bestLevel && head._enqueued < best->_enqueued))
+            {
+                best = &head;
+                bestLevel = level;
+                bestSource = static_cast<int>(i);
+            }
+        }
+        if (bestSource < 0)
+        {
+            std::pop_heap(_deadlines.begin(), _deadlines.end(), LaterDeadline());
+            task = std::move(_deadlines.back()._task);
+            _deadlines.pop_back();
+        }
+        else
+        {
+            task = std::move(_levels[bestSource].front()._task);
+            _levels[bestSource].pop_front();
+        }
+        --_size;
+        return true;
+    }
+
+private:
+    const SchedulingOptions _options;
+    mutable std::mutex _m;
+    std::condition_variable _cv;
+    std::array<std::deque<Entry>, LEVELS> _levels;
+    std::vector<Entry> _deadlines;
+    size_t _size = 0;
+    /*workers inside wait_and_pop; pushes skip notify_one when nobody sleeps*/
+    size_t _waiting = 0;
+    /*kick() wake-ups not yet consumed by a waiter*/
+    size_t _kicks = 0;
+    std::uint64_t _seq = 0;
+    bool _stopped = false;
+    /*cleared after stop(): the queued work was discarded, so no follow-ups either*/
+    bool _cleared = false;
+};
+
+THREADSAFT_CONTAINER_END
+
+#endif //!__POOL_TASK_QUEUE_H__
@@ -3,91 +3,630 @@
 #define __SIMPLE_THREAD_POOL_H__
 
 #include <iostream>
+#include "base_def.h"
 #include "my_algorithm.hpp"
 #include <random>
 #include <ctime>
 #include "threadsafe_stack.hpp"
 #include "threadsafe_queue.hpp"
+#include "pool_task_queue.hpp"
+#include "timer_wheel.hpp"
+#include "cpu_topology.hpp"
+#include "continuable_future.hpp"
 #include <chrono>
+#include <exception>
+#include <functional>
 #include <future>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include "container_metrics.hpp"
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#endif
 
 
 class SimpleThreadPool
 {
 public:
+    using TaskPriority = threadsafe_container::TaskPriority;
+    using Clock = threadsafe_container::pool_task_queue::Clock;
+
+    /*
+     * The pool keeps _minThreads workers. While the oldest queued task has waited longer than
+     * _growThreshold it adds workers up to _maxThreads; workers beyond _minThreads retire after
+     * _idleTimeout without work.
+     */
+    struct Options
+    {
+        size_t _minThreads = 1;
+        size_t _maxThreads = 1;
+        std::chrono::microseconds _growThreshold{ 5000 };
+        std::chrono::milliseconds _idleTimeout{ 30000 };
+        threadsafe_container::SchedulingOptions _scheduling;
+
+        /*Worker i is pinned to the i-th cpu of the placement; NONE leaves workers unpinned*/
+        threadsafe_container::AffinityPolicy _affinity = threadsafe_container::AffinityPolicy::NONE;
+        std::vector<int> _cores;
+        /*
+         * One run queue per NUMA node: a worker serves its node's queue and steals from the others
+         * only when that is empty, and enqueuers push to the queue of the node they run on.
+         */
+        bool _perNodeQueues = false;
+        /*detected from sysfs when left empty; cpu_topology::emulate() for testing*/
+        threadsafe_container::cpu_topology _topology;
+
+        /*
+         * Gets the exception of a posted task that threw, on the worker that ran it; the worker then
+         * carries on. Unset, the exception is written to std::cerr. enqueue/submit tasks never get here:
+         * their exceptions go to the future. Must not throw.
+         */
+        std::function<void(std::exception_ptr)> _onTaskError;
+    };
+
     SimpleThreadPool(size_t threadSize = 1);
+    SimpleThreadPool(size_t threadSize, const threadsafe_container::SchedulingOptions& scheduling);
+    explicit SimpleThreadPool(const Options& options);
     ~SimpleThreadPool();
     template<class F, class... Args>
     auto enqueue(F&& f, Args&&... args)->std::future<decltype(f(args...))>;
 
+    /*Runs ahead of lower classes; waiting tasks age upwards so LOW work is never starved*/
+    template<class F, class... Args>
+    auto enqueue(TaskPriority priority, F&& f, Args&&... args)->std::future<decltype(f(args...))>;
+
+    /*Deadline tasks are served earliest-deadline-first, ahead of the priority classes*/
+    template<class F, class... Args>
+    auto enqueue(Clock::time_point deadline, F&& f, Args&&... args)->std::future<decltype(f(args...))>;
+
+    /*
+     * Like enqueue, but returns a continuable_future: the bound call and its result share one
+     * allocation, and then()/when_all()/when_any() continuations run on this pool.
+     */
+    template<class F, class... Args>
+    auto submit(F&& f, Args&&... args)->threadsafe_container::continuable_future<decltype(f(args...))>;
+
+    template<class F, class... Args>
+    auto submit(TaskPriority priority, F&& f, Args&&... args)->threadsafe_container::continuable_future<decltype(f(args...))>;
+
+    /*Fire-and-forget: no packaged_task and no future, for callers that track completion themselves*/
+    template<class F>
+    void post(F&& f, TaskPriority priority = TaskPriority::NORMAL);
+
+#ifdef __cpp_impl_coroutine
+    /*co_await pool.schedule() continues the coroutine on a worker; throws like post() once stopped*/
+    auto schedule(TaskPriority priority = TaskPriority::NORMAL)
+    {
+        struct awaiter
+        {
+            SimpleThreadPool& _pool;
+            TaskPriority _priority;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                _pool.post([handle]() { handle.resume(); }, _priority);
+            }
+
+            void await_resume() const noexcept {}
+        };
+        return awaiter{ *this, priority };
+    }
+#endif
+
+    /*Timed tasks: the pool's timer thread posts them into the run queue when they fall due*/
+    using TimerHandle = threadsafe_container::timer_handle;
+
+    template<class Rep, class Period, class F>
+    TimerHandle schedule_after(std::chrono::duration<Rep, Period> delay, F&& f, TaskPriority priority = TaskPriority::NORMAL);
+
+    template<class F>
+    TimerHandle schedule_at(Clock::time_point when, F&& f, TaskPriority priority = TaskPriority::NORMAL);
+
+    /*First run after one period; a run that is still going does not delay the next one*/
+    template<class Rep, class Period, class F>
+    TimerHandle schedule_every(std::chrono::duration<Rep, Period> period, F&& f, TaskPriority priority = TaskPriority::NORMAL);
+
+    /*False if the task already fell due; it may then still be queued or running*/
+    bool cancel(TimerHandle handle);
+
+    /*
+     * Both stop the pool for good: pending timers are dropped and enqueue/post throw
+     * std::runtime_error from then on. drain() runs every queued task before joining the workers,
+     * including follow-ups that those tasks still queue from the workers; shutdown_now() discards
+     * the queued tasks, whose futures then throw std::future_error (broken_promise), returns how
+     * many were discarded and refuses follow-ups. Running tasks always finish.
+     * Neither may be called from a task running on this pool.
+     */
+    void drain();
+    size_t shutdown_now();
+    /*Same as drain()*/
     void join_all();
+
+    size_t thread_count() const
+    {
+        return _liveWorkers.load(std::memory_order_relaxed);
+    }
+
+    const metrics::container_metrics_t& get_metrics() const
+    {
+        return _metrics;
+    }
 private:
+    static Options fixed_size_options(size_t threadSize, const threadsafe_container::SchedulingOptions& scheduling);
+    void start_workers(size_t threadSize);
+    void add_worker_locked();
+    void worker_loop();
+    void grow_if_backlogged();
+    void stop_and_join(bool discardQueued, size_t& discarded);
+
+    template<class Key>
+    void push_task(std::function<void()> task, Key key);
+    size_t local_queue() const;
+    bool steal(std::function<void()>& task, size_t node);
+
+    struct WorkerContext
+    {
+        const SimpleThreadPool* _pool = nullptr;
+        size_t _node = 0;
+    };
+
+    static WorkerContext& worker_context()
+    {
+        static thread_local WorkerContext context;
+        return context;
+    }
+
+    template<class F>
+    std::function<void()> wrap_task(F&& f);
+    void report_task_error(std::exception_ptr error) const noexcept;
+
+    template<class F>
+    std::function<void()> make_timer_callback(F&& f, TaskPriority priority)
+    {
+        return [this, task = std::function<void()>(std::forward<F>(f)), priority]() { post(task, priority); };
+    }
+
+    template<class F, class... Args>
+    static auto make_task(F&& f, Args&&... args)
+    {
+        using returnType = decltype(f(args...));
+        return std::make_shared<std::packaged_task<returnType()>>(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+    }
+
+private:
+    const Options _options;
+    std::mutex _workersMutex;
     std::vector<std::thread> _workThreads;
-    threadsafe_queue<std::function<void()>> _tasks;
-    std::mutex _threadPoolLock;
-    std::condition_variable _threadPoolCv;
+    /*threads of retired workers, joined on the next grow or at shutdown*/
+    std::vector<std::thread> _retiredThreads;
+    std::atomic<size_t> _liveWorkers{ 0 };
+    /*workers ever started; picks the next worker's cpu and node*/
+    size_t _workerSlots = 0;
+    const threadsafe_container::cpu_topology _topology;
+    const std::vector<int> _placement;
+    std::vector<std::unique_ptr<threadsafe_container::pool_task_queue>> _queues;
     std::atomic<bool> _end = false;
+    metrics::container_metrics_t _metrics;
+    /*starts its thread on the first schedule_* call*/
+    threadsafe_container::timer_wheel _timers;
 };
 
-SimpleThreadPool::SimpleThreadPool(size_t threadSize)
+inline SimpleThreadPool::SimpleThreadPool(size_t threadSize)
+    :SimpleThreadPool(threadSize, threadsafe_container::SchedulingOptions())
 {
+}
+
+inline SimpleThreadPool::SimpleThreadPool(size_t threadSize, const threadsafe_container::SchedulingOptions& scheduling)
+    :SimpleThreadPool(fixed_size_options(threadSize, scheduling))
+{
+}
+
+inline SimpleThreadPool::Options SimpleThreadPool::fixed_size_options(size_t threadSize, const threadsafe_container::SchedulingOptions& scheduling)
+{
+    Options options;
+    options._minThreads = threadSize;
+    options._maxThreads = threadSize;
+    options._scheduling = scheduling;
+    return options;
+}
+
+inline SimpleThreadPool::SimpleThreadPool(const Options& options)
+    :_options(options),
+    _topology(options._topology.node_count() != 0 ? options._topology : threadsafe_container::cpu_topology::detect()),
+    _placement(_topology.placement(options._affinity, options._cores))
+{
+    size_t queueCount = _options._perNodeQueues ? _topology.node_count() : 1;
+    for (size_t i = 0; i < queueCount; ++i)
+    {
+        _queues.push_back(std::make_unique<threadsafe_container::pool_task_queue>(_options._scheduling));
+    }
+    start_workers(_options._minThreads);
+    if (_options._maxThreads > _options._minThreads)
+    {
+        auto period = std::max<std::chrono::microseconds>(_options._growThreshold / 2, std::chrono::milliseconds(1));
+        _timers.schedule_every(period, [this]() { grow_if_backlogged(); });
+    }
+}
+
+inline void SimpleThreadPool::start_workers(size_t threadSize)
+{
+    std::lock_guard<std::mutex> lock(_workersMutex);
     for (size_t i = 0; i < threadSize; ++i)
     {
-        _workThreads.emplace_back(
-            [this] () {
-                while (true)
-                {
-                    std::shared_ptr<std::function<void()>> task;
-                    {
-                        std::unique_lock<std::mutex> lock(this->_threadPoolLock);
-                        this->_threadPoolCv.wait(lock, [this]() { return !this->_tasks.empty() || this->_end; });
-                    }
-                    if (this->_end && this->_tasks.empty())
-                        return;
-                    if (task = this->_tasks.wait_and_pop())
-                    {
-                        (*task)();
-                    }
-                }
+        add_worker_locked();
+    }
+}
+
+inline void SimpleThreadPool::add_worker_locked()
+{
+    size_t slot = _workerSlots++;
+    int cpu = _placement.empty() ? -1 : _placement[slot % _placement.size()];
+    size_t node = 0;
+    if (_queues.size() > 1)
+    {
+        node = (cpu >= 0 ? _topology.node_of_cpu(cpu) : slot) % _queues.size();
+    }
+    ++_liveWorkers;
+    _workThreads.emplace_back([this, cpu, node]() {
+        if (cpu >= 0)
+        {
+            /*best effort: fails for cpus that only exist in an emulated topology*/
+            threadsafe_container::cpu_topology::pin_current_thread(cpu);
+        }
+        worker_context() = WorkerContext{ this, node };
+        worker_loop();
+        worker_context() = WorkerContext{};
+    });
+}
+
+inline void SimpleThreadPool::worker_loop()
+{
+    using threadsafe_container::QueueStatus;
+    const size_t node = worker_context()._node;
+    threadsafe_container::pool_task_queue& local = *_queues[node];
+    const bool stealing = _queues.size() > 1;
+    std::function<void()> task;
+    while (true)
+    {
+        if (stealing)
+        {
+            bool found = local.try_pop(task);
+            if (!found && steal(task, node))
+            {
+                /*the victim is probably backlogged: let an idle sibling on this node look as well*/
+                local.kick();
+                found = true;
+            }
+            if (found)
+            {
+                _metrics.on_pop();
+                task();
+                task = nullptr;
+                continue;
+            }
+        }
+        auto idleTimeout = _liveWorkers.load() > _options._minThreads
+            ? std::chrono::duration_cast<Clock::duration>(_options._idleTimeout) : Clock::duration::max();
+        QueueStatus status = local.wait_and_pop_for(task, idleTimeout, [this]() { _metrics.on_park(); });
+        if (status == QueueStatus::KICKED)
+        {
+            continue;
+        }
+        if (status == QueueStatus::STOPPED)
+        {
+            /*
+             * drain() must also finish what is left on the other nodes' queues. A stolen task's
+             * follow-ups land on this worker's own queue, so that is checked again every time.
+             */
+            while (local.try_pop(task) || steal(task, node))
+            {
+                _metrics.on_pop();
+                task();
+                task = nullptr;
+            }
+            --_liveWorkers;
+            return;
+        }
+        if (status == QueueStatus::TIMEOUT)
+        {
+            size_t live = _liveWorkers.load();
+            while (live > _options._minThreads && !_liveWorkers.compare_exchange_weak(live, live - 1))
+            {
+            }
+            if (live <= _options._minThreads)
+            {
+                continue;
             }
-        );
+            /*a thread cannot join itself, so it parks its handle for whoever grows or stops the pool next*/
+            std::lock_guard<std::mutex> lock(_workersMutex);
+            auto self = std::find_if(_workThreads.begin(), _workThreads.end(),
+                [](const std::thread& t) { return t.get_id() == std::this_thread::get_id(); });
+            if (self != _workThreads.end())
+            {
+                _retiredThreads.push_back(std::move(*self));
+                _workThreads.erase(self);
+            }
+            return;
+        }
+        _metrics.on_pop();
+        task();
+        task = nullptr;
     }
 }
 
+/*Runs on the timer thread; one worker per check keeps a short burst from spawning the maximum*/
+inline void SimpleThreadPool::grow_if_backlogged()
+{
+    if (_liveWorkers.load() >= _options._maxThreads)
+    {
+        return;
+    }
+    Clock::duration oldestWait = Clock::duration::zero();
+    for (const auto& queue : _queues)
+    {
+        oldestWait = std::max(oldestWait, queue->oldest_wait());
+    }
+    if (oldestWait < _options._growThreshold)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_workersMutex);
+    if (_end || _liveWorkers.load() >= _options._maxThreads)
+    {
+        return;
+    }
+    for (auto& retired : _retiredThreads)
+    {
+        retired.join();
+    }
+    _retiredThreads.clear();
+    add_worker_locked();
+}
+
 template<class F, class... Args>
 auto SimpleThreadPool::enqueue(F&& f, Args&&... args)->std::future<decltype(f(args...))>
+{
+    return enqueue(TaskPriority::NORMAL, std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+template<class F, class... Args>
+auto SimpleThreadPool::enqueue(TaskPriority priority, F&& f, Args&&... args)->std::future<decltype(f(args...))>
+{
+    auto currentTask = make_task(std::forward<F>(f), std::forward<Args>(args)...);
+    auto res = currentTask->get_future();
+    post([currentTask]() { (*currentTask)(); }, priority);
+    return res;
+}
+
+template<class F, class... Args>
+auto SimpleThreadPool::enqueue(Clock::time_point deadline, F&& f, Args&&... args)->std::future<decltype(f(args...))>
+{
+    auto currentTask = make_task(std::forward<F>(f), std::forward<Args>(args)...);
+    auto res = currentTask->get_future();
+    push_task(wrap_task([currentTask]() { (*currentTask)(); }), deadline);
+    return res;
+}
+
+template<class F, class... Args>
+auto SimpleThreadPool::submit(F&& f, Args&&... args)->threadsafe_container::continuable_future<decltype(f(args...))>
+{
+    return submit(TaskPriority::NORMAL, std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+template<class F, class... Args>
+auto SimpleThreadPool::submit(TaskPriority priority, F&& f, Args&&... args)->threadsafe_container::continuable_future<decltype(f(args...))>
 {
     using returnType = decltype(f(args...));
+    auto bound = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+    using State = threadsafe_container::detail::task_state<returnType, decltype(bound)>;
+    State* state = new State(std::move(bound));
+    state->_executor = *this;
+    auto res = threadsafe_container::detail::future_access::make<returnType>(state);
+    post(threadsafe_container::detail::run_handle<State>(state), priority);
+    return res;
+}
+
+template<class F>
+void SimpleThreadPool::post(F&& f, TaskPriority priority)
+{
+    push_task(wrap_task(std::forward<F>(f)), priority);
+}
 
-    auto currentTask = std::make_shared<std::packaged_task<returnType()>>(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-    std::future<returnType> res = currentTask->get_future();
+/*Key is a TaskPriority or a deadline, whichever pool_task_queue::push overload applies*/
+template<class Key>
+void SimpleThreadPool::push_task(std::function<void()> task, Key key)
+{
+    size_t node = local_queue();
+    threadsafe_container::pool_task_queue& queue = *_queues[node];
+    /*
+     * drain() lets tasks that are still running queue follow-ups, e.g. an actor rescheduling itself.
+     * They land on the pushing worker's own queue, which it empties again before it exits.
+     */
+    const bool fromWorker = worker_context()._pool == this;
+    if (!queue.push(std::move(task), key, fromWorker))
     {
-        std::function<void()> taskFunc = [currentTask]() { (*currentTask)(); };
-        _tasks.push(std::move(taskFunc));
+        throw std::runtime_error("enqueue on stopped SimpleThreadPool");
+    }
+    _metrics.on_push();
+    if (_queues.size() > 1 && queue.waiting() == 0)
+    {
+        /*nobody on this node is idle: wake an idle worker elsewhere to steal it*/
+        for (size_t i = 1; i < _queues.size(); ++i)
+        {
+            if (_queues[(node + i) % _queues.size()]->kick())
+            {
+                break;
+            }
+        }
     }
-    _threadPoolCv.notify_one();
-    return res;
 }
 
-SimpleThreadPool::~SimpleThreadPool()
+inline size_t SimpleThreadPool::local_queue() const
 {
-    _end = true;
-    _threadPoolCv.notify_all();
-    for (auto& eachWorkThread : _workThreads)
+    if (_queues.size() == 1)
     {
-        if (eachWorkThread.joinable())
+        return 0;
+    }
+    const WorkerContext& context = worker_context();
+    if (context._pool == this)
+    {
+        return context._node;
+    }
+    return _topology.current_node() % _queues.size();
+}
+
+inline bool SimpleThreadPool::steal(std::function<void()>& task, size_t node)
+{
+    for (size_t i = 1; i < _queues.size(); ++i)
+    {
+        if (_queues[(node + i) % _queues.size()]->try_pop(task))
         {
-            eachWorkThread.join();
+            _metrics.on_steal();
+            return true;
         }
     }
+    return false;
+}
+
+/*A throwing task must not take its worker down with it, so every queued task runs inside a catch*/
+template<class F>
+std::function<void()> SimpleThreadPool::wrap_task(F&& f)
+{
+    if constexpr (metrics::container_metrics_t::ENABLED)
+    {
+        metrics::timestamp enqueued = _metrics.clock();
+        return [this, func = std::forward<F>(f), enqueued]() mutable {
+            metrics::timestamp started = _metrics.clock();
+            _metrics.record_queue_delay(enqueued);
+            try
+            {
+                func();
+            }
+            catch (...)
+            {
+                report_task_error(std::current_exception());
+            }
+            _metrics.record_exec_time(started);
+        };
+    }
+    else
+    {
+        return [this, func = std::forward<F>(f)]() mutable {
+            try
+            {
+                func();
+            }
+            catch (...)
+            {
+                report_task_error(std::current_exception());
+            }
+        };
+    }
+}
+
+inline void SimpleThreadPool::report_task_error(std::exception_ptr error) const noexcept
+{
+    if (_options._onTaskError)
+    {
+        _options._onTaskError(error);
+        return;
+    }
+    try
+    {
+        std::rethrow_exception(error);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "SimpleThreadPool: task threw: " << e.what() << std::endl;
+    }
+    catch (...)
+    {
+        std::cerr << "SimpleThreadPool: task threw a non-std exception" << std::endl;
+    }
+}
+
+template<class Rep, class Period, class F>
+SimpleThreadPool::TimerHandle SimpleThreadPool::schedule_after(std::chrono::duration<Rep, Period> delay, F&& f, TaskPriority priority)
+{
+    return _timers.schedule_after(delay, make_timer_callback(std::forward<F>(f), priority));
+}
+
+template<class F>
+SimpleThreadPool::TimerHandle SimpleThreadPool::schedule_at(Clock::time_point when, F&& f, TaskPriority priority)
+{
+    return _timers.schedule_at(when, make_timer_callback(std::forward<F>(f), priority));
+}
+
+template<class Rep, class Period, class F>
+SimpleThreadPool::TimerHandle SimpleThreadPool::schedule_every(std::chrono::duration<Rep, Period> period, F&& f, TaskPriority priority)
+{
+    return _timers.schedule_every(period, make_timer_callback(std::forward<F>(f), priority));
+}
+
+inline bool SimpleThreadPool::cancel(TimerHandle handle)
+{
+    return _timers.cancel(handle);
+}
+
+inline SimpleThreadPool::~SimpleThreadPool()
+{
+    join_all();
+}
+
+inline void SimpleThreadPool::drain()
+{
+    size_t discarded = 0;
+    stop_and_join(false, discarded);
+}
+
+inline size_t SimpleThreadPool::shutdown_now()
+{
+    size_t discarded = 0;
+    stop_and_join(true, discarded);
+    return discarded;
+}
+
+inline void SimpleThreadPool::join_all()
+{
+    drain();
 }
 
-void SimpleThreadPool::join_all()
+inline void SimpleThreadPool::stop_and_join(bool discardQueued, size_t& discarded)
 {
-    _end = true;
-    _threadPoolCv.notify_all();
-    for (auto& eachWorkThread : _workThreads)
+    /*timers first, so nothing is posted into a stopped queue; this also ends the grow checks*/
+    _timers.stop();
+    {
+        std::lock_guard<std::mutex> lock(_workersMutex);
+        _end = true;
+    }
+    for (auto& queue : _queues)
+    {
+        queue->stop();
+    }
+    if (discardQueued)
+    {
+        /*dropping a packaged_task abandons its shared state, so its future reports broken_promise*/
+        for (auto& queue : _queues)
+        {
+            discarded += queue->clear();
+        }
+    }
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(_workersMutex);
+        threads.swap(_workThreads);
+        for (auto& retired : _retiredThreads)
+        {
+            threads.push_back(std::move(retired));
+        }
+        _retiredThreads.clear();
+    }
+    for (auto& eachWorkThread : threads)
     {
         if (eachWorkThread.joinable())
         {
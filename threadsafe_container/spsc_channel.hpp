@@ -0,0 +1,349 @@
+#pragma once
+
+#ifndef __SPSC_CHANNEL_H__
+#define __SPSC_CHANNEL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "base_def.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+THREADSAFT_CONTAINER_BEGIN
+
+/*
+ * Sleep/wake on a 32-bit sequence word. On linux this is a bare futex, so a notify with nobody
+ * asleep is one atomic load; elsewhere it falls back to a mutex and condition variable.
+ */
+class futex_event
+{
+public:
+    /*Announce a waiter and return the sequence to pass to wait(); re-check the condition in between*/
+    std::uint32_t prepare_wait()
+    {
+        _waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return _seq.load();
+    }
+
+    void cancel_wait()
+    {
+        _waiters.fetch_sub(1);
+    }
+
+    void wait(std::uint32_t seq)
+    {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&_seq), FUTEX_WAIT_PRIVATE, seq, nullptr, nullptr, 0);
+#else
+        std::unique_lock<std::mutex> lock(_m);
+        _cv.wait(lock, [&]() { return _seq.load() != seq; });
+#endif
+        _waiters.fetch_sub(1);
+    }
+
+    /*Callers publish their state change first; the fence orders it before the waiter check*/
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_waiters.load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+#ifdef __linux__
+        _seq.fetch_add(1);
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&_seq), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _seq.fetch_add(1);
+        }
+        _cv.notify_all();
+#endif
+    }
+
+private:
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex word must be 32 bits");
+    std::atomic<std::uint32_t> _seq{ 0 };
+    std::atomic<std::uint32_t> _waiters{ 0 };
+#ifndef __linux__
+    std::mutex _m;
+    std::condition_variable _cv;
+#endif
+};
+
+enum class spsc_wait
+{
+    SPIN = 0,   /*full/empty waits spin with yield; no fence on the publish path*/
+    BLOCK = 1   /*full/empty waits sleep on a futex after a short spin*/
+};
+
+/*
+ * Bounded single-producer/single-consumer ring (Lamport queue with FastForward-style cached
+ * indices). Each side keeps a private copy of the other side's index and only re-reads the shared
+ * one when the copy says full/empty, so in steady state the two cores exchange cache lines once per
+ * batch rather than once per item.
+ *
+ * Exactly one thread may call the producer functions (push, try_push, stage, publish, ...) and one
+ * thread the consumer functions (pop, try_pop, try_pop_batch, ...). push/try_pop/wait_and_pop match
+ * threadsafe_queue so the channel can back a messaging::mailbox with a single sender.
+ */
+template<class T>
+class spsc_channel
+{
+public:
+    explicit spsc_channel(size_t capacity = 1024, spsc_wait waitMode = spsc_wait::BLOCK)
+        :_mask(round_up_pow2(capacity < 2 ? 2 : capacity) - 1),
+        _slots(new Slot[_mask + 1]),
+        _waitMode(waitMode)
+    {
+    }
+
+    spsc_channel(const spsc_channel&) = delete;
+    spsc_channel& operator=(const spsc_channel&) = delete;
+
+    ~spsc_channel()
+    {
+        for (size_t i = _head.load(std::memory_order_relaxed); i != _producer._localTail; ++i)
+        {
+            slot(i)->~T();
+        }
+    }
+
+    size_t capacity() const
+    {
+        return _mask + 1;
+    }
+
+    /*Producer: write one item without making it visible; see publish()*/
+    bool try_stage(T& value)
+    {
+        size_t tail = _producer._localTail;
+        if (tail - _producer._cachedHead > _mask)
+        {
+            _producer._cachedHead = _head.load(std::memory_order_acquire);
+            if (tail - _producer._cachedHead > _mask)
+            {
+                return false;
+            }
+        }
+        new (&_slots[tail & _mask]) T(std::move(value));
+        _producer._localTail = tail + 1;
+        return true;
+    }
+
+    /*Producer: make every staged item visible to the consumer with a single store*/
+    void publish()
+    {
+        if (_producer._localTail == _producer._publishedTail)
+        {
+            return;
+        }
+        _producer._publishedTail = _producer._localTail;
+        _tail.store(_producer._localTail, std::memory_order_release);
+        if (_waitMode == spsc_wait::BLOCK)
+        {
+            _notEmpty.notify();
+        }
+    }
+
+    bool try_push(T value)
+    {
+        if (!try_stage(value))
+        {
+            return false;
+        }
+        publish();
+        return true;
+    }
+
+    /*Producer: blocks while the ring is full*/
+    void push(T value)
+    {
+        stage(value);
+        publish();
+    }
+
+    /*Producer: like push() but leaves the item unpublished, so a batch costs one release store*/
+    void stage(T& value)
+    {
+        for (unsigned spins = 0; !try_stage(value); ++spins)
+        {
+            /*the consumer cannot see staged items, so they have to go out before we wait for room*/
+            publish();
+            wait_for(_notFull, spins, [&]() { return _producer._localTail - _head.load(std::memory_order_acquire) <= _mask; });
+        }
+    }
+
+    template<class Iterator>
+    Iterator push_batch(Iterator first, Iterator last)
+    {
+        for (; first != last; ++first)
+        {
+            T value(std::move(*first));
+            stage(value);
+        }
+        publish();
+        return first;
+    }
+
+    /*Consumer*/
+    bool try_pop(T& value)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _consumer._cachedTail)
+        {
+            _consumer._cachedTail = _tail.load(std::memory_order_acquire);
+            if (head == _consumer._cachedTail)
+            {
+                return false;
+            }
+        }
+        T* item = slot(head);
+        value = std::move(*item);
+        item->~T();
+        _head.store(head + 1, std::memory_order_release);
+        if (_waitMode == spsc_wait::BLOCK)
+        {
+            _notFull.notify();
+        }
+        return true;
+    }
+
+    std::shared_ptr<T> try_pop()
+    {
+        T value;
+        return try_pop(value) ? std::make_shared<T>(std::move(value)) : nullptr;
+    }
+
+    /*Consumer: hands every available item (up to maxItems) to out, then frees their slots at once*/
+    template<class OutputIterator>
+    size_t try_pop_batch(OutputIterator out, size_t maxItems)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _consumer._cachedTail)
+        {
+            _consumer._cachedTail = _tail.load(std::memory_order_acquire);
+        }
+        size_t count = std::min(maxItems, _consumer._cachedTail - head);
+        for (size_t i = 0; i < count; ++i)
+        {
+            T* item = slot(head + i);
+            *out++ = std::move(*item);
+            item->~T();
+        }
+        if (count != 0)
+        {
+            _head.store(head + count, std::memory_order_release);
+            if (_waitMode == spsc_wait::BLOCK)
+            {
+                _notFull.notify();
+            }
+        }
+        return count;
+    }
+
+    /*Consumer: blocks while the ring is empty*/
+    void wait_and_pop(T& value)
+    {
+        for (unsigned spins = 0; !try_pop(value); ++spins)
+        {
+            wait_for(_notEmpty, spins, [&]() { return _head.load(std::memory_order_relaxed) != _tail.load(std::memory_order_acquire); });
+        }
+    }
+
+    std::shared_ptr<T> wait_and_pop()
+    {
+        T value;
+        wait_and_pop(value);
+        return std::make_shared<T>(std::move(value));
+    }
+
+    /*Approximate unless called by the consumer*/
+    bool empty() const
+    {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+    static constexpr unsigned SPIN_LIMIT = 128;
+
+    using Slot = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
+    static size_t round_up_pow2(size_t n)
+    {
+        size_t res = 1;
+        while (res < n)
+        {
+            res <<= 1;
+        }
+        return res;
+    }
+
+    T* slot(size_t index)
+    {
+        return std::launder(reinterpret_cast<T*>(&_slots[index & _mask]));
+    }
+
+    template<class Ready>
+    void wait_for(futex_event& event, unsigned spins, Ready ready)
+    {
+        if (_waitMode == spsc_wait::SPIN || spins < SPIN_LIMIT)
+        {
+            std::this_thread::yield();
+            return;
+        }
+        std::uint32_t seq = event.prepare_wait();
+        if (ready())
+        {
+            event.cancel_wait();
+            return;
+        }
+        event.wait(seq);
+    }
+
+private:
+    const size_t _mask;
+    std::unique_ptr<Slot[]> _slots;
+    const spsc_wait _waitMode;
+
+    /*shared indices, each on its own line*/
+    alignas(CACHE_LINE) std::atomic<size_t> _head{ 0 };
+    alignas(CACHE_LINE) std::atomic<size_t> _tail{ 0 };
+
+    /*producer-private*/
+    struct alignas(CACHE_LINE) ProducerState
+    {
+        size_t _localTail = 0;
+        size_t _publishedTail = 0;
+        size_t _cachedHead = 0;
+    } _producer;
+
+    /*consumer-private*/
+    struct alignas(CACHE_LINE) ConsumerState
+    {
+        size_t _cachedTail = 0;
+    } _consumer;
+
+    alignas(CACHE_LINE) futex_event _notEmpty;
+    alignas(CACHE_LINE) futex_event _notFull;
+};
+
+THREADSAFT_CONTAINER_END
+
+#endif //!__SPSC_CHANNEL_H__
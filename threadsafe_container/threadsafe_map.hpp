@@ -5,19 +5,51 @@
 
 #include <mutex>
 #include <functional>
-#include <unordered_map>
 #include <list>
 #include "boost/thread/shared_mutex.hpp"
 #include "boost/thread/locks.hpp"
 #include <algorithm>
 #include <memory>
+#include <vector>
+#include <atomic>
+#include <iterator>
+#include <numeric>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include "base_def.h"
+#include "container_metrics.hpp"
+#include "my_algorithm.hpp"
 THREADSAFT_CONTAINER_BEGIN
 const static unsigned int _gPrimes[] =
 {
-    53,   97,   193,   389,   769,   1543,
-    3079, 6151, 12289, 24593, 49157, 98317
+    53,        97,        193,       389,       769,       1543,
+    3079,      6151,      12289,     24593,     49157,     98317,
+    196613,    393241,    786433,    1572869,   3145739,   6291469,
+    12582917,  25165843,  50331653,  100663319, 201326611, 402653189,
+    805306457, 1610612741
 };
 
+/*
+ * Hash for std::string keys that also accepts std::string_view and const char*, so lookups with
+ * those do not build a temporary std::string. It hashes like std::hash<std::string>.
+ */
+struct string_hash
+{
+    using is_transparent = void;
+
+    size_t operator()(std::string_view key) const
+    {
+        return std::hash<std::string_view>()(key);
+    }
+};
+
+template<class Hash, class = void>
+struct is_transparent_hash : std::false_type {};
+
+template<class Hash>
+struct is_transparent_hash<Hash, std::void_t<typename Hash::is_transparent>> : std::true_type {};
+
 template<class Key, class Value, class Hash = std::hash<Key>>
 class threadsafe_map
 {
@@ -27,19 +59,21 @@ private:
     public:
         using BucketValue = std::pair<Key, Value>;
         using BucketData = std::list<BucketValue>;
-        using BucketInterator = BucketData::iterator;
-        using BucketConstInterator = BucketData::const_iterator;
+        using BucketInterator = typename BucketData::iterator;
+        using BucketConstInterator = typename BucketData::const_iterator;
         BucketData _data;
         mutable boost::shared_mutex _rwm;
 
     public:
 
-        BucketInterator findKeyEntry(Key const& key)
+        template<class K>
+        BucketInterator findKeyEntry(K const& key)
         {
             return std::find_if(_data.begin(), _data.end(), [&](BucketValue const& elem) {return elem.first == key; });
         }
 
-        BucketConstInterator findKeyEntry(Key const& key) const
+        template<class K>
+        BucketConstInterator findKeyEntry(K const& key) const
         {
             return std::find_if(_data.begin(), _data.end(), [&](BucketValue const& elem) {return elem.first == key; });
         }
@@ -50,120 +84,699 @@ private:
             return _data;
         }
 
+        /*The members below expect the caller to hold _rwm, shared for the const ones*/
         Value getValue(Key const& key, const Value& defaultValue) const
         {
-            boost::shared_lock<boost::shared_mutex> readLock(_rwm);
             BucketConstInterator entryPosi = findKeyEntry(key);
             return entryPosi == _data.end() ? defaultValue : entryPosi->second;
         }
 
-        void addPair(const Key& key, const Value& value)
+        bool addPair(const Key& key, const Value& value, metrics::container_metrics_t& m)
         {
-            std::unique_lock<boost::shared_mutex> writeLock(_rwm);
             BucketInterator entryPosi = findKeyEntry(key);
             if (entryPosi == _data.end())
             {
                 _data.emplace_back(BucketValue{ key, value });
+                m.on_push();
+                return true;
             }
-            else
+            entryPosi->second = value;
+            return false;
+        }
+
+        /*f(const Value&), if key is present*/
+        template<class K, class F>
+        bool visit(const K& key, F& f) const
+        {
+            BucketConstInterator entryPosi = findKeyEntry(key);
+            if (entryPosi == _data.end())
             {
-                entryPosi->second = value;
+                return false;
             }
+            f(entryPosi->second);
+            return true;
         }
 
-        void removePair(const Key& key)
+        /*f(Value&) on an existing entry, otherwise a new one built from args; true if inserted*/
+        template<class K, class F, class... Args>
+        bool upsert(K&& key, F& f, metrics::container_metrics_t& m, Args&&... args)
         {
-            std::unique_lock<boost::shared_mutex> writeLock(_rwm);
             BucketInterator entryPosi = findKeyEntry(key);
             if (entryPosi != _data.end())
             {
-                _data.erase(entryPosi);
+                f(entryPosi->second);
+                return false;
+            }
+            _data.emplace_back(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+            m.on_push();
+            return true;
+        }
+
+        /*Builds the value from args only if key is absent*/
+        template<class K, class... Args>
+        bool tryEmplace(K&& key, metrics::container_metrics_t& m, Args&&... args)
+        {
+            if (findKeyEntry(key) != _data.end())
+            {
+                return false;
+            }
+            _data.emplace_back(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+            m.on_push();
+            return true;
+        }
+
+        /*Splices the single entry of node in if its key is absent, so the pair is never copied*/
+        bool emplaceNode(BucketData& node, metrics::container_metrics_t& m)
+        {
+            if (findKeyEntry(node.front().first) != _data.end())
+            {
+                return false;
+            }
+            _data.splice(_data.end(), node);
+            m.on_push();
+            return true;
+        }
+
+        bool removePair(const Key& key, metrics::container_metrics_t& m)
+        {
+            BucketInterator entryPosi = findKeyEntry(key);
+            if (entryPosi == _data.end())
+            {
+                return false;
             }
+            _data.erase(entryPosi);
+            m.on_pop();
+            return true;
         }
     };
 
-    std::vector<std::unique_ptr<BucketType>> _buckets;
+    using ReadLock = boost::shared_lock<boost::shared_mutex>;
+    using WriteLock = std::unique_lock<boost::shared_mutex>;
+
+    /*
+     * The bucket array. Growing publishes a new, larger table whose first buckets are the old ones;
+     * the entries are moved while every old bucket is locked, and the table pointer is swapped before
+     * those locks are released. Replaced tables and all buckets live until the map is destroyed (the
+     * old tables only hold pointers, less than one per current bucket in total), so a thread holding
+     * a stale table still reads valid memory: once it has its bucket locked it sees the new pointer
+     * and retries.
+     */
+    struct BucketTable
+    {
+        std::vector<BucketType*> _buckets;
+    };
+
+    std::vector<std::unique_ptr<BucketType>> _bucketStore;
+    std::vector<std::unique_ptr<BucketTable>> _tables;
+    std::atomic<BucketTable*> _table{ nullptr };
     Hash _hashFunc;
     std::atomic<int> _realSize = 0;
-    std::mutex _bucketsLock;
+    /*serialises growth against itself and against new pins*/
+    mutable std::mutex _bucketsLock;
+    /*bulk operations running on bucket indices; the table does not grow while there are any*/
+    mutable std::atomic<size_t> _pins{ 0 };
+    mutable metrics::container_metrics_t _metrics;
 
-    unsigned int findNextPrime(int size)
+    /*Keeps the current table from being replaced for as long as it lives*/
+    class TablePin
     {
-        int len = sizeof(_gPrimes) / sizeof(_gPrimes[0]);
-        int dstPrime = _gPrimes[0];
-        for (int i = 0; i < len; ++i)
+    public:
+        explicit TablePin(const threadsafe_map& map)
+            :_map(map)
         {
-            if (_gPrimes[i] <= size)
+            std::lock_guard<std::mutex> lock(map._bucketsLock);
+            map._pins.fetch_add(1, std::memory_order_relaxed);
+            _table = map._table.load(std::memory_order_relaxed);
+        }
+
+        TablePin(const TablePin&) = delete;
+        TablePin& operator=(const TablePin&) = delete;
+
+        ~TablePin()
+        {
+            _map._pins.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        const std::vector<BucketType*>& buckets() const
+        {
+            return _table->_buckets;
+        }
+
+    private:
+        const threadsafe_map& _map;
+        const BucketTable* _table;
+    };
+
+    /*The smallest table prime above size, or the largest one if size is beyond the table*/
+    unsigned int findNextPrime(size_t size) const
+    {
+        const size_t len = sizeof(_gPrimes) / sizeof(_gPrimes[0]);
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (_gPrimes[i] > size)
             {
-                continue;
+                return _gPrimes[i];
             }
-            dstPrime = _gPrimes[i];
-            break;
         }
-        return dstPrime;
+        return _gPrimes[len - 1];
     }
 
-    BucketType& getBucket(const Key& key) const
+    size_t bucketCount() const
     {
-        const size_t bucketIndex = _hashFunc(key) % _buckets.size();
-        return *(_buckets[bucketIndex]);
+        return _table.load(std::memory_order_acquire)->_buckets.size();
     }
 
-public:
-    threadsafe_map(unsigned int pairsNum = 53, const Hash& hashFun = Hash()):_hashFunc(hashFun)
+    /*Publishes a table of newBucketsSize buckets; caller holds _bucketsLock and nothing is pinned*/
+    void rehashLocked(size_t newBucketsSize)
+    {
+        const std::vector<BucketType*>& oldBuckets = _table.load(std::memory_order_relaxed)->_buckets;
+        std::unique_ptr<BucketTable> table(new BucketTable);
+        table->_buckets.reserve(newBucketsSize);
+        table->_buckets.assign(oldBuckets.begin(), oldBuckets.end());
+        _bucketStore.reserve(newBucketsSize);
+        while (_bucketStore.size() < newBucketsSize)
+        {
+            _bucketStore.emplace_back(new BucketType);
+            table->_buckets.push_back(_bucketStore.back().get());
+        }
+        _tables.reserve(_tables.size() + 1);
+        /*nothing below allocates; the lock order is by index, and no other path holds two bucket locks*/
+        for (BucketType* bucket : oldBuckets)
+        {
+            bucket->_rwm.lock();
+        }
+        typename BucketType::BucketData moving;
+        for (BucketType* bucket : oldBuckets)
+        {
+            moving.splice(moving.end(), bucket->_data);
+        }
+        while (!moving.empty())
+        {
+            const size_t bucketIndex = _hashFunc(moving.front().first) % newBucketsSize;
+            auto& target = table->_buckets[bucketIndex]->_data;
+            target.splice(target.end(), moving, moving.begin());
+        }
+        _table.store(table.get(), std::memory_order_release);
+        _tables.push_back(std::move(table));
+        for (BucketType* bucket : oldBuckets)
+        {
+            bucket->_rwm.unlock();
+        }
+    }
+
+    /*
+     * Runs f(bucket) with key's bucket locked by Lock (ReadLock or WriteLock). If a rehash moved the
+     * key while this thread waited for the lock, it looks the bucket up again in the new table.
+     */
+    template<class Lock, class K, class F>
+    auto withBucket(const K& key, F&& f) const
     {
-        _buckets.resize(pairsNum);
-        for (int i = 0; i < pairsNum; ++i)
+        const size_t hash = _hashFunc(key);
+        while (true)
         {
-            _buckets[i].reset(new BucketType);
+            const BucketTable* table = _table.load(std::memory_order_acquire);
+            BucketType& bucket = *table->_buckets[hash % table->_buckets.size()];
+            metrics::timestamp waitStart = _metrics.clock();
+            Lock lock(bucket._rwm);
+            /*a rehash swaps the table while it holds this lock, so the lock makes the swap visible*/
+            if (_table.load(std::memory_order_relaxed) == table)
+            {
+                auto holdScope = _metrics.lock_acquired(waitStart);
+                return f(bucket);
+            }
         }
     }
 
-    threadsafe_map(const threadsafe_map& rhs) = delete;
-    threadsafe_map& operator=(const threadsafe_map& rhs) = delete;
+    /*f(bucket) under bucket's lock; for bulk operations that hold a TablePin*/
+    template<class Lock, class F>
+    auto withLockedBucket(BucketType& bucket, F&& f) const
+    {
+        metrics::timestamp waitStart = _metrics.clock();
+        Lock lock(bucket._rwm);
+        auto holdScope = _metrics.lock_acquired(waitStart);
+        return f(bucket);
+    }
 
-    Value getValue(const Key& key, const Value& defaultValue = Value()) const
+    /*Contiguous bucket ranges for the bulk operations, a few per thread to even out the load*/
+    static size_t bucketChunks(size_t bucketsSize)
     {
-        return getBucket(key).getValue(key, defaultValue);
+        const size_t threads = HARDWARE_THREADS != 0 ? HARDWARE_THREADS : 2;
+        return std::min(bucketsSize, threads * 4);
     }
 
-    void addPair(const Key& key, const Value& value)
+    static size_t chunkBegin(size_t bucketsSize, size_t chunk, size_t chunks)
+    {
+        return bucketsSize * chunk / chunks;
+    }
+
+    /*Runs work(chunk) for every chunk inline (executor == nullptr) or via parallel_chunks*/
+    template<class Executor, class F>
+    static void runChunks(Executor* executor, size_t chunks, F&& work)
+    {
+        if (executor == nullptr)
+        {
+            for (size_t chunk = 0; chunk < chunks; ++chunk)
+            {
+                work(chunk);
+            }
+            return;
+        }
+        parallel_chunks(*executor, chunks, std::forward<F>(work));
+    }
+
+    /*Stand-in executor for callers without a pool: the chunks run on up to _threads threads of their own*/
+    struct OwnThreads
     {
-        if (_realSize == _buckets.size())
+        size_t _threads;
+    };
+
+    template<class F>
+    static void runChunks(OwnThreads* executor, size_t chunks, F&& work)
+    {
+        std::atomic<size_t> next{ 0 };
+        run_blocks(std::min(chunks, std::max<size_t>(executor->_threads, 1)), [&](size_t) {
+            for (size_t chunk = next.fetch_add(1); chunk < chunks; chunk = next.fetch_add(1))
+            {
+                work(chunk);
+            }
+        });
+    }
+
+    template<class Iterator, class Executor>
+    void insertBulk(Iterator first, Iterator last, Executor* executor)
+    {
+        static_assert(std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>::value,
+            "insert_bulk needs random access iterators");
+        const size_t count = static_cast<size_t>(last - first);
+        if (count == 0)
+        {
+            return;
+        }
         {
             std::lock_guard<std::mutex> lock(_bucketsLock);
-            std::unordered_map<Key, Value> oriMap;
-            for (int i = 0; i < _buckets.size(); ++i)
+            const size_t newBucketsSize = findNextPrime(static_cast<size_t>(_realSize.load()) + count);
+            /*a running for_each or snapshot keeps the table as it is; the entries then share buckets*/
+            if (newBucketsSize > bucketCount() && _pins.load(std::memory_order_relaxed) == 0)
+            {
+                rehashLocked(newBucketsSize);
+            }
+        }
+        {
+            TablePin pin(*this);
+            _realSize += static_cast<int>(fillPinned(first, count, pin.buckets(), executor));
+        }
+        /*catches up on the growth a pin held off*/
+        growIfFull();
+    }
+
+    /*The bulk of insertBulk, into the buckets of a pinned table; returns how many keys were new*/
+    template<class Iterator, class Executor>
+    size_t fillPinned(Iterator first, size_t count, const std::vector<BucketType*>& buckets, Executor* executor)
+    {
+        const size_t bucketsSize = buckets.size();
+        const size_t chunks = executor != nullptr ? bucketChunks(bucketsSize) : 1;
+        /*
+         * Counting sort of the input by owning chunk: hash each slice and count per chunk, turn the
+         * counts into offsets, then scatter element positions so every chunk's input is contiguous.
+         */
+        std::vector<unsigned int> bucketOf(count);
+        std::vector<size_t> counts(chunks * chunks, 0);
+        auto sliceBegin = [&](size_t slice) { return count * slice / chunks; };
+        auto chunkOf = [&](size_t bucket) { return bucket * chunks / bucketsSize; };
+        runChunks(executor, chunks, [&](size_t slice) {
+            size_t* sliceCounts = &counts[slice * chunks];
+            for (size_t i = sliceBegin(slice); i < sliceBegin(slice + 1); ++i)
+            {
+                const size_t bucketIndex = _hashFunc(first[i].first) % bucketsSize;
+                bucketOf[i] = static_cast<unsigned int>(bucketIndex);
+                ++sliceCounts[chunkOf(bucketIndex)];
+            }
+        });
+        std::vector<size_t> chunkStart(chunks + 1, 0);
+        size_t offset = 0;
+        for (size_t chunk = 0; chunk < chunks; ++chunk)
+        {
+            chunkStart[chunk] = offset;
+            for (size_t slice = 0; slice < chunks; ++slice)
+            {
+                const size_t sliceCount = counts[slice * chunks + chunk];
+                counts[slice * chunks + chunk] = offset;
+                offset += sliceCount;
+            }
+        }
+        chunkStart[chunks] = offset;
+        std::vector<size_t> order(count);
+        runChunks(executor, chunks, [&](size_t slice) {
+            size_t* cursor = &counts[slice * chunks];
+            for (size_t i = sliceBegin(slice); i < sliceBegin(slice + 1); ++i)
+            {
+                order[cursor[chunkOf(bucketOf[i])]++] = i;
+            }
+        });
+        /*
+         * chunks own disjoint buckets, so the bucket locks below are never contended by each other.
+         * A second, stable counting sort puts each chunk's input in bucket order: the buckets are
+         * then walked in memory order, several times faster than at random, and a bucket's entries
+         * share one lock.
+         */
+        auto firstBucketOf = [&](size_t chunk) { return (chunk * bucketsSize + chunks - 1) / chunks; };
+        std::atomic<size_t> inserted{ 0 };
+        runChunks(executor, chunks, [&](size_t chunk) {
+            const size_t lowBucket = firstBucketOf(chunk);
+            std::vector<size_t> bucketStart(firstBucketOf(chunk + 1) - lowBucket + 1, 0);
+            for (size_t pos = chunkStart[chunk]; pos < chunkStart[chunk + 1]; ++pos)
+            {
+                ++bucketStart[bucketOf[order[pos]] - lowBucket + 1];
+            }
+            std::partial_sum(bucketStart.begin(), bucketStart.end(), bucketStart.begin());
+            std::vector<size_t> sorted(chunkStart[chunk + 1] - chunkStart[chunk]);
+            for (size_t pos = chunkStart[chunk]; pos < chunkStart[chunk + 1]; ++pos)
+            {
+                sorted[bucketStart[bucketOf[order[pos]] - lowBucket]++] = order[pos];
+            }
+            size_t added = 0;
+            for (size_t pos = 0; pos < sorted.size(); )
             {
-                for (const auto& elem : _buckets[i]->getBucketData())
+                const size_t bucketIndex = bucketOf[sorted[pos]];
+                size_t end = pos + 1;
+                while (end < sorted.size() && bucketOf[sorted[end]] == bucketIndex)
                 {
-                    oriMap.insert(elem);
+                    ++end;
                 }
+                added += withLockedBucket<WriteLock>(*buckets[bucketIndex], [&](BucketType& bucket) {
+                    size_t fresh = 0;
+                    for (size_t run = pos; run < end; ++run)
+                    {
+                        if (bucket.addPair(first[sorted[run]].first, first[sorted[run]].second, _metrics))
+                        {
+                            ++fresh;
+                        }
+                    }
+                    return fresh;
+                });
+                pos = end;
             }
-            oriMap[key] = value;
-            int newBucketsSize = findNextPrime(_realSize.load());
-            _buckets.clear();
-            _buckets.resize(newBucketsSize);
-            for (int i = 0; i < newBucketsSize; ++i)
+            inserted.fetch_add(added);
+        });
+        return inserted.load();
+    }
+
+    template<class F, class Executor>
+    void forEach(F& f, Executor* executor) const
+    {
+        TablePin pin(*this);
+        const std::vector<BucketType*>& buckets = pin.buckets();
+        const size_t chunks = executor != nullptr ? bucketChunks(buckets.size()) : 1;
+        runChunks(executor, chunks, [&](size_t chunk) {
+            for (size_t i = chunkBegin(buckets.size(), chunk, chunks); i < chunkBegin(buckets.size(), chunk + 1, chunks); ++i)
             {
-                _buckets[i].reset(new BucketType);
+                withLockedBucket<ReadLock>(*buckets[i], [&](const BucketType& bucket) {
+                    for (const auto& elem : bucket._data)
+                    {
+                        f(elem.first, elem.second);
+                    }
+                });
             }
-            for (const auto& elem : oriMap)
+        });
+    }
+
+    template<class Executor>
+    std::vector<std::pair<Key, Value>> takeSnapshot(Executor* executor) const
+    {
+        TablePin pin(*this);
+        const std::vector<BucketType*>& buckets = pin.buckets();
+        const size_t chunks = executor != nullptr ? bucketChunks(buckets.size()) : 1;
+        std::vector<std::vector<std::pair<Key, Value>>> parts(chunks);
+        runChunks(executor, chunks, [&](size_t chunk) {
+            for (size_t i = chunkBegin(buckets.size(), chunk, chunks); i < chunkBegin(buckets.size(), chunk + 1, chunks); ++i)
             {
-                const size_t bucketIndex = _hashFunc(elem.first) % _buckets.size();
-                (*_buckets[bucketIndex])._data.push_back(BucketType::BucketValue(elem.first, elem.second));
+                withLockedBucket<ReadLock>(*buckets[i], [&](const BucketType& bucket) {
+                    parts[chunk].insert(parts[chunk].end(), bucket._data.begin(), bucket._data.end());
+                });
             }
+        });
+        if (chunks == 1)
+        {
+            return std::move(parts.front());
+        }
+        size_t total = 0;
+        for (const auto& part : parts)
+        {
+            total += part.size();
+        }
+        std::vector<std::pair<Key, Value>> result;
+        result.reserve(total);
+        for (auto& part : parts)
+        {
+            std::move(part.begin(), part.end(), std::back_inserter(result));
+        }
+        return result;
+    }
+
+    /*Stand-in executor type for the serial overloads*/
+    struct InlineExecutor
+    {
+        template<class F>
+        void post(F&& f)
+        {
+            f();
+        }
+    };
+
+    /*Keys other than Key are only looked up directly when Hash declares is_transparent*/
+    template<class K>
+    using EnableLookup = std::enable_if_t<std::is_same<std::decay_t<K>, Key>::value || is_transparent_hash<Hash>::value>;
+
+    /*
+     * Grows once there are as many entries as buckets. Writers that find another thread growing, or
+     * a bulk operation pinning the table, go ahead without waiting and leave the growth to later.
+     */
+    void growIfFull()
+    {
+        if (static_cast<size_t>(_realSize.load(std::memory_order_relaxed)) < bucketCount() || _pins.load(std::memory_order_relaxed) != 0)
+        {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(_bucketsLock, std::try_to_lock);
+        if (!lock.owns_lock() || _pins.load(std::memory_order_relaxed) != 0)
+        {
+            return;
+        }
+        const size_t newBucketsSize = findNextPrime(_realSize.load());
+        if (newBucketsSize > bucketCount())
+        {
+            rehashLocked(newBucketsSize);
+        }
+    }
+
+public:
+    threadsafe_map(unsigned int pairsNum = 53, const Hash& hashFun = Hash()):_hashFunc(hashFun)
+    {
+        pairsNum = std::max(pairsNum, 1u);
+        std::unique_ptr<BucketTable> table(new BucketTable);
+        for (unsigned int i = 0; i < pairsNum; ++i)
+        {
+            _bucketStore.emplace_back(new BucketType);
+            table->_buckets.push_back(_bucketStore.back().get());
+        }
+        _table.store(table.get(), std::memory_order_release);
+        _tables.push_back(std::move(table));
+    }
+
+    threadsafe_map(const threadsafe_map& rhs) = delete;
+    threadsafe_map& operator=(const threadsafe_map& rhs) = delete;
+
+    Value getValue(const Key& key, const Value& defaultValue = Value()) const
+    {
+        _metrics.on_lookup();
+        return withBucket<ReadLock>(key, [&](const BucketType& bucket) { return bucket.getValue(key, defaultValue); });
+    }
+
+    void addPair(const Key& key, const Value& value)
+    {
+        growIfFull();
+        if (withBucket<WriteLock>(key, [&](BucketType& bucket) { return bucket.addPair(key, value, _metrics); }))
+        {
+            ++_realSize;
+        }
+    }
+
+    /*
+     * Calls f(const Value&) in place under the bucket's shared lock instead of copying the value
+     * out; returns false if key is absent. f must not call back into the map.
+     */
+    template<class K, class F, class = EnableLookup<K>>
+    bool find_fn(const K& key, F f) const
+    {
+        _metrics.on_lookup();
+        return withBucket<ReadLock>(key, [&](const BucketType& bucket) { return bucket.visit(key, f); });
+    }
+
+    template<class K, class = EnableLookup<K>>
+    bool contains(const K& key) const
+    {
+        auto ignore = [](const Value&) {};
+        return find_fn(key, ignore);
+    }
+
+    /*
+     * Calls f(Value&) under the bucket's exclusive lock if key is present, otherwise inserts
+     * Value(args...). Returns true if it inserted. f must not call back into the map.
+     */
+    template<class K, class F, class... Args>
+    bool upsert(K&& key, F f, Args&&... args)
+    {
+        growIfFull();
+        if (withBucket<WriteLock>(key, [&](BucketType& bucket) {
+            return bucket.upsert(std::forward<K>(key), f, _metrics, std::forward<Args>(args)...);
+        }))
+        {
+            ++_realSize;
+            return true;
+        }
+        return false;
+    }
+
+    /*Inserts Value(args...) under key if key is absent; nothing is constructed otherwise*/
+    template<class K, class... Args>
+    bool try_emplace(K&& key, Args&&... args)
+    {
+        growIfFull();
+        if (withBucket<WriteLock>(key, [&](BucketType& bucket) {
+            return bucket.tryEmplace(std::forward<K>(key), _metrics, std::forward<Args>(args)...);
+        }))
+        {
+            ++_realSize;
+            return true;
         }
-        else
+        return false;
+    }
+
+    /*Builds the pair from args up front, as std::unordered_map::emplace does, and keeps it only if the key is new*/
+    template<class... Args>
+    bool emplace(Args&&... args)
+    {
+        typename BucketType::BucketData node;
+        node.emplace_back(std::forward<Args>(args)...);
+        growIfFull();
+        if (withBucket<WriteLock>(node.front().first, [&](BucketType& bucket) { return bucket.emplaceNode(node, _metrics); }))
         {
-            getBucket(key).addPair(key, value);
+            ++_realSize;
+            return true;
         }
-        ++_realSize;
+        return false;
     }
 
     void removePair(const Key& key)
     {
-        getBucket(key).removePair(key);
+        if (withBucket<WriteLock>(key, [&](BucketType& bucket) { return bucket.removePair(key, _metrics); }))
+        {
+            --_realSize;
+        }
+    }
+
+    /*
+     * Loads [first, last), random access pairs of key and value, in one go. The table is grown once
+     * to fit (unless a for_each or snapshot is running), the input is partitioned by bucket, and each
+     * chunk of buckets is filled in bucket order with one uncontended lock per bucket; existing keys
+     * are overwritten as with addPair. The executor overload (anything with post(F), e.g.
+     * SimpleThreadPool) hashes, partitions and fills in parallel, and so does the threads overload,
+     * on up to that many threads of its own.
+     */
+    template<class Iterator>
+    void insert_bulk(Iterator first, Iterator last)
+    {
+        insertBulk(first, last, static_cast<InlineExecutor*>(nullptr));
+    }
+
+    template<class Iterator, class Executor, class = std::enable_if_t<!std::is_arithmetic<Executor>::value>>
+    void insert_bulk(Iterator first, Iterator last, Executor& executor)
+    {
+        insertBulk(first, last, &executor);
+    }
+
+    template<class Iterator>
+    void insert_bulk(Iterator first, Iterator last, size_t threads)
+    {
+        OwnThreads own{ threads };
+        insertBulk(first, last, &own);
+    }
+
+    /*getValue for many keys; keys sharing a bucket are read under a single shared lock*/
+    std::vector<Value> multi_get(const std::vector<Key>& keys, const Value& defaultValue = Value()) const
+    {
+        std::vector<Value> values(keys.size(), defaultValue);
+        TablePin pin(*this);
+        const std::vector<BucketType*>& buckets = pin.buckets();
+        std::vector<std::pair<size_t, size_t>> byBucket;
+        byBucket.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            byBucket.emplace_back(_hashFunc(keys[i]) % buckets.size(), i);
+        }
+        std::sort(byBucket.begin(), byBucket.end());
+        for (size_t runStart = 0; runStart < byBucket.size(); )
+        {
+            size_t runEnd = runStart + 1;
+            while (runEnd < byBucket.size() && byBucket[runEnd].first == byBucket[runStart].first)
+            {
+                ++runEnd;
+            }
+            withLockedBucket<ReadLock>(*buckets[byBucket[runStart].first], [&](const BucketType& bucket) {
+                for (size_t r = runStart; r < runEnd; ++r)
+                {
+                    auto entryPosi = bucket.findKeyEntry(keys[byBucket[r].second]);
+                    if (entryPosi != bucket._data.end())
+                    {
+                        values[byBucket[r].second] = entryPosi->second;
+                    }
+                    _metrics.on_lookup();
+                }
+            });
+            runStart = runEnd;
+        }
+        return values;
+    }
+
+    /*
+     * Calls f(key, value) for every entry. Each bucket is visited under its own shared lock, so
+     * writers are held up one bucket at a time, never for the whole walk: the view is consistent per
+     * bucket, not across buckets. The table does not grow during the walk (writers keep inserting
+     * into it), so no entry is moved past the walk and seen twice or missed. f must not write to the
+     * map. With an executor, buckets are visited in parallel and f is called concurrently.
+     */
+    template<class F>
+    void for_each(F f) const
+    {
+        forEach(f, static_cast<InlineExecutor*>(nullptr));
+    }
+
+    template<class F, class Executor>
+    void for_each(F f, Executor& executor) const
+    {
+        forEach(f, &executor);
+    }
+
+    /*Copy of every entry, with the same per-bucket consistency as for_each*/
+    std::vector<std::pair<Key, Value>> snapshot() const
+    {
+        return takeSnapshot(static_cast<InlineExecutor*>(nullptr));
+    }
+
+    template<class Executor>
+    std::vector<std::pair<Key, Value>> snapshot(Executor& executor) const
+    {
+        return takeSnapshot(&executor);
+    }
+
+    size_t size() const
+    {
+        return static_cast<size_t>(_realSize.load());
+    }
+
+    const metrics::container_metrics_t& getMetrics() const
+    {
+        return _metrics;
     }
 };
 THREADSAFT_CONTAINER_END
@@ -7,14 +7,27 @@
 #include <mutex>
 #include <condition_variable>
 #include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include "base_def.h"
+#include "container_metrics.hpp"
+#include "async_waiter.hpp"
 
 THREADSAFT_CONTAINER_BEGIN
 
+/*
+ * Two-lock FIFO. Unbounded by default; constructed with a capacity, push blocks while the queue is
+ * full (try_push and push_for give up instead), so stalled consumers throttle their producers rather
+ * than letting the queue grow without limit.
+ */
 template <class T>
 class threadsafe_queue
 {
 public:
-    threadsafe_queue() 
+    /*capacity 0 means unbounded*/
+    explicit threadsafe_queue(size_t capacity = 0)
+        :_capacity(capacity)
     {
         _head = std::make_unique<node>(node{});
         _tail = _head.get();
@@ -22,41 +35,92 @@ public:
     threadsafe_queue(const threadsafe_queue& rhs) = delete;
     threadsafe_queue& operator=(const threadsafe_queue&) = delete;
     ~threadsafe_queue() {}
-    void push(const T newValue)
+
+    /*Blocks while a bounded queue is full*/
+    void push(T newValue)
     {
         std::shared_ptr<T> newData = std::make_shared<T>(std::move(newValue));
         std::unique_ptr<node> p = std::make_unique<node>(node{});
+        size_t depth = 0;
         {
-            std::lock_guard<std::mutex> tailLock(_tailMutex);
-            _tail->_data = newData;
-            node* const newTail = p.get();
-            _tail->_next = std::move(p);
-            _tail = newTail;
+            metrics::timestamp waitStart = _metrics.clock();
+            std::unique_lock<std::mutex> tailLock(_tailMutex);
+            auto holdScope = _metrics.lock_acquired(waitStart);
+            wait_not_full(tailLock, Clock::duration::max());
+            depth = link_tail(std::move(newData), std::move(p));
         }
-        _dataCond.notify_one();
+        after_push(depth);
+    }
+
+    /*false, leaving value untouched, if a bounded queue is full*/
+    template<class U>
+    bool try_push(U&& value)
+    {
+        return push_within(std::forward<U>(value), Clock::duration::zero());
+    }
+
+    /*Waits up to timeout for room; false, leaving value untouched, if there was none*/
+    template<class U, class Rep, class Period>
+    bool push_for(U&& value, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        return push_within(std::forward<U>(value), std::chrono::duration_cast<Clock::duration>(timeout));
+    }
+
+    /*
+     * callback(true) when the depth reaches high, callback(false) when it next falls to low, and so on
+     * alternately; it runs on the pushing or popping thread with no queue lock held. Set it before the
+     * queue is shared between threads.
+     */
+    void set_watermarks(size_t high, size_t low, std::function<void(bool)> callback)
+    {
+        _highWatermark = high;
+        _lowWatermark = low;
+        _watermarkCallback = std::move(callback);
+    }
+
+    size_t size() const
+    {
+        return _count.load();
+    }
+
+    size_t capacity() const
+    {
+        return _capacity;
     }
 
     std::shared_ptr<T> wait_and_pop()
     {
         std::unique_ptr<node> const oldHead = wait_pop_head();
+        after_pop();
         return oldHead->_data;
     }
 
     void wait_and_pop(T& value)
     {
         wait_pop_head(value);
+        after_pop();
     }
 
     std::shared_ptr<T> try_pop()
     {
         std::unique_ptr<node> oldHead = try_pop_head();
-        return oldHead ? oldHead->_data : nullptr;
+        if (!oldHead)
+        {
+            return nullptr;
+        }
+        after_pop();
+        return oldHead->_data;
     }
 
     bool try_pop(T& value)
     {
         std::unique_ptr<node> const oldHead = try_pop_head(value);
-        return oldHead;
+        if (!oldHead)
+        {
+            return false;
+        }
+        after_pop();
+        return true;
     }
 
     bool empty()
@@ -64,7 +128,74 @@ public:
         std::lock_guard<std::mutex> headLock(_headMutex);
         return (_head.get() == get_tail());
     }
+
+    const metrics::container_metrics_t& get_metrics() const
+    {
+        return _metrics;
+    }
+
+#ifdef __cpp_impl_coroutine
+    class pop_awaiter
+    {
+    public:
+        pop_awaiter(threadsafe_queue& queue, coro::resumer resume)
+            :_queue(queue)
+        {
+            _waiter._resumer = resume;
+        }
+
+        bool await_ready()
+        {
+            std::unique_ptr<node> const oldHead = _queue.try_pop_head();
+            if (!oldHead)
+            {
+                return false;
+            }
+            _waiter._value.emplace(std::move(*oldHead->_data));
+            _queue.after_pop();
+            return true;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            _waiter._handle = handle;
+            if (_queue.suspend_waiter(_waiter))
+            {
+                return true;
+            }
+            _queue.after_pop();
+            return false;
+        }
+
+        T await_resume()
+        {
+            return std::move(*_waiter._value);
+        }
+
+    private:
+        threadsafe_queue& _queue;
+        coro::async_waiter<T> _waiter;
+    };
+
+    /*
+     * co_await queue.async_pop() suspends the coroutine until a value arrives, holding no thread.
+     * It resumes on the pushing thread; pass an executor (e.g. a SimpleThreadPool) to resume there.
+     * Every awaiting coroutine must have been resumed before the queue is destroyed.
+     */
+    pop_awaiter async_pop()
+    {
+        return pop_awaiter(*this, coro::resumer());
+    }
+
+    template<class Executor>
+    pop_awaiter async_pop(Executor& executor)
+    {
+        return pop_awaiter(*this, coro::resumer::on(executor));
+    }
+#endif
 private:
+    using Clock = std::chrono::steady_clock;
+
     struct node
     {
         std::shared_ptr<T> _data;
@@ -76,6 +207,22 @@ private:
     node* _tail;
     std::mutex _tailMutex;
     std::condition_variable _dataCond;
+    metrics::container_metrics_t _metrics;
+    const size_t _capacity;
+    std::atomic<size_t> _count{ 0 };
+    /*waits on _tailMutex; producers announce themselves in _blockedPushers before checking for room*/
+    std::condition_variable _notFullCond;
+    std::atomic<size_t> _blockedPushers{ 0 };
+    std::atomic<size_t> _blockedPoppers{ 0 };
+    size_t _highWatermark = 0;
+    size_t _lowWatermark = 0;
+    std::function<void(bool)> _watermarkCallback;
+    std::atomic<bool> _aboveHigh{ false };
+#ifdef __cpp_impl_coroutine
+    std::mutex _waitersMutex;
+    coro::waiter_list<T> _waiters;
+    std::atomic<size_t> _asyncWaiters{ 0 };
+#endif
 
 private:
     node* get_tail()
@@ -88,27 +235,145 @@ private:
     {
         std::unique_ptr<node> oldHead = std::move(_head);
         _head = std::move(oldHead->_next);
+        _metrics.on_pop();
+        _count.fetch_sub(1);
+        if (_blockedPushers.load() != 0)
+        {
+            /*taking the lock orders this notify after a producer that is about to wait*/
+            std::lock_guard<std::mutex> tailLock(_tailMutex);
+            _notFullCond.notify_one();
+        }
         return oldHead;
     }
 
+    /*Called by every pop once its locks are released*/
+    void after_pop()
+    {
+        if (_watermarkCallback && _count.load() <= _lowWatermark && _aboveHigh.exchange(false))
+        {
+            _watermarkCallback(false);
+        }
+    }
+
+    /*false if the queue stayed full for timeout; duration::max() waits indefinitely*/
+    bool wait_not_full(std::unique_lock<std::mutex>& tailLock, Clock::duration timeout)
+    {
+        if (_capacity == 0)
+        {
+            return true;
+        }
+        auto hasRoom = [this]() { return _count.load() < _capacity; };
+        if (hasRoom())
+        {
+            return true;
+        }
+        if (timeout == Clock::duration::zero())
+        {
+            return false;
+        }
+        _blockedPushers.fetch_add(1);
+        bool room = true;
+        if (timeout == Clock::duration::max())
+        {
+            _notFullCond.wait(tailLock, hasRoom);
+        }
+        else
+        {
+            room = _notFullCond.wait_for(tailLock, timeout, hasRoom);
+        }
+        _blockedPushers.fetch_sub(1);
+        return room;
+    }
+
+    /*Caller holds _tailMutex; returns the new depth*/
+    size_t link_tail(std::shared_ptr<T> newData, std::unique_ptr<node> p)
+    {
+        _tail->_data = std::move(newData);
+        node* const newTail = p.get();
+        _tail->_next = std::move(p);
+        _tail = newTail;
+        return _count.fetch_add(1) + 1;
+    }
+
+    void after_push(size_t depth)
+    {
+        _metrics.on_push();
+        if (_blockedPoppers.load() != 0)
+        {
+            /*a consumer that saw the queue empty is either waiting already or still holds _headMutex*/
+            std::lock_guard<std::mutex> headLock(_headMutex);
+        }
+        _dataCond.notify_one();
+        if (_watermarkCallback && _highWatermark != 0 && depth >= _highWatermark && !_aboveHigh.exchange(true))
+        {
+            _watermarkCallback(true);
+        }
+#ifdef __cpp_impl_coroutine
+        /*a suspended coroutine registers before it re-checks, so this load cannot miss it*/
+        if (_asyncWaiters.load() != 0)
+        {
+            serve_async_waiters();
+        }
+#endif
+    }
+
+    template<class U>
+    bool push_within(U&& value, Clock::duration timeout)
+    {
+        std::unique_ptr<node> p = std::make_unique<node>(node{});
+        size_t depth = 0;
+        {
+            metrics::timestamp waitStart = _metrics.clock();
+            std::unique_lock<std::mutex> tailLock(_tailMutex);
+            auto holdScope = _metrics.lock_acquired(waitStart);
+            if (!wait_not_full(tailLock, timeout))
+            {
+                return false;
+            }
+            /*built only once there is room, so a refused value is never moved from*/
+            depth = link_tail(std::make_shared<T>(std::forward<U>(value)), std::move(p));
+        }
+        after_push(depth);
+        return true;
+    }
+
+    /*Caller holds _headMutex; like the not-full wait, a consumer announces itself before checking*/
+    void wait_for_data(std::unique_lock<std::mutex>& headLock)
+    {
+        auto hasData = [&]() {return _head.get() != get_tail(); };
+        if (hasData())
+        {
+            return;
+        }
+        _blockedPoppers.fetch_add(1);
+        _dataCond.wait(headLock, hasData);
+        _blockedPoppers.fetch_sub(1);
+    }
+
     std::unique_ptr<node> wait_pop_head()
     {
         std::unique_lock<std::mutex> headLock(_headMutex);
-        _dataCond.wait(headLock, [&]() {return _head.get() != get_tail(); });
+        wait_for_data(headLock);
+        /*time blocked on an empty queue is not lock contention, only the hold is recorded*/
+        auto holdScope = _metrics.lock_acquired(_metrics.clock());
         return pop_head();
     }
 
     std::unique_ptr<node> wait_pop_head(T& value)
     {
         std::unique_lock<std::mutex> headLock(_headMutex);
-        _dataCond.wait(headLock, [&]() {return _head.get() != get_tail(); });
+        wait_for_data(headLock);
+        /*time blocked on an empty queue is not lock contention, only the hold is recorded*/
+        auto holdScope = _metrics.lock_acquired(_metrics.clock());
         value = std::move(*(_head->_data));
         return pop_head();
     }
 
     std::unique_ptr<node> try_pop_head()
     {
+        metrics::timestamp waitStart = _metrics.clock();
         std::lock_guard<std::mutex> headLock(_headMutex);
+        auto holdScope = _metrics.lock_acquired(waitStart);
         if (_head.get() == get_tail())
         {
             return std::unique_ptr<node>();
@@ -118,7 +383,9 @@ private:
 
     std::unique_ptr<node> try_pop_head(T& value)
     {
+        metrics::timestamp waitStart = _metrics.clock();
         std::lock_guard<std::mutex> headLock(_headMutex);
+        auto holdScope = _metrics.lock_acquired(waitStart);
         if (_head.get() == get_tail())
         {
             return std::unique_ptr<node>();
@@ -126,6 +393,53 @@ private:
         value = std::move(*_head->_data);
         return pop_head();
     }
+
+#ifdef __cpp_impl_coroutine
+    /*false if a value turned up meanwhile and the coroutine should not suspend*/
+    bool suspend_waiter(coro::async_waiter<T>& waiter)
+    {
+        std::lock_guard<std::mutex> waitersLock(_waitersMutex);
+        _asyncWaiters.fetch_add(1);
+        std::unique_ptr<node> const oldHead = try_pop_head();
+        if (oldHead)
+        {
+            _asyncWaiters.fetch_sub(1);
+            waiter._value.emplace(std::move(*oldHead->_data));
+            return false;
+        }
+        _waiters.push_back(&waiter);
+        return true;
+    }
+
+    void serve_async_waiters()
+    {
+        coro::waiter_list<T> ready;
+        {
+            std::lock_guard<std::mutex> waitersLock(_waitersMutex);
+            while (!_waiters.empty())
+            {
+                std::unique_ptr<node> const oldHead = try_pop_head();
+                if (!oldHead)
+                {
+                    break;
+                }
+                coro::async_waiter<T>* waiter = _waiters.pop_front();
+                waiter->_value.emplace(std::move(*oldHead->_data));
+                _asyncWaiters.fetch_sub(1);
+                ready.push_back(waiter);
+            }
+        }
+        if (!ready.empty())
+        {
+            after_pop();
+        }
+        /*resumed outside the lock: an inline resume may push or await on this queue again*/
+        while (coro::async_waiter<T>* waiter = ready.pop_front())
+        {
+            waiter->resume();
+        }
+    }
+#endif
 };
 
 THREADSAFT_CONTAINER_END
@@ -4,7 +4,10 @@
 #include <memory>
 #include <mutex>
 #include <stack>
+#include <condition_variable>
 #include "base_def.h"
+#include "container_metrics.hpp"
+#include "async_waiter.hpp"
 
 THREADSAFT_CONTAINER_BEGIN
 
@@ -26,18 +29,47 @@ public:
 
     void push(T newValue)
     {
+#ifdef __cpp_impl_coroutine
+        coro::async_waiter<T>* waiter = nullptr;
+#endif
         SmartPtr4T data = std::make_shared<T>(std::move(newValue));
-        std::lock_guard<std::mutex> l(_m);
-        _data.push(data);
+        {
+            metrics::timestamp waitStart = _metrics.clock();
+            std::lock_guard<std::mutex> l(_m);
+            auto holdScope = _metrics.lock_acquired(waitStart);
+            _metrics.on_push();
+#ifdef __cpp_impl_coroutine
+            /*a suspended coroutine only waits while the stack is empty, so it takes this value directly*/
+            if ((waiter = _waiters.pop_front()) != nullptr)
+            {
+                waiter->_value.emplace(std::move(*data));
+                _metrics.on_pop();
+            }
+            else
+#endif
+            {
+                _data.push(data);
+                _cv.notify_one();
+            }
+        }
+#ifdef __cpp_impl_coroutine
+        if (waiter != nullptr)
+        {
+            waiter->resume();
+        }
+#endif
     }
 
     bool try_pop(T &value)
     {
+        metrics::timestamp waitStart = _metrics.clock();
         std::lock_guard<std::mutex> l(_m);
+        auto holdScope = _metrics.lock_acquired(waitStart);
         if (!_data.empty())
         {
             value = std::move(*_data.top());
             _data.pop();
+            _metrics.on_pop();
             return true;
         }
         return false;
@@ -45,11 +77,14 @@ public:
 
     SmartPtr4T try_pop()
     {
+        metrics::timestamp waitStart = _metrics.clock();
         std::lock_guard<std::mutex> l(_m);
+        auto holdScope = _metrics.lock_acquired(waitStart);
         if (!_data.empty())
         {
             SmartPtr4T res = _data.top();
             _data.pop();
+            _metrics.on_pop();
             return res;
         }
         return nullptr;
@@ -61,6 +96,7 @@ public:
         _cv.wait(ul, [this]() {return !_data.empty(); });
         value = std::move(*_data.top());
         _data.pop();
+        _metrics.on_pop();
     }
 
     SmartPtr4T wait_and_pop()
@@ -69,6 +105,7 @@ public:
         _cv.wait(ul, [this]() {return !_data.empty(); });
         SmartPtr4T res = _data.top();
         _data.pop();
+        _metrics.on_pop();
         return res;
     }
 
@@ -78,6 +115,65 @@ public:
         return _data.empty();
     }
 
+    const metrics::container_metrics_t& get_metrics() const
+    {
+        return _metrics;
+    }
+
+#ifdef __cpp_impl_coroutine
+    class pop_awaiter
+    {
+    public:
+        pop_awaiter(threadsaft_stack& stack, coro::resumer resume)
+            :_stack(stack)
+        {
+            _waiter._resumer = resume;
+        }
+
+        /*the emptiness check happens in await_suspend, under the same lock as the registration*/
+        bool await_ready()
+        {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            _waiter._handle = handle;
+            std::lock_guard<std::mutex> l(_stack._m);
+            if (!_stack._data.empty())
+            {
+                _waiter._value.emplace(std::move(*_stack._data.top()));
+                _stack._data.pop();
+                _stack._metrics.on_pop();
+                return false;
+            }
+            _stack._waiters.push_back(&_waiter);
+            return true;
+        }
+
+        T await_resume()
+        {
+            return std::move(*_waiter._value);
+        }
+
+    private:
+        threadsaft_stack& _stack;
+        coro::async_waiter<T> _waiter;
+    };
+
+    /*Like threadsafe_queue::async_pop: suspends without holding a thread, resumes on the pusher or executor*/
+    pop_awaiter async_pop()
+    {
+        return pop_awaiter(*this, coro::resumer());
+    }
+
+    template<class Executor>
+    pop_awaiter async_pop(Executor& executor)
+    {
+        return pop_awaiter(*this, coro::resumer::on(executor));
+    }
+#endif
+
     friend void swap(threadsaft_stack<T>& lhs, threadsaft_stack<T>& rhs)
     {
         if (&lhs == &rhs)
@@ -94,6 +190,10 @@ private:
     std::stack<SmartPtr4T> _data;
     mutable std::mutex _m;
     std::condition_variable _cv;
+    metrics::container_metrics_t _metrics;
+#ifdef __cpp_impl_coroutine
+    coro::waiter_list<T> _waiters;
+#endif
 };
 
 THREADSAFT_CONTAINER_END
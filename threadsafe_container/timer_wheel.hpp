@@ -0,0 +1,449 @@
+#pragma once
+
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "base_def.h"
+
+THREADSAFT_CONTAINER_BEGIN
+
+/*Identifies one scheduled timer; stays safe to cancel after the timer fired or was cancelled*/
+struct timer_handle
+{
+    void* _node = nullptr;
+    std::uint64_t _id = 0;
+
+    explicit operator bool() const
+    {
+        return _id != 0;
+    }
+};
+
+/*
+ * Hierarchical timing wheel (Varghese & Lauck) driven by one thread: 4 levels of 256 slots cover
+ * 2^32 ticks, so insert and cancel are O(1) list operations however many timers are pending.
+ * A timer that lands on a coarse level is cascaded down when the finer level wraps; the thread
+ * skips ticks while level 0 is empty, so sparse timers do not cost a wakeup per tick.
+ *
+ * Callbacks run on the timer thread one after another and must be short; SimpleThreadPool's
+ * schedule_* functions only post the real work into the pool from here.
+ */
+class timer_wheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+
+    explicit timer_wheel(std::chrono::milliseconds resolution = std::chrono::milliseconds(1))
+        :_resolution(resolution.count() > 0 ? resolution : std::chrono::milliseconds(1)),
+        _epoch(Clock::now())
+    {
+        for (auto& level : _slots)
+        {
+            for (auto& slot : level)
+            {
+                slot._prev = slot._next = &slot;
+            }
+        }
+    }
+
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+    ~timer_wheel()
+    {
+        stop();
+    }
+
+    /*Shared wheel for components that only need an occasional timer (pools, the logger flush)*/
+    static timer_wheel& instance()
+    {
+        static timer_wheel wheel;
+        return wheel;
+    }
+
+    timer_handle schedule_at(Clock::time_point when, Callback callback)
+    {
+        return add(when, Clock::duration::zero(), std::move(callback));
+    }
+
+    template<class Rep, class Period>
+    timer_handle schedule_after(std::chrono::duration<Rep, Period> delay, Callback callback)
+    {
+        return add(Clock::now() + std::chrono::duration_cast<Clock::duration>(delay), Clock::duration::zero(), std::move(callback));
+    }
+
+    /*Fires at now + initialDelay and then every period, without drift accumulating*/
+    template<class Rep, class Period>
+    timer_handle schedule_every(std::chrono::duration<Rep, Period> period, Callback callback)
+    {
+        auto interval = std::chrono::duration_cast<Clock::duration>(period);
+        return add(Clock::now() + interval, interval, std::move(callback));
+    }
+
+    /*
+     * Returns true if the timer was still pending. When its callback is running on the timer thread
+     * right now, waits for it to return (unless called from that callback), so afterwards nothing
+     * the callback uses is touched again.
+     */
+    bool cancel(timer_handle handle)
+    {
+        if (!handle)
+        {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(_m);
+        TimerNode* node = static_cast<TimerNode*>(handle._node);
+        bool pending = node->_id == handle._id;
+        if (pending)
+        {
+            if (node->linked())
+            {
+                unlink_locked(node);
+                if (_runningId != handle._id)
+                {
+                    free_locked(node);
+                }
+            }
+            node->_cancelled = true;
+        }
+        if (std::this_thread::get_id() != _threadId)
+        {
+            _idleCv.wait(lock, [&]() { return _runningId != handle._id; });
+        }
+        return pending;
+    }
+
+    size_t pending() const
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        return _count;
+    }
+
+    /*Drops pending timers and joins the timer thread; later schedules are ignored*/
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            if (_stopped)
+            {
+                return;
+            }
+            _stopped = true;
+        }
+        _cv.notify_all();
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+        std::lock_guard<std::mutex> lock(_m);
+        for (auto& level : _slots)
+        {
+            for (auto& slot : level)
+            {
+                while (slot._next != &slot)
+                {
+                    TimerNode* node = static_cast<TimerNode*>(slot._next);
+                    unlink_locked(node);
+                    free_locked(node);
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr unsigned LEVEL_BITS = 8;
+    static constexpr unsigned LEVELS = 4;
+    static constexpr std::uint64_t SLOTS = std::uint64_t{ 1 } << LEVEL_BITS;
+    static constexpr std::uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr std::uint64_t MAX_DELTA = (std::uint64_t{ 1 } << (LEVEL_BITS * LEVELS)) - 1;
+
+    struct Link
+    {
+        Link* _prev = nullptr;
+        Link* _next = nullptr;
+    };
+
+    struct TimerNode : Link
+    {
+        Callback _callback;
+        std::uint64_t _expire = 0;
+        std::uint64_t _period = 0;
+        std::uint64_t _id = 0;
+        unsigned _level = 0;
+        bool _cancelled = false;
+        TimerNode* _nextFree = nullptr;
+
+        bool linked() const
+        {
+            return _next != nullptr;
+        }
+    };
+
+    std::uint64_t tick_of(Clock::time_point when) const
+    {
+        if (when <= _epoch)
+        {
+            return 0;
+        }
+        /*round up so a timer never fires before its time*/
+        return static_cast<std::uint64_t>((when - _epoch + _resolution - Clock::duration(1)) / _resolution);
+    }
+
+    std::uint64_t current_tick() const
+    {
+        return static_cast<std::uint64_t>((Clock::now() - _epoch) / _resolution);
+    }
+
+    Clock::time_point time_of(std::uint64_t tick) const
+    {
+        return _epoch + tick * _resolution;
+    }
+
+    timer_handle add(Clock::time_point when, Clock::duration period, Callback callback)
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        if (_stopped)
+        {
+            return timer_handle{};
+        }
+        if (!_thread.joinable())
+        {
+            _thread = std::thread([this]() { run(); });
+            _threadId = _thread.get_id();
+        }
+        TimerNode* node = allocate_locked();
+        node->_callback = std::move(callback);
+        node->_expire = tick_of(when);
+        node->_period = period.count() > 0 ? std::max<std::uint64_t>(1, (period + _resolution - Clock::duration(1)) / _resolution) : 0;
+        node->_cancelled = false;
+        insert_locked(node);
+        if (node->_expire < _wakeTick)
+        {
+            _wakeTick = node->_expire;
+            _cv.notify_one();
+        }
+        return timer_handle{ node, node->_id };
+    }
+
+    TimerNode* allocate_locked()
+    {
+        TimerNode* node = _freeList;
+        if (node != nullptr)
+        {
+            _freeList = node->_nextFree;
+        }
+        else
+        {
+            /*nodes are never returned to the allocator, so stale handles always point at valid memory*/
+            _nodes.emplace_back();
+            node = &_nodes.back();
+        }
+        node->_id = ++_lastId;
+        return node;
+    }
+
+    void free_locked(TimerNode* node)
+    {
+        node->_id = 0;
+        node->_callback = nullptr;
+        node->_nextFree = _freeList;
+        _freeList = node;
+    }
+
+    void insert_locked(TimerNode* node)
+    {
+        if (node->_expire <= _now)
+        {
+            node->_expire = _now + 1;
+        }
+        std::uint64_t delta = std::min(node->_expire - _now, MAX_DELTA);
+        std::uint64_t slotTick = _now + delta;
+        unsigned level = 0;
+        while (level + 1 < LEVELS && delta >= (std::uint64_t{ 1 } << (LEVEL_BITS * (level + 1))))
+        {
+            ++level;
+        }
+        Link& slot = _slots[level][(slotTick >> (LEVEL_BITS * level)) & SLOT_MASK];
+        node->_level = level;
+        node->_prev = slot._prev;
+        node->_next = &slot;
+        slot._prev->_next = node;
+        slot._prev = node;
+        ++_levelCounts[level];
+        ++_count;
+    }
+
+    void unlink_locked(TimerNode* node)
+    {
+        node->_prev->_next = node->_next;
+        node->_next->_prev = node->_prev;
+        node->_prev = node->_next = nullptr;
+        --_levelCounts[node->_level];
+        --_count;
+    }
+
+    /*Moves one slot of a coarser level down to the finer levels*/
+    void cascade_locked(unsigned level)
+    {
+        Link& slot = _slots[level][(_now >> (LEVEL_BITS * level)) & SLOT_MASK];
+        Link pending;
+        pending._prev = pending._next = &pending;
+        if (slot._next != &slot)
+        {
+            pending._next = slot._next;
+            pending._prev = slot._prev;
+            pending._next->_prev = &pending;
+            pending._prev->_next = &pending;
+            slot._prev = slot._next = &slot;
+        }
+        while (pending._next != &pending)
+        {
+            TimerNode* node = static_cast<TimerNode*>(pending._next);
+            pending._next = node->_next;
+            node->_next->_prev = &pending;
+            --_levelCounts[node->_level];
+            --_count;
+            insert_locked(node);
+        }
+    }
+
+    void advance_locked(std::vector<TimerNode*>& due)
+    {
+        ++_now;
+        for (unsigned level = 1; level < LEVELS; ++level)
+        {
+            if ((_now & ((std::uint64_t{ 1 } << (LEVEL_BITS * level)) - 1)) != 0)
+            {
+                break;
+            }
+            cascade_locked(level);
+        }
+        Link& slot = _slots[0][_now & SLOT_MASK];
+        while (slot._next != &slot)
+        {
+            TimerNode* node = static_cast<TimerNode*>(slot._next);
+            unlink_locked(node);
+            if (node->_expire > _now)
+            {
+                /*clamped to the wheel's span on insert; not due yet*/
+                insert_locked(node);
+                continue;
+            }
+            due.push_back(node);
+        }
+    }
+
+    void fire_locked(std::unique_lock<std::mutex>& lock, std::vector<TimerNode*>& due)
+    {
+        for (TimerNode* node : due)
+        {
+            if (node->_cancelled)
+            {
+                /*cancelled while an earlier callback of this batch was running*/
+                free_locked(node);
+                continue;
+            }
+            std::uint64_t id = node->_id;
+            Callback oneShot;
+            Callback* callback = &node->_callback;
+            if (node->_period != 0)
+            {
+                node->_expire += node->_period;
+                insert_locked(node);
+            }
+            else
+            {
+                oneShot = std::move(node->_callback);
+                callback = &oneShot;
+                free_locked(node);
+            }
+            _runningId = id;
+            lock.unlock();
+            (*callback)();
+            lock.lock();
+            _runningId = 0;
+            if (node->_id == id && node->_cancelled && !node->linked())
+            {
+                free_locked(node);
+            }
+            _idleCv.notify_all();
+        }
+        due.clear();
+    }
+
+    void run()
+    {
+        std::vector<TimerNode*> due;
+        std::unique_lock<std::mutex> lock(_m);
+        while (!_stopped)
+        {
+            std::uint64_t target = current_tick();
+            if (_count == 0)
+            {
+                _now = std::max(_now, target);
+                _wakeTick = UINT64_MAX;
+                _cv.wait(lock, [this]() { return _stopped || _count != 0; });
+                continue;
+            }
+            while (_now < target && !_stopped)
+            {
+                if (_levelCounts[0] == 0)
+                {
+                    /*nothing can fire before level 0 wraps and the next cascade happens*/
+                    std::uint64_t boundary = _now | SLOT_MASK;
+                    if (boundary >= target)
+                    {
+                        _now = target;
+                        break;
+                    }
+                    _now = boundary;
+                }
+                advance_locked(due);
+                if (!due.empty())
+                {
+                    fire_locked(lock, due);
+                    target = current_tick();
+                }
+            }
+            std::uint64_t wakeTick = _levelCounts[0] != 0 ? _now + 1 : (_now | SLOT_MASK) + 1;
+            _wakeTick = wakeTick;
+            _cv.wait_until(lock, time_of(wakeTick), [&]() { return _stopped || _wakeTick < wakeTick; });
+        }
+    }
+
+private:
+    const Clock::duration _resolution;
+    const Clock::time_point _epoch;
+    mutable std::mutex _m;
+    std::condition_variable _cv;
+    std::condition_variable _idleCv;
+    std::array<std::array<Link, SLOTS>, LEVELS> _slots;
+    std::array<size_t, LEVELS> _levelCounts{};
+    std::deque<TimerNode> _nodes;
+    TimerNode* _freeList = nullptr;
+    size_t _count = 0;
+    std::uint64_t _now = 0;
+    std::uint64_t _wakeTick = UINT64_MAX;
+    std::uint64_t _lastId = 0;
+    std::uint64_t _runningId = 0;
+    bool _stopped = false;
+    std::thread _thread;
+    std::thread::id _threadId;
+};
+
+THREADSAFT_CONTAINER_END
+
+#endif //!__TIMER_WHEEL_H__